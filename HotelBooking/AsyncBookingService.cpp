@@ -0,0 +1,157 @@
+#include "AsyncBookingService.h"
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+struct AsyncBookingService::Shard
+{
+	explicit Shard(const BookingServiceOptions& options)
+		: service(options)
+	{
+	}
+
+	BookingService service;
+	std::mutex mutex;
+	std::condition_variable operationsAdded;
+	// Awaited operations in reverse order, guarded by the mutex
+	Operation* pendingOperations = nullptr;
+	bool stopping = false;
+	std::thread thread;
+};
+
+AsyncBookingService::AsyncBookingService(const BookingServiceOptions& options, unsigned shardCount)
+{
+	if (shardCount == 0)
+	{
+		throw std::invalid_argument("Shard count must be positive");
+	}
+	if (options.expireIdleHotels)
+	{
+		throw std::invalid_argument("Idle hotels can't expire without the latest booking of all hotels");
+	}
+	m_shards.reserve(shardCount);
+	for (unsigned i = 0; i < shardCount; ++i)
+	{
+		m_shards.push_back(std::make_unique<Shard>(options));
+	}
+	try
+	{
+		for (auto& shard : m_shards)
+		{
+			shard->thread = std::thread([this, &shard = *shard] {
+				RunShard(shard);
+			});
+		}
+	}
+	catch (...)
+	{
+		StopShards();
+		throw;
+	}
+}
+
+AsyncBookingService::~AsyncBookingService()
+{
+	StopShards();
+}
+
+void AsyncBookingService::StopShards() noexcept
+{
+	for (auto& shard : m_shards)
+	{
+		{
+			std::lock_guard lock(shard->mutex);
+			shard->stopping = true;
+		}
+		shard->operationsAdded.notify_one();
+	}
+	for (auto& shard : m_shards)
+	{
+		if (shard->thread.joinable())
+		{
+			shard->thread.join();
+		}
+	}
+}
+
+size_t AsyncBookingService::GetShardCount() const noexcept
+{
+	return m_shards.size();
+}
+
+AsyncBookingService::Statistics AsyncBookingService::GetStatistics() const noexcept
+{
+	Statistics statistics;
+	statistics.operationCount = m_operationCount.load(std::memory_order_relaxed);
+	statistics.batchCount = m_batchCount.load(std::memory_order_relaxed);
+	return statistics;
+}
+
+size_t AsyncBookingService::GetShardIndex(const std::string& hotelName) const noexcept
+{
+	return std::hash<std::string>()(hotelName) % m_shards.size();
+}
+
+void AsyncBookingService::Enqueue(size_t shardIndex, Operation& operation)
+{
+	auto& shard = *m_shards[shardIndex];
+	bool wasIdle;
+	{
+		std::lock_guard lock(shard.mutex);
+		wasIdle = !shard.pendingOperations;
+		operation.next = shard.pendingOperations;
+		shard.pendingOperations = &operation;
+	}
+	// A shard having pending operations is awake already
+	if (wasIdle)
+	{
+		shard.operationsAdded.notify_one();
+	}
+}
+
+void AsyncBookingService::RunShard(Shard& shard) noexcept
+{
+	for (;;)
+	{
+		Operation* reversed;
+		{
+			std::unique_lock lock(shard.mutex);
+			shard.operationsAdded.wait(lock, [&shard] {
+				return shard.pendingOperations || shard.stopping;
+			});
+			if (!shard.pendingOperations)
+			{
+				return;
+			}
+			reversed = std::exchange(shard.pendingOperations, nullptr);
+		}
+		Operation* batch = nullptr;
+		size_t batchSize = 0;
+		while (reversed)
+		{
+			auto operation = std::exchange(reversed, reversed->next);
+			operation->next = batch;
+			batch = operation;
+			++batchSize;
+		}
+		// Every operation of the batch is executed before any coroutine resumes and awaits again
+		for (auto operation = batch; operation; operation = operation->next)
+		{
+			operation->Execute(shard.service);
+		}
+		m_operationCount.fetch_add(batchSize, std::memory_order_relaxed);
+		m_batchCount.fetch_add(1, std::memory_order_relaxed);
+		while (batch)
+		{
+			// Resuming destroys the awaiter holding the operation
+			const auto continuation = batch->continuation;
+			batch = batch->next;
+			continuation.resume();
+		}
+	}
+}
+#endif
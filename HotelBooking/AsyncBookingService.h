@@ -0,0 +1,165 @@
+#pragma once
+#include "BookingService.h"
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/*
+Runs BookingService operations on per-shard executor threads for coroutine callers (C++20 only):
+	co_await service.BookAsync(time, hotelName, clientId, roomCount);
+	const auto rooms = co_await service.GetBookedRoomCountAsync(hotelName);
+Hotels are distributed over shards by the hash of their names, and every shard owns a BookingService and a thread.
+An awaiting coroutine suspends without blocking its thread. A shard takes all operations pending at once,
+executes them as a batch and then resumes their coroutines on the shard thread in the order they were awaited.
+Statistics over all hotels are not available since hotels are spread over shards
+*/
+class AsyncBookingService final
+{
+	// Operation waiting in a shard queue. It is stored in the awaiter, so queueing doesn't allocate
+	class Operation
+	{
+	public:
+		Operation() = default;
+		Operation(const Operation&) = delete;
+		Operation& operator=(const Operation&) = delete;
+
+		// Stores the result or the exception thrown
+		virtual void Execute(BookingService& service) noexcept = 0;
+
+		std::coroutine_handle<> continuation;
+		Operation* next = nullptr;
+
+	protected:
+		~Operation() = default;
+	};
+
+public:
+	template <typename Function>
+	class Awaiter final : private Operation
+	{
+	public:
+		using Result = std::invoke_result_t<Function&, BookingService&>;
+
+		Awaiter(AsyncBookingService& service, size_t shardIndex, Function function)
+			: m_service(service)
+			, m_shardIndex(shardIndex)
+			, m_function(std::move(function))
+		{
+		}
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		void await_suspend(std::coroutine_handle<> continuation)
+		{
+			this->continuation = continuation;
+			m_service.Enqueue(m_shardIndex, *this);
+		}
+
+		// Throws what the service has thrown
+		Result await_resume()
+		{
+			if (m_error)
+			{
+				std::rethrow_exception(m_error);
+			}
+			if constexpr (!std::is_void_v<Result>)
+			{
+				return std::move(*m_result);
+			}
+		}
+
+	private:
+		void Execute(BookingService& service) noexcept override
+		{
+			try
+			{
+				if constexpr (std::is_void_v<Result>)
+				{
+					m_function(service);
+				}
+				else
+				{
+					m_result.emplace(m_function(service));
+				}
+			}
+			catch (...)
+			{
+				m_error = std::current_exception();
+			}
+		}
+
+		AsyncBookingService& m_service;
+		size_t m_shardIndex;
+		Function m_function;
+		std::optional<std::conditional_t<std::is_void_v<Result>, bool, Result>> m_result;
+		std::exception_ptr m_error;
+	};
+
+	struct Statistics
+	{
+		std::uint64_t operationCount = 0;
+		std::uint64_t batchCount = 0;
+	};
+
+	// Starts shardCount threads. Throws std::invalid_argument if shardCount is 0 or if idle hotels expire,
+	// since a shard would expire its hotels against its own latest booking
+	AsyncBookingService(const BookingServiceOptions& options, unsigned shardCount);
+	// Completes the pending operations and stops the shard threads. Nothing may be awaited meanwhile
+	~AsyncBookingService();
+
+	AsyncBookingService(const AsyncBookingService&) = delete;
+	AsyncBookingService& operator=(const AsyncBookingService&) = delete;
+
+	// Booking ids are not exposed since every shard numbers its bookings
+	auto BookAsync(Time time, std::string hotelName, ClientId clientId, RoomCount roomCount)
+	{
+		const auto shardIndex = GetShardIndex(hotelName);
+		return Awaiter(*this, shardIndex, [=, hotelName = std::move(hotelName)](BookingService& service) {
+			service.Book(time, hotelName, clientId, roomCount);
+		});
+	}
+
+	auto GetDistinctClientCountAsync(std::string hotelName, size_t spanIndex = 0)
+	{
+		const auto shardIndex = GetShardIndex(hotelName);
+		return Awaiter(*this, shardIndex, [=, hotelName = std::move(hotelName)](BookingService& service) {
+			return service.GetDistinctClientCount(hotelName, spanIndex);
+		});
+	}
+
+	auto GetBookedRoomCountAsync(std::string hotelName, size_t spanIndex = 0)
+	{
+		const auto shardIndex = GetShardIndex(hotelName);
+		return Awaiter(*this, shardIndex, [=, hotelName = std::move(hotelName)](BookingService& service) {
+			return service.GetBookedRoomCount(hotelName, spanIndex);
+		});
+	}
+
+	size_t GetShardCount() const noexcept;
+
+	// May be read while the shards run
+	Statistics GetStatistics() const noexcept;
+
+private:
+	struct Shard;
+
+	size_t GetShardIndex(const std::string& hotelName) const noexcept;
+	void Enqueue(size_t shardIndex, Operation& operation);
+	void RunShard(Shard& shard) noexcept;
+	// Lets the running shard threads complete the pending operations and joins them
+	void StopShards() noexcept;
+
+	std::vector<std::unique_ptr<Shard>> m_shards;
+	std::atomic<std::uint64_t> m_operationCount{ 0 };
+	std::atomic<std::uint64_t> m_batchCount{ 0 };
+};
+#endif
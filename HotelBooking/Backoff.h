@@ -0,0 +1,35 @@
+#pragma once
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+// Spins for a while and then yields, so a waiting thread doesn't starve others when threads outnumber cores
+class Backoff final
+{
+public:
+	void Pause() noexcept
+	{
+		if (m_spinCount < SpinLimit)
+		{
+			++m_spinCount;
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+			_mm_pause();
+#endif
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	void Reset() noexcept
+	{
+		m_spinCount = 0;
+	}
+
+private:
+	static constexpr unsigned SpinLimit = 256;
+	unsigned m_spinCount = 0;
+};
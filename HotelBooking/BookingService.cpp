@@ -1,35 +1,582 @@
 #include "BookingService.h"
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace
+{
+// Orders hotel expiries in a min-heap
+const auto expiresLater = [](const auto& lhs, const auto& rhs) noexcept {
+	return lhs.latestBookingTime > rhs.latestBookingTime;
+};
+} // namespace
+
+// Forwards clients entering and leaving the first time span of a hotel to the client hotel index
+// and bookings moving in and leaving the booking history to the booking handles
+class BookingService::HotelBookingsObserver final : public BookingObserver
+{
+public:
+	HotelBookingsObserver(ClientHotelIndex* index, BookingHandleMap* handles, const std::string& hotelName) noexcept
+		: m_index(index)
+		, m_handles(handles)
+		, m_hotelName(hotelName)
+	{
+	}
+
+	void OnClientAdded(ClientId clientId) override
+	{
+		if (m_index)
+		{
+			m_index->Add(clientId, m_hotelName);
+		}
+	}
+
+	void OnClientRemoved(ClientId clientId) noexcept override
+	{
+		if (m_index)
+		{
+			m_index->Remove(clientId, m_hotelName);
+		}
+	}
+
+	void OnBookingMoved(BookingId id, std::uint64_t sequence) noexcept override
+	{
+		if (auto it = m_handles->find(id); it != m_handles->end())
+		{
+			it->second.sequence = sequence;
+		}
+	}
+
+	void OnBookingDiscarded(BookingId id) noexcept override
+	{
+		m_handles->erase(id);
+	}
+
+private:
+	ClientHotelIndex* m_index;
+	BookingHandleMap* m_handles;
+	const std::string& m_hotelName;
+};
 
 BookingService::BookingService(Time statisticTimeSpan)
-	: m_statisticTimeSpan(statisticTimeSpan)
+	: BookingService(std::vector<Time>{ statisticTimeSpan })
+{
+}
+
+BookingService::BookingService(std::vector<Time> statisticTimeSpans)
+	: BookingService(BookingServiceOptions{ std::move(statisticTimeSpans) })
 {
 }
 
-void BookingService::Book(Time time, const std::string& hotelName, ClientId clientId, RoomCount roomCount)
+BookingService::BookingService(BookingServiceOptions options)
+	: m_statisticTimeSpans(std::move(options.statisticTimeSpans))
+	, m_totals(m_statisticTimeSpans.size())
+	, m_maxLateness(options.maxLateness)
+	, m_rejectTooLate(options.rejectTooLate)
+	, m_retentionHorizon(options.retentionHorizon)
+	, m_hotelBookings(&m_hotelMapMemory)
+	, m_compactHotels(options.compactHotels)
+	, m_hotelExpiries(&m_hotelMapMemory)
 {
-	GetHotelBookings(hotelName).Book(time, clientId, roomCount);
+	if (m_statisticTimeSpans.empty())
+	{
+		throw std::invalid_argument("At least one statistic time span is required");
+	}
+	const auto longestSpan = *std::max_element(m_statisticTimeSpans.begin(), m_statisticTimeSpans.end());
+	m_forgetsLatestBooking = longestSpan <= 0 && m_retentionHorizon <= 0 && !m_rejectTooLate;
+	if (options.expireIdleHotels)
+	{
+		// Bookings of an idle hotel have left all time spans and the retention horizon, and late bookings can't enter them
+		m_idleHotelHorizon = std::max(longestSpan, m_retentionHorizon) + m_maxLateness;
+	}
+	if (options.rankHotels)
+	{
+		m_hotelRanking.emplace(&m_hotelRankingMemory);
+	}
+	if (options.indexClientHotels)
+	{
+		m_clientHotelIndex.emplace(&m_clientHotelIndexMemory);
+	}
+	if (options.cancellable)
+	{
+		m_bookingHandles.emplace(&m_bookingHandleMemory);
+	}
+}
+
+BookingId BookingService::Book(Time time, const std::string& hotelName, ClientId clientId, RoomCount roomCount)
+{
+	const auto id = ++m_lastBookingId;
+#ifdef COLLECT_SERVICE_METRICS
+	const auto hotelBucketCount = GetHotelBucketCount();
+#endif
+	auto& hotel = GetHotel(hotelName);
+	auto& [storedHotelName, hotelBookings] = hotel;
+	const auto bookedRooms = hotelBookings.GetBookedRoomCount();
+	const bool wasEmpty = IsDroppable(hotelBookings);
+#ifdef COLLECT_SERVICE_METRICS
+	const auto evictedBookingCount = hotelBookings.GetEvictedBookingCount();
+	const auto clientBucketCount = hotelBookings.GetClientBucketCount();
+#endif
+
+	std::optional<HotelBookingsObserver> observer;
+	if (m_clientHotelIndex || m_bookingHandles)
+	{
+		observer.emplace(m_clientHotelIndex ? &*m_clientHotelIndex : nullptr,
+			m_bookingHandles ? &*m_bookingHandles : nullptr, storedHotelName);
+	}
+	if (m_bookingHandles)
+	{
+		// The handle is added in advance since the booking may be moved or discarded while it is being made
+		m_bookingHandles->try_emplace(id, BookingHandle{ &hotel, 0 });
+	}
+	if (m_idleHotelHorizon && hotelBookings.GetLatestBookingTime() == std::numeric_limits<Time>::min())
+	{
+		try
+		{
+			// The first booking of a hotel is made at its time. If it fails, the entry is discarded once it expires
+			m_hotelExpiries.push_back({ time, storedHotelName });
+		}
+		catch (...)
+		{
+			if (m_bookingHandles)
+			{
+				m_bookingHandles->erase(id);
+			}
+			throw;
+		}
+		std::push_heap(m_hotelExpiries.begin(), m_hotelExpiries.end(), expiresLater);
+	}
+
+	SubtractFromTotals(hotelBookings);
+	std::optional<std::uint64_t> sequence;
+	try
+	{
+		sequence = hotelBookings.Book(time, clientId, roomCount, observer ? &*observer : nullptr, m_bookingHandles ? id : 0);
+	}
+	catch (...)
+	{
+		AddToTotals(hotelBookings);
+		if (m_bookingHandles)
+		{
+			m_bookingHandles->erase(id);
+		}
+		throw;
+	}
+	AddToTotals(hotelBookings);
+	if (m_bookingHandles)
+	{
+		if (sequence)
+		{
+			m_bookingHandles->find(id)->second.sequence = *sequence;
+		}
+		else
+		{
+			m_bookingHandles->erase(id);
+		}
+	}
+
+	if (m_hotelRanking)
+	{
+		m_hotelRanking->Update(storedHotelName, bookedRooms, hotelBookings.GetBookedRoomCount());
+	}
+#ifdef COLLECT_SERVICE_METRICS
+	m_metrics.CountBook(static_cast<size_t>(hotelBookings.GetEvictedBookingCount() - evictedBookingCount),
+		hotelBookings.GetWindowBookingCount(),
+		hotelBucketCount != GetHotelBucketCount(),
+		clientBucketCount != hotelBookings.GetClientBucketCount());
+#endif
+
+	m_latestBookingTime = std::max(m_latestBookingTime, hotelBookings.GetLatestBookingTime());
+	UpdateEmptyHotelCount(wasEmpty, IsDroppable(hotelBookings));
+	if (m_idleHotelHorizon)
+	{
+		ExpireIdleHotels();
+	}
+	return id;
+}
+
+bool BookingService::Cancel(BookingId id)
+{
+	if (!m_bookingHandles)
+	{
+		throw std::logic_error("Booking cancellation is not enabled");
+	}
+	auto it = m_bookingHandles->find(id);
+	if (it == m_bookingHandles->end())
+	{
+		return false;
+	}
+	auto& [hotelName, hotelBookings] = *it->second.hotel;
+	const auto sequence = it->second.sequence;
+	m_bookingHandles->erase(it);
+
+	const auto bookedRooms = hotelBookings.GetBookedRoomCount();
+	std::optional<HotelBookingsObserver> observer;
+	if (m_clientHotelIndex)
+	{
+		observer.emplace(&*m_clientHotelIndex, &*m_bookingHandles, hotelName);
+	}
+	SubtractFromTotals(hotelBookings);
+	hotelBookings.Cancel(sequence, observer ? &*observer : nullptr);
+	AddToTotals(hotelBookings);
+
+	if (m_hotelRanking)
+	{
+		m_hotelRanking->Update(hotelName, bookedRooms, hotelBookings.GetBookedRoomCount());
+	}
+	m_metrics.CountCancel();
+	// The latest booking time of the hotel is kept to check lateness of the bookings that follow
+	UpdateEmptyHotelCount(false, IsDroppable(hotelBookings));
+	return true;
 }
 
 size_t BookingService::GetDistinctClientCount(const std::string& hotelName) const noexcept
 {
+	m_metrics.CountClientsQuery();
 	auto optHotelBookings = FindHotelBookings(hotelName);
 	return optHotelBookings ? optHotelBookings->GetDistinctClientCount() : 0;
 }
 
 RoomCount BookingService::GetBookedRoomCount(const std::string& hotelName) const noexcept
 {
+	m_metrics.CountRoomsQuery();
 	auto optHotelBookings = FindHotelBookings(hotelName);
 	return optHotelBookings ? optHotelBookings->GetBookedRoomCount() : 0;
 }
 
+size_t BookingService::GetDistinctClientCount(const std::string& hotelName, size_t spanIndex) const
+{
+	CheckSpanIndex(spanIndex);
+	m_metrics.CountClientsQuery();
+	auto optHotelBookings = FindHotelBookings(hotelName);
+	return optHotelBookings ? optHotelBookings->GetDistinctClientCount(spanIndex) : 0;
+}
+
+RoomCount BookingService::GetBookedRoomCount(const std::string& hotelName, size_t spanIndex) const
+{
+	CheckSpanIndex(spanIndex);
+	m_metrics.CountRoomsQuery();
+	auto optHotelBookings = FindHotelBookings(hotelName);
+	return optHotelBookings ? optHotelBookings->GetBookedRoomCount(spanIndex) : 0;
+}
+
+std::uint64_t BookingService::GetTotalBookedRoomCount() const noexcept
+{
+	return m_totals.front().bookedRooms;
+}
+
+std::uint64_t BookingService::GetTotalBookingCount() const noexcept
+{
+	return m_totals.front().bookingCount;
+}
+
+std::uint64_t BookingService::GetTotalBookedRoomCount(size_t spanIndex) const
+{
+	CheckSpanIndex(spanIndex);
+	return m_totals[spanIndex].bookedRooms;
+}
+
+std::uint64_t BookingService::GetTotalBookingCount(size_t spanIndex) const
+{
+	CheckSpanIndex(spanIndex);
+	return m_totals[spanIndex].bookingCount;
+}
+
+std::vector<HotelRoomCount> BookingService::GetTopHotels(size_t count) const
+{
+	if (!m_hotelRanking)
+	{
+		throw std::logic_error("Hotel ranking is not enabled");
+	}
+	return m_hotelRanking->GetTop(count);
+}
+
+size_t BookingService::GetClientHotelCount(ClientId clientId) const
+{
+	return GetClientHotelIndex().GetHotelCount(clientId);
+}
+
+std::vector<std::string> BookingService::GetClientHotels(ClientId clientId) const
+{
+	return GetClientHotelIndex().GetHotels(clientId);
+}
+
+const std::vector<Time>& BookingService::GetStatisticTimeSpans() const noexcept
+{
+	return m_statisticTimeSpans;
+}
+
+RoomCount BookingService::GetBookedRoomCount(const std::string& hotelName, Time from, Time to) const noexcept
+{
+	m_metrics.CountRoomsRangeQuery();
+	auto optHotelBookings = FindHotelBookings(hotelName);
+	return optHotelBookings ? optHotelBookings->GetBookedRoomCount(from, to) : 0;
+}
+
+size_t BookingService::CompactHotels() noexcept
+{
+	m_emptyHotelCount = 0;
+	size_t droppedHotelCount = 0;
+	for (auto it = m_hotelBookings.begin(); it != m_hotelBookings.end();)
+	{
+		auto& [hotelName, hotelBookings] = *it;
+		if (!IsDroppable(hotelBookings))
+		{
+			++it;
+			continue;
+		}
+		// The hotel has neither rooms nor clients, so the totals and the client hotel index don't refer to it
+		if (m_hotelRanking)
+		{
+			m_hotelRanking->Erase(hotelName, hotelBookings.GetBookedRoomCount());
+		}
+		it = m_hotelBookings.erase(it);
+		++droppedHotelCount;
+	}
+	ShrinkHotelMap();
+	m_metrics.CountDroppedHotels(droppedHotelCount);
+	return droppedHotelCount;
+}
+
+size_t BookingService::GetDistinctClientCountAt(const std::string& hotelName, Time time, size_t spanIndex) const
+{
+	CheckHistoryRetained();
+	CheckSpanIndex(spanIndex);
+	auto optHotelBookings = FindHotelBookings(hotelName);
+	return optHotelBookings ? optHotelBookings->GetDistinctClientCountAt(time, spanIndex) : 0;
+}
+
+RoomCount BookingService::GetBookedRoomCountAt(const std::string& hotelName, Time time, size_t spanIndex) const
+{
+	CheckHistoryRetained();
+	CheckSpanIndex(spanIndex);
+	auto optHotelBookings = FindHotelBookings(hotelName);
+	return optHotelBookings ? optHotelBookings->GetBookedRoomCountAt(time, spanIndex) : 0;
+}
+
+ServiceMetrics BookingService::GetMetrics() const noexcept
+{
+	ServiceMetrics metrics;
+	m_metrics.CopyTo(metrics);
+
+	metrics.hotelCount = m_hotelBookings.size();
+	metrics.hotelMapBucketCount = GetHotelBucketCount();
+	if (metrics.hotelMapBucketCount != 0)
+	{
+		metrics.hotelMapLoadFactor = float(metrics.hotelCount) / metrics.hotelMapBucketCount;
+	}
+
+	for (auto& [hotelName, hotelBookings] : m_hotelBookings)
+	{
+		metrics.clientMapEntryCount += hotelBookings.GetDistinctClientCount();
+		metrics.clientMapBucketCount += hotelBookings.GetClientBucketCount();
+	}
+	if (metrics.clientMapBucketCount != 0)
+	{
+		metrics.clientMapLoadFactor = float(metrics.clientMapEntryCount) / metrics.clientMapBucketCount;
+	}
+	metrics.shrinkCount = m_hotelMapShrinkCount + m_bookingMemory.shrinkCount.load(std::memory_order_relaxed);
+	metrics.reclaimedBytes = m_hotelMapReclaimedBytes + m_bookingMemory.reclaimedBytes.load(std::memory_order_relaxed);
+	return metrics;
+}
+
+MemoryUsage BookingService::GetMemoryUsage() const noexcept
+{
+	MemoryUsage usage;
+	usage.hotelMap = m_hotelMapMemory.GetStatistics();
+	usage.bookings = m_bookingMemory.bookings.GetStatistics();
+	usage.clientMaps = m_bookingMemory.clients.GetStatistics();
+	usage.windows = m_bookingMemory.windows.GetStatistics();
+	usage.hotelRanking = m_hotelRankingMemory.GetStatistics();
+	usage.clientHotelIndex = m_clientHotelIndexMemory.GetStatistics();
+	usage.bookingHandles = m_bookingHandleMemory.GetStatistics();
+	usage.hotelCount = m_hotelBookings.size();
+
+	const auto smallStringCapacity = std::string().capacity();
+	for (auto& [hotelName, hotelBookings] : m_hotelBookings)
+	{
+		usage.bookingCount += hotelBookings.GetBookingCount();
+		if (hotelName.capacity() > smallStringCapacity)
+		{
+			// Names are allocated by the default allocator, so the overhead is not estimated
+			usage.hotelNames.bytes += hotelName.capacity() + 1;
+			++usage.hotelNames.blocks;
+		}
+	}
+	return usage;
+}
+
 const HotelBookings* BookingService::FindHotelBookings(const std::string& hotelName) const noexcept
 {
 	auto it = m_hotelBookings.find(hotelName);
 	return it != m_hotelBookings.end() ? &(it->second) : nullptr;
 }
 
-HotelBookings& BookingService::GetHotelBookings(const std::string& hotelName)
+BookingService::HotelMap::value_type& BookingService::GetHotel(const std::string& hotelName)
+{
+	// Create new hotel or use existing one.
+	// Unlike emplace, try_emplace doesn't construct a node (and its HotelBookings) when the hotel exists
+	auto [it, inserted] = m_hotelBookings.try_emplace(hotelName, m_statisticTimeSpans, &m_bookingMemory,
+		BookingHistoryOptions{ m_maxLateness, m_retentionHorizon, m_bookingHandles.has_value(), m_rejectTooLate });
+	if (inserted && m_hotelRanking)
+	{
+		try
+		{
+			m_hotelRanking->Insert(it->first);
+		}
+		catch (...)
+		{
+			m_hotelBookings.erase(it);
+			throw;
+		}
+	}
+	if (inserted)
+	{
+		++m_emptyHotelCount;
+	}
+	return *it;
+}
+
+size_t BookingService::GetHotelBucketCount() const noexcept
+{
+#ifdef USE_UNORDERED_MAP_FOR_STORING_HOTELS
+	return m_hotelBookings.bucket_count();
+#else
+	return 0;
+#endif
+}
+
+void BookingService::ShrinkHotelMap() noexcept
+{
+#ifdef USE_UNORDERED_MAP_FOR_STORING_HOTELS
+	if (m_hotelBookings.size() * HotelBookings::ShrinkRatio >= m_hotelBookings.bucket_count())
+	{
+		return;
+	}
+	const auto allocatedBytes = m_hotelMapMemory.GetStatistics().GetTotalBytes();
+	try
+	{
+		// Leave room to double before the hotel map grows again
+		m_hotelBookings.rehash(m_hotelBookings.size() * 2);
+	}
+	catch (...)
+	{
+		// Shrinking is an optimization, the hotel map stays valid if it fails
+		return;
+	}
+	const auto shrunkBytes = m_hotelMapMemory.GetStatistics().GetTotalBytes();
+	++m_hotelMapShrinkCount;
+	m_hotelMapReclaimedBytes += allocatedBytes > shrunkBytes ? allocatedBytes - shrunkBytes : 0;
+#endif
+}
+
+void BookingService::CheckSpanIndex(size_t spanIndex) const
+{
+	if (spanIndex >= m_statisticTimeSpans.size())
+	{
+		throw std::out_of_range("Statistic time span index is out of range");
+	}
+}
+
+const ClientHotelIndex& BookingService::GetClientHotelIndex() const
+{
+	if (!m_clientHotelIndex)
+	{
+		throw std::logic_error("Client hotel index is not enabled");
+	}
+	return *m_clientHotelIndex;
+}
+
+void BookingService::CheckHistoryRetained() const
+{
+	if (m_retentionHorizon <= 0)
+	{
+		throw std::logic_error("Booking history is not retained");
+	}
+}
+
+void BookingService::SubtractFromTotals(const HotelBookings& hotelBookings) noexcept
+{
+	for (size_t i = 0; i < m_totals.size(); ++i)
+	{
+		m_totals[i].bookedRooms -= hotelBookings.GetBookedRoomCount(i);
+		m_totals[i].bookingCount -= hotelBookings.GetBookingCount(i);
+	}
+}
+
+void BookingService::AddToTotals(const HotelBookings& hotelBookings) noexcept
+{
+	for (size_t i = 0; i < m_totals.size(); ++i)
+	{
+		m_totals[i].bookedRooms += hotelBookings.GetBookedRoomCount(i);
+		m_totals[i].bookingCount += hotelBookings.GetBookingCount(i);
+	}
+}
+
+size_t BookingService::GetHotelCount() const noexcept
+{
+	return m_hotelBookings.size();
+}
+
+void BookingService::ExpireIdleHotels() noexcept
+{
+	size_t expiredHotelCount = 0;
+	while (!m_hotelExpiries.empty() && m_latestBookingTime - m_hotelExpiries.front().latestBookingTime >= *m_idleHotelHorizon)
+	{
+		std::pop_heap(m_hotelExpiries.begin(), m_hotelExpiries.end(), expiresLater);
+		auto& expiry = m_hotelExpiries.back();
+		auto it = m_hotelBookings.find(expiry.hotelName);
+		// The hotel may have been dropped by compaction, or no booking of it may have been made
+		if (it != m_hotelBookings.end() && it->second.GetLatestBookingTime() != std::numeric_limits<Time>::min())
+		{
+			auto& [hotelName, hotelBookings] = *it;
+			if (m_latestBookingTime - hotelBookings.GetLatestBookingTime() < *m_idleHotelHorizon)
+			{
+				// The hotel has been booked since it was queued
+				expiry.latestBookingTime = hotelBookings.GetLatestBookingTime();
+				std::push_heap(m_hotelExpiries.begin(), m_hotelExpiries.end(), expiresLater);
+				continue;
+			}
+			std::optional<HotelBookingsObserver> observer;
+			if (m_clientHotelIndex || m_bookingHandles)
+			{
+				observer.emplace(m_clientHotelIndex ? &*m_clientHotelIndex : nullptr,
+					m_bookingHandles ? &*m_bookingHandles : nullptr, hotelName);
+			}
+			const auto bookedRooms = hotelBookings.GetBookedRoomCount();
+			const bool wasEmpty = IsDroppable(hotelBookings);
+			SubtractFromTotals(hotelBookings);
+			// Clients leave the client hotel index and handles of the bookings are discarded
+			hotelBookings.AdvanceTime(m_latestBookingTime, observer ? &*observer : nullptr);
+			assert(hotelBookings.GetBookingCount() == 0);
+			if (m_hotelRanking)
+			{
+				m_hotelRanking->Erase(hotelName, bookedRooms);
+			}
+			m_emptyHotelCount -= wasEmpty;
+			m_hotelBookings.erase(it);
+			++expiredHotelCount;
+		}
+		m_hotelExpiries.pop_back();
+	}
+	if (expiredHotelCount != 0)
+	{
+		ShrinkHotelMap();
+		m_metrics.CountDroppedHotels(expiredHotelCount);
+	}
+}
+
+bool BookingService::IsDroppable(const HotelBookings& hotelBookings) const noexcept
+{
+	return hotelBookings.GetBookingCount() == 0
+		&& (m_forgetsLatestBooking || hotelBookings.GetLatestBookingTime() == std::numeric_limits<Time>::min());
+}
+
+void BookingService::UpdateEmptyHotelCount(bool wasEmpty, bool isEmpty) noexcept
 {
-	// Create new hotel or use existing one
-	return m_hotelBookings.emplace(hotelName, m_statisticTimeSpan).first->second;
+	m_emptyHotelCount = m_emptyHotelCount + isEmpty - wasEmpty;
+	if (m_compactHotels && m_emptyHotelCount * 2 > m_hotelBookings.size())
+	{
+		CompactHotels();
+	}
 }
@@ -1,5 +1,11 @@
 #pragma once
+#include "ClientHotelIndex.h"
 #include "HotelBookings.h"
+#include "HotelRanking.h"
+#include "MemoryUsage.h"
+#include "ServiceMetrics.h"
+#include <limits>
+#include <optional>
 
 /*
 Determines whether to use unordered_map for storing hotels.
@@ -11,29 +17,203 @@ In this case O(Log(N)) complexity will be guaranteed when searching for hotel
 
 #ifdef USE_UNORDERED_MAP_FOR_STORING_HOTELS
 template <typename Key, typename Value>
-using HotelMapType = std::unordered_map<Key, Value>;
+using HotelMapType = std::unordered_map<Key, Value, std::hash<Key>, std::equal_to<Key>,
+	CountingAllocator<std::pair<const Key, Value>>>;
 #else
 #include <map>
 template <typename Key, typename Value>
-using HotelMapType = std::map<Key, Value>;
+using HotelMapType = std::map<Key, Value, std::less<Key>, CountingAllocator<std::pair<const Key, Value>>>;
 #endif
 
+struct BookingServiceOptions
+{
+	// Statistics are collected for every time span. Time spans are referred to by their indices
+	std::vector<Time> statisticTimeSpans = { 24 * 60 * 60 };
+	// Maintain hotels ordered by rooms booked within the first time span (see GetTopHotels).
+	// Costs O(log(number of hotels)) per booking
+	bool rankHotels = false;
+	// Maintain hotels booked by every client within the first time span (see GetClientHotelCount).
+	// Costs O(1) per booking and O(number of hotels of the client) per client leaving a hotel time span
+	bool indexClientHotels = false;
+	// Drop hotels that answer as missing ones from the hotel map (see CompactHotels).
+	// The hotel map is swept when at least half of the hotels can be dropped, so it costs O(1) amortized per booking
+	bool compactHotels = true;
+	// Drop a hotel as soon as its latest booking becomes older than the longest time span (or retentionHorizon)
+	// plus maxLateness before the latest booking of the service, so that a hotel booked once doesn't stay forever.
+	// Queries of such a hotel are answered as for a missing one rather than over its own latest bookings, and
+	// a booking of it is checked for lateness as a booking of a new hotel. Hotels are queued by their latest
+	// booking time, which costs O(log(number of hotels)) per hotel booked and per time span the hotel stays booked
+	bool expireIdleHotels = false;
+	// A booking may be made up to maxLateness earlier than the latest booking of the hotel.
+	// Late bookings are inserted in time order, taking O(number of bookings made after it).
+	// An earlier booking is booked at the time of the latest booking of the hotel unless rejectTooLate is set
+	Time maxLateness = 0;
+	bool rejectTooLate = false;
+	// Bookings made within retentionHorizon before the latest booking of the hotel are retained to answer
+	// point-in-time queries (see GetBookedRoomCountAt). Point-in-time queries are disabled if it is 0
+	Time retentionHorizon = 0;
+	// Keep a handle of every booking within the time spans to cancel it (see Cancel).
+	// Costs O(1) per booking and a hash map entry per retained booking
+	bool cancellable = false;
+};
+
 class BookingService final
 {
 public:
 	explicit BookingService(Time statisticTimeSpan = 24 * 60 * 60);
 
-	void Book(Time time, const std::string& hotelName, ClientId clientId, RoomCount roomCount);
+	// Collects statistics for every time span sharing a single booking history per hotel.
+	// Time spans are referred to by their indices. Throws std::invalid_argument if there are no time spans
+	explicit BookingService(std::vector<Time> statisticTimeSpans);
 
-	size_t GetDistinctClientCount(const std::string& hotelName) const noexcept;
+	explicit BookingService(BookingServiceOptions options);
 
+	// Returns the id of the booking: the n-th call gets id n, whether the booking is made or not.
+	// Throws std::invalid_argument if the booking is more than maxLateness earlier than the latest booking of the hotel
+	// and rejectTooLate is set
+	BookingId Book(Time time, const std::string& hotelName, ClientId clientId, RoomCount roomCount);
+
+	// Removes the booking from all statistics in O(number of time spans + log(number of bookings of the hotel)).
+	// Returns false if there is no such booking or it has already been cancelled or left the booking history.
+	// Range and point-in-time queries of a hotel having cancelled bookings take O(log(number of bookings)) more.
+	// Throws std::logic_error unless cancellation is enabled
+	bool Cancel(BookingId id);
+
+	// Statistics within the first time span
+	size_t GetDistinctClientCount(const std::string& hotelName) const noexcept;
 	RoomCount GetBookedRoomCount(const std::string& hotelName) const noexcept;
 
+	// Statistics within the time span with the given index. Throws std::out_of_range if there is no such time span
+	size_t GetDistinctClientCount(const std::string& hotelName, size_t spanIndex) const;
+	RoomCount GetBookedRoomCount(const std::string& hotelName, size_t spanIndex) const;
+
+	// Sums over all hotels within the first time span. O(1)
+	std::uint64_t GetTotalBookedRoomCount() const noexcept;
+	std::uint64_t GetTotalBookingCount() const noexcept;
+
+	// Sums over all hotels within the time span with the given index. O(1).
+	// Throws std::out_of_range if there is no such time span
+	std::uint64_t GetTotalBookedRoomCount(size_t spanIndex) const;
+	std::uint64_t GetTotalBookingCount(size_t spanIndex) const;
+
+	// Returns up to count hotels with most rooms booked within the first time span in O(count).
+	// Throws std::logic_error unless hotel ranking is enabled
+	std::vector<HotelRoomCount> GetTopHotels(size_t count) const;
+
+	// Number of hotels having bookings of the client within the first time span. O(1).
+	// Throws std::logic_error unless the client hotel index is enabled
+	size_t GetClientHotelCount(ClientId clientId) const;
+
+	// Hotels having bookings of the client within the first time span in no particular order. O(number of hotels).
+	// Throws std::logic_error unless the client hotel index is enabled
+	std::vector<std::string> GetClientHotels(ClientId clientId) const;
+
+	const std::vector<Time>& GetStatisticTimeSpans() const noexcept;
+
+	// Rooms booked at time in [from, to] among the retained hotel bookings
+	RoomCount GetBookedRoomCount(const std::string& hotelName, Time from, Time to) const noexcept;
+
+	// Statistics as of the latest hotel booking made at or before time in O(log(number of retained bookings)).
+	// Throw std::logic_error unless history is retained and std::out_of_range if there is no such time span
+	// or the bookings needed are beyond the retention horizon
+	size_t GetDistinctClientCountAt(const std::string& hotelName, Time time, size_t spanIndex = 0) const;
+	RoomCount GetBookedRoomCountAt(const std::string& hotelName, Time time, size_t spanIndex = 0) const;
+
+	// Drops hotels having no bookings whose latest booking time doesn't affect the bookings that follow
+	// and returns their number. O(number of hotels). Queries are not affected since such a hotel answers
+	// as a missing one, which has no booked rooms and clients and accepts a booking made at any time.
+	// Idle hotels don't wait for it, they are dropped as soon as they expire (see expireIdleHotels)
+	size_t CompactHotels() noexcept;
+
+	// Number of hotels in the hotel map. O(1)
+	size_t GetHotelCount() const noexcept;
+
+	// Takes O(number of hotels) to aggregate the client maps
+	ServiceMetrics GetMetrics() const noexcept;
+
+	// Takes O(number of hotels) to count bookings and hotel names
+	MemoryUsage GetMemoryUsage() const noexcept;
+
 private:
+	using HotelMap = HotelMapType<std::string, HotelBookings>;
+
+	// Locates a booking in the history of its hotel
+	struct BookingHandle
+	{
+		HotelMap::value_type* hotel; // Hotels are not dropped while they have bookings
+		std::uint64_t sequence;
+	};
+	using BookingHandleMap = std::unordered_map<BookingId, BookingHandle, std::hash<BookingId>, std::equal_to<BookingId>,
+		CountingAllocator<std::pair<const BookingId, BookingHandle>>>;
+
+	// Updates the client hotel index and booking handles on changes of the booking history of a hotel
+	class HotelBookingsObserver;
+
 	const HotelBookings* FindHotelBookings(const std::string& hotelName) const noexcept;
 
-	HotelBookings& GetHotelBookings(const std::string& hotelName);
+	HotelMap::value_type& GetHotel(const std::string& hotelName);
+
+	// Returns 0 if hotels are stored in std::map
+	size_t GetHotelBucketCount() const noexcept;
+	// Returns the bucket array of the hotel map to the heap after compaction left it mostly empty
+	void ShrinkHotelMap() noexcept;
+
+	void CheckSpanIndex(size_t spanIndex) const;
+	const ClientHotelIndex& GetClientHotelIndex() const;
+	void CheckHistoryRetained() const;
+
+	// Totals are updated by subtracting hotel statistics before booking and adding them back after it
+	void SubtractFromTotals(const HotelBookings& hotelBookings) noexcept;
+	void AddToTotals(const HotelBookings& hotelBookings) noexcept;
+	// Whether the hotel has no bookings and lateness of the bookings that follow can't be told from a new hotel:
+	// no booking has been made, or bookings leave the statistics at once and aren't rejected as too late
+	bool IsDroppable(const HotelBookings& hotelBookings) const noexcept;
+	// Compacts hotels once at least half of them can be dropped (if compaction is enabled).
+	// Hotel bookings must not be used after it
+	void UpdateEmptyHotelCount(bool wasEmpty, bool isEmpty) noexcept;
+	// Drops the hotels whose latest booking is m_idleHotelHorizon older than the latest booking of the service.
+	// Hotel bookings must not be used after it
+	void ExpireIdleHotels() noexcept;
+
+	// A hotel queued for expiry with its latest booking time as of queuing
+	struct HotelExpiry
+	{
+		Time latestBookingTime;
+		std::string hotelName;
+	};
+
+	// Statistics of all hotels within a time span
+	struct Totals
+	{
+		std::uint64_t bookedRooms = 0;
+		std::uint64_t bookingCount = 0;
+	};
 
-	Time m_statisticTimeSpan;
-	HotelMapType<std::string, HotelBookings> m_hotelBookings;
+	std::vector<Time> m_statisticTimeSpans;
+	std::vector<Totals> m_totals; // Per time span
+	Time m_maxLateness;
+	bool m_rejectTooLate;
+	Time m_retentionHorizon;
+	// Counters must outlive the containers using them
+	AllocationCounter m_hotelMapMemory;
+	BookingMemoryCounters m_bookingMemory;
+	AllocationCounter m_hotelRankingMemory;
+	AllocationCounter m_clientHotelIndexMemory;
+	AllocationCounter m_bookingHandleMemory;
+	HotelMap m_hotelBookings;
+	std::optional<HotelRanking> m_hotelRanking; // Refers to hotel names stored in m_hotelBookings
+	std::optional<ClientHotelIndex> m_clientHotelIndex; // Refers to hotel names stored in m_hotelBookings
+	std::optional<BookingHandleMap> m_bookingHandles; // Refers to hotels stored in m_hotelBookings
+	BookingId m_lastBookingId = 0;
+	bool m_compactHotels;
+	bool m_forgetsLatestBooking; // Bookings leave the history at once and aren't rejected as too late
+	size_t m_emptyHotelCount = 0; // Hotels that can be dropped
+	std::optional<Time> m_idleHotelHorizon; // Only if idle hotels expire
+	Time m_latestBookingTime = std::numeric_limits<Time>::min(); // Of all hotels
+	// Min-heap of booked hotels by latest booking time. A hotel is queued again if it has been booked since.
+	// Only if idle hotels expire
+	std::vector<HotelExpiry, CountingAllocator<HotelExpiry>> m_hotelExpiries;
+	std::uint64_t m_hotelMapShrinkCount = 0;
+	std::uint64_t m_hotelMapReclaimedBytes = 0;
+	mutable ServiceMetricCounters m_metrics;
 };
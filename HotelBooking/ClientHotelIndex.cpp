@@ -0,0 +1,69 @@
+#include "ClientHotelIndex.h"
+#include <algorithm>
+
+ClientHotelIndex::ClientHotelIndex(AllocationCounter* memoryCounter)
+	: m_clientHotels(ClientHotelMap::allocator_type(memoryCounter))
+{
+}
+
+void ClientHotelIndex::Add(ClientId clientId, const std::string& hotelName)
+{
+	auto [it, inserted] = m_clientHotels.try_emplace(clientId, m_clientHotels.get_allocator());
+	try
+	{
+		it->second.push_back(&hotelName);
+	}
+	catch (...)
+	{
+		if (inserted)
+		{
+			m_clientHotels.erase(it);
+		}
+		throw;
+	}
+}
+
+void ClientHotelIndex::Remove(ClientId clientId, const std::string& hotelName) noexcept
+{
+	auto it = m_clientHotels.find(clientId);
+	if (it == m_clientHotels.end())
+	{
+		return;
+	}
+	auto& hotels = it->second;
+	if (auto hotelIt = std::find(hotels.begin(), hotels.end(), &hotelName); hotelIt != hotels.end())
+	{
+		// The order of hotels doesn't matter, so the last one takes the place of the removed hotel
+		*hotelIt = hotels.back();
+		hotels.pop_back();
+	}
+	if (hotels.empty())
+	{
+		m_clientHotels.erase(it);
+	}
+}
+
+size_t ClientHotelIndex::GetHotelCount(ClientId clientId) const noexcept
+{
+	auto it = m_clientHotels.find(clientId);
+	return it != m_clientHotels.end() ? it->second.size() : 0;
+}
+
+std::vector<std::string> ClientHotelIndex::GetHotels(ClientId clientId) const
+{
+	std::vector<std::string> hotels;
+	if (auto it = m_clientHotels.find(clientId); it != m_clientHotels.end())
+	{
+		hotels.reserve(it->second.size());
+		for (auto hotelName : it->second)
+		{
+			hotels.push_back(*hotelName);
+		}
+	}
+	return hotels;
+}
+
+size_t ClientHotelIndex::GetClientCount() const noexcept
+{
+	return m_clientHotels.size();
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "HotelBookings.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Hotels having bookings of a client within their first time span.
+// The number of hotels of a client is returned in O(1) and the hotels are enumerated in O(1) per hotel.
+// Adding a hotel takes O(1), removing it takes O(number of hotels of the client)
+class ClientHotelIndex final
+{
+public:
+	// memoryCounter (if any) must outlive ClientHotelIndex
+	explicit ClientHotelIndex(AllocationCounter* memoryCounter = nullptr);
+
+	// hotelName must stay alive and unchanged while the client has bookings in the hotel
+	void Add(ClientId clientId, const std::string& hotelName);
+
+	void Remove(ClientId clientId, const std::string& hotelName) noexcept;
+
+	size_t GetHotelCount(ClientId clientId) const noexcept;
+
+	// Returns hotel names in no particular order
+	std::vector<std::string> GetHotels(ClientId clientId) const;
+
+	size_t GetClientCount() const noexcept;
+
+private:
+	using HotelList = std::vector<const std::string*, CountingAllocator<const std::string*>>;
+	using ClientHotelMap = std::unordered_map<ClientId, HotelList, std::hash<ClientId>, std::equal_to<ClientId>,
+		CountingAllocator<std::pair<const ClientId, HotelList>>>;
+
+	ClientHotelMap m_clientHotels;
+};
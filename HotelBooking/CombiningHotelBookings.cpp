@@ -0,0 +1,113 @@
+#include "CombiningHotelBookings.h"
+#include "Backoff.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+CombiningHotelBookings::CombiningHotelBookings(const std::vector<Time>& timeSpans, unsigned threadCount,
+	const BookingHistoryOptions& options)
+	: m_spanCount(timeSpans.size())
+	, m_slots(std::make_unique<Slot[]>(threadCount))
+	, m_slotCount(threadCount)
+	, m_bookings(timeSpans, nullptr, options)
+{
+	if (threadCount == 0)
+	{
+		throw std::invalid_argument("Thread count must be positive");
+	}
+	if (options.retentionHorizon != 0 || options.cancellable)
+	{
+		throw std::invalid_argument("Combined bookings can't be retained or cancelled");
+	}
+	m_batchSlots.reserve(threadCount);
+	m_batch.reserve(threadCount);
+	m_errors.reserve(threadCount);
+}
+
+void CombiningHotelBookings::Book(unsigned threadIndex, Time time, ClientId clientId, RoomCount roomCount)
+{
+	auto& slot = m_slots[threadIndex];
+	slot.booking = { time, clientId, roomCount };
+	slot.pending.store(true, std::memory_order_release);
+	for (Backoff backoff; slot.pending.load(std::memory_order_acquire); backoff.Pause())
+	{
+		if (m_mutex.try_lock())
+		{
+			std::lock_guard lock(m_mutex, std::adopt_lock);
+			// The slot is published before the lock is taken, so the combiner serves it
+			// unless another combiner has served it since it was checked
+			if (slot.pending.load(std::memory_order_acquire))
+			{
+				Combine();
+			}
+			break;
+		}
+	}
+	if (slot.error)
+	{
+		std::rethrow_exception(std::exchange(slot.error, nullptr));
+	}
+}
+
+size_t CombiningHotelBookings::GetDistinctClientCount(size_t spanIndex) const
+{
+	CheckSpanIndex(spanIndex);
+	std::lock_guard lock(m_mutex);
+	return m_bookings.GetDistinctClientCount(spanIndex);
+}
+
+RoomCount CombiningHotelBookings::GetBookedRoomCount(size_t spanIndex) const
+{
+	CheckSpanIndex(spanIndex);
+	std::lock_guard lock(m_mutex);
+	return m_bookings.GetBookedRoomCount(spanIndex);
+}
+
+CombiningHotelBookings::Statistics CombiningHotelBookings::GetStatistics() const
+{
+	std::lock_guard lock(m_mutex);
+	return m_statistics;
+}
+
+void CombiningHotelBookings::Combine()
+{
+	m_batchSlots.clear();
+	for (unsigned i = 0; i < m_slotCount; ++i)
+	{
+		if (m_slots[i].pending.load(std::memory_order_acquire))
+		{
+			m_batchSlots.push_back(i);
+		}
+	}
+	if (m_batchSlots.empty())
+	{
+		// An empty batch would lower the bookings per batch
+		return;
+	}
+	// Ties are ordered by slot so that the batch doesn't depend on the sort algorithm
+	std::sort(m_batchSlots.begin(), m_batchSlots.end(), [this](unsigned left, unsigned right) {
+		return std::make_pair(m_slots[left].booking.time, left) < std::make_pair(m_slots[right].booking.time, right);
+	});
+	m_batch.clear();
+	for (auto slotIndex : m_batchSlots)
+	{
+		m_batch.push_back(m_slots[slotIndex].booking);
+	}
+	m_bookings.BookBatch(m_batch, m_errors);
+	for (size_t i = 0; i < m_batchSlots.size(); ++i)
+	{
+		auto& slot = m_slots[m_batchSlots[i]];
+		slot.error = std::move(m_errors[i]);
+		slot.pending.store(false, std::memory_order_release);
+	}
+	m_statistics.bookingCount += m_batchSlots.size();
+	++m_statistics.batchCount;
+}
+
+void CombiningHotelBookings::CheckSpanIndex(size_t spanIndex) const
+{
+	if (spanIndex >= m_spanCount)
+	{
+		throw std::out_of_range("Statistic time span index is out of range");
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "HotelBookings.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+Bookings of a hotel booked by several threads at once through flat combining. A thread publishes its booking
+in its own slot, and whichever thread acquires the lock (the combiner) makes all published bookings
+in one pass (see HotelBookings::BookBatch) while the others wait for their slots to be served.
+So the lock changes hands once per batch rather than once per booking, and the history stays in the cache
+of the combiner. Bookings of a batch are sorted by time, so bookings of different threads arriving
+slightly out of order are not late unless they fall behind a previous batch
+*/
+class CombiningHotelBookings final
+{
+public:
+	struct Statistics
+	{
+		std::uint64_t bookingCount = 0;
+		std::uint64_t batchCount = 0;
+	};
+
+	// timeSpans must not be empty. Throws std::invalid_argument if threadCount is 0
+	// or history is retained or cancellable
+	CombiningHotelBookings(const std::vector<Time>& timeSpans, unsigned threadCount, const BookingHistoryOptions& options = {});
+
+	CombiningHotelBookings(const CombiningHotelBookings&) = delete;
+	CombiningHotelBookings& operator=(const CombiningHotelBookings&) = delete;
+
+	// Concurrent calls must pass distinct thread indices. Throws what HotelBookings::Book throws
+	void Book(unsigned threadIndex, Time time, ClientId clientId, RoomCount roomCount);
+
+	// Are thread-safe. Throw std::out_of_range if spanIndex is out of range
+	size_t GetDistinctClientCount(size_t spanIndex = 0) const;
+	RoomCount GetBookedRoomCount(size_t spanIndex = 0) const;
+
+	Statistics GetStatistics() const;
+
+private:
+	struct alignas(64) Slot
+	{
+		// Set by the owner thread once the booking is published and cleared by the combiner once it is made
+		std::atomic<bool> pending{ false };
+		BookingRequest booking{};
+		std::exception_ptr error;
+	};
+
+	// Makes the published bookings, counting a batch if there are any. The lock must be held
+	void Combine();
+	void CheckSpanIndex(size_t spanIndex) const;
+
+	size_t m_spanCount;
+	std::unique_ptr<Slot[]> m_slots;
+	unsigned m_slotCount;
+	mutable std::mutex m_mutex;
+	// Guarded by the mutex
+	HotelBookings m_bookings;
+	std::vector<unsigned> m_batchSlots;
+	std::vector<BookingRequest> m_batch;
+	std::vector<std::exception_ptr> m_errors;
+	Statistics m_statistics;
+};
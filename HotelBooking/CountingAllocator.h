@@ -0,0 +1,124 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Snapshot of memory allocated through a CountingAllocator
+struct AllocationStatistics
+{
+	std::size_t bytes = 0; // Requested by containers
+	std::size_t blocks = 0; // Live allocations
+	std::size_t overheadBytes = 0; // Estimated heap bookkeeping and alignment padding
+
+	AllocationStatistics& operator+=(const AllocationStatistics& other) noexcept
+	{
+		bytes += other.bytes;
+		blocks += other.blocks;
+		overheadBytes += other.overheadBytes;
+		return *this;
+	}
+
+	std::size_t GetTotalBytes() const noexcept { return bytes + overheadBytes; }
+};
+
+// Accumulates live allocations of all the containers sharing it
+class AllocationCounter final
+{
+public:
+	void OnAllocate(std::size_t bytes) noexcept
+	{
+		m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+		m_blocks.fetch_add(1, std::memory_order_relaxed);
+		m_overheadBytes.fetch_add(EstimateOverhead(bytes), std::memory_order_relaxed);
+	}
+
+	void OnDeallocate(std::size_t bytes) noexcept
+	{
+		m_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+		m_blocks.fetch_sub(1, std::memory_order_relaxed);
+		m_overheadBytes.fetch_sub(EstimateOverhead(bytes), std::memory_order_relaxed);
+	}
+
+	AllocationStatistics GetStatistics() const noexcept
+	{
+		AllocationStatistics statistics;
+		statistics.bytes = m_bytes.load(std::memory_order_relaxed);
+		statistics.blocks = m_blocks.load(std::memory_order_relaxed);
+		statistics.overheadBytes = m_overheadBytes.load(std::memory_order_relaxed);
+		return statistics;
+	}
+
+private:
+	/*
+	The heap is modelled after dlmalloc/glibc: every block carries a pointer-sized header
+	and is rounded up to twice the pointer size, with a minimum of four pointers.
+	Other allocators differ in details but not in the order of magnitude.
+	*/
+	static constexpr std::size_t EstimateOverhead(std::size_t bytes) noexcept
+	{
+		constexpr std::size_t alignment = 2 * sizeof(void*);
+		constexpr std::size_t minBlockSize = 4 * sizeof(void*);
+		const std::size_t blockSize = (bytes + sizeof(void*) + alignment - 1) & ~(alignment - 1);
+		return std::max(blockSize, minBlockSize) - bytes;
+	}
+
+	std::atomic<std::size_t> m_bytes{ 0 };
+	std::atomic<std::size_t> m_blocks{ 0 };
+	std::atomic<std::size_t> m_overheadBytes{ 0 };
+};
+
+// Standard allocator reporting every allocation to an AllocationCounter (if any)
+template <typename T>
+class CountingAllocator
+{
+public:
+	using value_type = T;
+
+	CountingAllocator(AllocationCounter* counter = nullptr) noexcept
+		: m_counter(counter)
+	{
+	}
+
+	template <typename U>
+	CountingAllocator(const CountingAllocator<U>& other) noexcept
+		: m_counter(other.GetCounter())
+	{
+	}
+
+	T* allocate(std::size_t count)
+	{
+		T* p = std::allocator<T>().allocate(count);
+		if (m_counter)
+		{
+			m_counter->OnAllocate(count * sizeof(T));
+		}
+		return p;
+	}
+
+	void deallocate(T* p, std::size_t count) noexcept
+	{
+		if (m_counter)
+		{
+			m_counter->OnDeallocate(count * sizeof(T));
+		}
+		std::allocator<T>().deallocate(p, count);
+	}
+
+	AllocationCounter* GetCounter() const noexcept { return m_counter; }
+
+private:
+	AllocationCounter* m_counter;
+};
+
+template <typename T, typename U>
+bool operator==(const CountingAllocator<T>& lhs, const CountingAllocator<U>& rhs) noexcept
+{
+	return lhs.GetCounter() == rhs.GetCounter();
+}
+
+template <typename T, typename U>
+bool operator!=(const CountingAllocator<T>& lhs, const CountingAllocator<U>& rhs) noexcept
+{
+	return !(lhs == rhs);
+}
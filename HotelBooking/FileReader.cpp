@@ -0,0 +1,354 @@
+#include "FileReader.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef USE_IO_URING
+/*
+Minimal io_uring over raw system calls, so no liburing is needed.
+Reads are submitted one by one and completions are reaped in any order
+*/
+class FileReader::IoUring final
+{
+public:
+	// Throws std::system_error if io_uring is not available
+	explicit IoUring(unsigned entries)
+		: m_iovecs(entries)
+	{
+		io_uring_params params{};
+		m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+		if (m_fd < 0)
+		{
+			throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+		}
+		m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (singleMap)
+		{
+			m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+		}
+		m_sqRing = Map(m_sqRingSize, IORING_OFF_SQ_RING);
+		m_cqRing = singleMap ? m_sqRing : Map(m_cqRingSize, IORING_OFF_CQ_RING);
+		m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		m_sqes = static_cast<io_uring_sqe*>(Map(m_sqesSize, IORING_OFF_SQES));
+
+		auto sq = static_cast<char*>(m_sqRing);
+		m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		auto cq = static_cast<char*>(m_cqRing);
+		m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+	}
+
+	~IoUring()
+	{
+		Unmap(m_sqes, m_sqesSize);
+		if (m_cqRing != m_sqRing)
+		{
+			Unmap(m_cqRing, m_cqRingSize);
+		}
+		Unmap(m_sqRing, m_sqRingSize);
+		if (m_fd >= 0)
+		{
+			::close(m_fd);
+		}
+	}
+
+	IoUring(const IoUring&) = delete;
+	IoUring& operator=(const IoUring&) = delete;
+
+	// Reads into buffer at offset of fd. index identifies the completion and must be less than entries
+	void SubmitRead(int fd, char* buffer, size_t size, std::uint64_t offset, unsigned index)
+	{
+		// IORING_OP_READV is supported by every kernel having io_uring, unlike IORING_OP_READ
+		m_iovecs[index] = { buffer, size };
+		const auto tail = *m_sqTail;
+		const auto slot = tail & m_sqMask;
+		auto& sqe = m_sqes[slot];
+		std::memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_READV;
+		sqe.fd = fd;
+		sqe.addr = reinterpret_cast<std::uint64_t>(&m_iovecs[index]);
+		sqe.len = 1;
+		sqe.off = offset;
+		sqe.user_data = index;
+		m_sqArray[slot] = slot;
+		__atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+		while (::syscall(__NR_io_uring_enter, m_fd, 1, 0, 0, nullptr, 0) < 0)
+		{
+			if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			{
+				throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+			}
+		}
+	}
+
+	// Waits for a read to complete and returns its index and result (bytes read or a negated errno)
+	std::pair<unsigned, int> WaitCompletion()
+	{
+		for (;;)
+		{
+			const auto head = *m_cqHead;
+			if (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+			{
+				const auto& cqe = m_cqes[head & m_cqMask];
+				const std::pair<unsigned, int> completion(static_cast<unsigned>(cqe.user_data), cqe.res);
+				__atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+				return completion;
+			}
+			if (::syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+			{
+				throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+			}
+		}
+	}
+
+private:
+	void* Map(size_t size, off_t offset)
+	{
+		void* address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset);
+		if (address == MAP_FAILED)
+		{
+			throw std::system_error(errno, std::generic_category(), "io_uring mmap");
+		}
+		return address;
+	}
+
+	static void Unmap(void* address, size_t size) noexcept
+	{
+		if (address)
+		{
+			::munmap(address, size);
+		}
+	}
+
+	int m_fd = -1;
+	std::vector<iovec> m_iovecs; // Per read in flight
+	void* m_sqRing = nullptr;
+	void* m_cqRing = nullptr;
+	size_t m_sqRingSize = 0;
+	size_t m_cqRingSize = 0;
+	io_uring_sqe* m_sqes = nullptr;
+	size_t m_sqesSize = 0;
+	unsigned* m_sqTail = nullptr;
+	unsigned m_sqMask = 0;
+	unsigned* m_sqArray = nullptr;
+	unsigned* m_cqHead = nullptr;
+	unsigned* m_cqTail = nullptr;
+	unsigned m_cqMask = 0;
+	io_uring_cqe* m_cqes = nullptr;
+};
+#else
+class FileReader::IoUring final
+{
+};
+#endif
+
+FileReader::FileReader(const std::string& path, Backend preferredBackend, size_t bufferSize, unsigned bufferCount)
+	: m_file(std::fopen(path.c_str(), "rb"))
+	, m_bufferSize(bufferSize)
+{
+	if (!m_file)
+	{
+		throw std::runtime_error("Can't open " + path);
+	}
+#ifdef USE_IO_URING
+	if (preferredBackend == Backend::IoUring)
+	{
+		try
+		{
+			m_ring = std::make_unique<IoUring>(bufferCount);
+		}
+		catch (const std::exception&)
+		{
+			// The read backend is used
+		}
+	}
+#else
+	(void)preferredBackend;
+#endif
+	// The read backend reads one buffer at a time
+	m_buffers.resize(m_ring ? bufferCount : 1);
+	try
+	{
+		for (unsigned i = 0; i < m_buffers.size(); ++i)
+		{
+			m_buffers[i].data = std::make_unique<char[]>(bufferSize);
+			SubmitRead(i);
+		}
+	}
+	catch (...)
+	{
+		Close();
+		throw;
+	}
+}
+
+FileReader::~FileReader()
+{
+	Close();
+}
+
+void FileReader::Close() noexcept
+{
+	// Reads in flight must complete before their buffers are freed
+	for (unsigned i = 0; i < m_buffers.size(); ++i)
+	{
+		try
+		{
+			WaitRead(i);
+		}
+		catch (const std::exception&)
+		{
+		}
+	}
+	m_ring.reset();
+	if (m_file)
+	{
+		std::fclose(m_file);
+		m_file = nullptr;
+	}
+}
+
+FileReader::Backend FileReader::GetBackend() const noexcept
+{
+	return m_ring ? Backend::IoUring : Backend::Read;
+}
+
+bool FileReader::ReadLine(std::string_view& line)
+{
+	if (m_carryReturned)
+	{
+		m_carry.clear();
+		m_carryReturned = false;
+	}
+	for (;;)
+	{
+		const auto lineEnd = m_unread.find('\n');
+		if (lineEnd != std::string_view::npos)
+		{
+			if (m_carry.empty())
+			{
+				line = m_unread.substr(0, lineEnd);
+			}
+			else
+			{
+				m_carry.append(m_unread.data(), lineEnd);
+				line = m_carry;
+				m_carryReturned = true;
+			}
+			m_unread.remove_prefix(lineEnd + 1);
+			return true;
+		}
+		m_carry.append(m_unread.data(), m_unread.size());
+		m_unread = {};
+		if (!NextBuffer())
+		{
+			// The last line may lack the line end
+			line = m_carry;
+			m_carryReturned = true;
+			return !m_carry.empty();
+		}
+	}
+}
+
+bool FileReader::NextBuffer()
+{
+	if (m_started)
+	{
+		// The current buffer is consumed, so it reads further ahead
+		SubmitRead(m_current);
+		m_current = (m_current + 1) % m_buffers.size();
+	}
+	m_started = true;
+	const auto size = WaitRead(m_current);
+	m_unread = std::string_view(m_buffers[m_current].data.get(), size);
+	return size != 0;
+}
+
+void FileReader::SubmitRead(unsigned bufferIndex)
+{
+	auto& buffer = m_buffers[bufferIndex];
+	buffer.size = 0;
+	if (m_endOfFile)
+	{
+		return;
+	}
+	buffer.offset = m_nextOffset;
+	m_nextOffset += m_bufferSize;
+#ifdef USE_IO_URING
+	if (m_ring)
+	{
+		m_ring->SubmitRead(fileno(m_file), buffer.data.get(), m_bufferSize, buffer.offset, bufferIndex);
+		buffer.pending = true;
+		return;
+	}
+#endif
+	buffer.size = std::fread(buffer.data.get(), 1, m_bufferSize, m_file);
+	if (buffer.size < m_bufferSize)
+	{
+		if (std::ferror(m_file))
+		{
+			throw std::runtime_error("File read error");
+		}
+		m_endOfFile = true;
+	}
+}
+
+size_t FileReader::WaitRead(unsigned bufferIndex)
+{
+	auto& buffer = m_buffers[bufferIndex];
+#ifdef USE_IO_URING
+	while (buffer.pending)
+	{
+		const auto [index, result] = m_ring->WaitCompletion();
+		auto& completed = m_buffers[index];
+		completed.pending = false;
+		if (result < 0)
+		{
+			throw std::system_error(-result, std::generic_category(), "io_uring read");
+		}
+		completed.size = static_cast<size_t>(result);
+		// A short read of a regular file is rare, so the rest of the buffer is read synchronously
+		while (completed.size != 0 && completed.size < m_bufferSize)
+		{
+			const auto size = ::pread(fileno(m_file), completed.data.get() + completed.size,
+				m_bufferSize - completed.size, static_cast<off_t>(completed.offset + completed.size));
+			if (size < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (size < 0)
+			{
+				throw std::system_error(errno, std::generic_category(), "pread");
+			}
+			if (size == 0)
+			{
+				break;
+			}
+			completed.size += static_cast<size_t>(size);
+		}
+		if (completed.size < m_bufferSize)
+		{
+			m_endOfFile = true;
+		}
+	}
+#endif
+	return buffer.size;
+}
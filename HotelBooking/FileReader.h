@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+Reads lines of a file sequentially for replaying query logs.
+The io_uring backend (Linux only) keeps reads of all buffers in flight, so the disk keeps reading ahead
+while the lines of the current buffer are processed. The read backend reads one buffer at a time
+and is used where io_uring is not available (the kernel lacks it or a seccomp policy forbids it)
+*/
+class FileReader final
+{
+public:
+	enum class Backend
+	{
+		IoUring,
+		Read,
+	};
+
+	// Throws std::runtime_error if the file can't be opened.
+	// Falls back to the read backend if the preferred io_uring can't be set up
+	explicit FileReader(const std::string& path, Backend preferredBackend = Backend::IoUring,
+		size_t bufferSize = 1024 * 1024, unsigned bufferCount = 4);
+	~FileReader();
+
+	FileReader(const FileReader&) = delete;
+	FileReader& operator=(const FileReader&) = delete;
+
+	Backend GetBackend() const noexcept;
+
+	// Returns false at the end of the file. The line lacks the line end and stays valid until the next call.
+	// Throws std::runtime_error on read errors
+	bool ReadLine(std::string_view& line);
+
+private:
+	class IoUring;
+
+	// Waits for the reads in flight and closes the file
+	void Close() noexcept;
+	// Makes the next buffer current. Returns false at the end of the file
+	bool NextBuffer();
+	// Starts reading the buffer at the next file offset
+	void SubmitRead(unsigned bufferIndex);
+	// Waits for the read of the buffer and returns the number of bytes read
+	size_t WaitRead(unsigned bufferIndex);
+
+	struct Buffer
+	{
+		std::unique_ptr<char[]> data;
+		std::uint64_t offset = 0;
+		size_t size = 0; // Bytes read
+		bool pending = false; // Read is in flight
+	};
+
+	std::FILE* m_file;
+	std::unique_ptr<IoUring> m_ring; // Null for the read backend
+	size_t m_bufferSize;
+	std::vector<Buffer> m_buffers;
+	unsigned m_current = 0;
+	bool m_started = false; // The current buffer is being consumed
+	std::uint64_t m_nextOffset = 0; // File offset of the next buffer to submit
+	bool m_endOfFile = false; // A read returned less than a buffer
+	std::string_view m_unread; // The rest of the current buffer
+	std::string m_carry; // A line split between buffers
+	bool m_carryReturned = false;
+};
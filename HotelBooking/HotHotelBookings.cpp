@@ -0,0 +1,103 @@
+#include "HotHotelBookings.h"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+HotHotelBookings::HotHotelBookings(const std::vector<Time>& timeSpans, unsigned partitionCount,
+	const BookingHistoryOptions& options)
+	: m_spanCount(timeSpans.size())
+{
+	if (partitionCount == 0)
+	{
+		throw std::invalid_argument("Partition count must be positive");
+	}
+	m_partitions.reserve(partitionCount);
+	for (unsigned i = 0; i < partitionCount; ++i)
+	{
+		m_partitions.push_back(std::make_unique<Partition>(timeSpans, options));
+	}
+}
+
+void HotHotelBookings::Book(unsigned partitionIndex, Time time, ClientId clientId, RoomCount roomCount)
+{
+	auto& partition = *m_partitions[partitionIndex];
+	std::lock_guard lock(partition.mutex);
+	partition.bookings.Book(time, clientId, roomCount);
+	partition.latestTime = std::max(partition.latestTime.value_or(time), time);
+}
+
+template <typename Action>
+void HotHotelBookings::WithMergedPartitions(size_t spanIndex, Action&& action) const
+{
+	if (spanIndex >= m_spanCount)
+	{
+		throw std::out_of_range("Statistic time span index is out of range");
+	}
+	// Readers lock partitions in the same order and writers lock only one, so there are no deadlocks
+	std::vector<std::unique_lock<std::mutex>> locks;
+	locks.reserve(m_partitions.size());
+	std::optional<Time> latestTime;
+	for (auto& partition : m_partitions)
+	{
+		locks.emplace_back(partition->mutex);
+		if (partition->latestTime)
+		{
+			latestTime = std::max(latestTime.value_or(*partition->latestTime), *partition->latestTime);
+		}
+	}
+	std::vector<const HotelBookings*> partials;
+	partials.reserve(m_partitions.size());
+	for (auto& partition : m_partitions)
+	{
+		if (latestTime)
+		{
+			partition->bookings.AdvanceTime(*latestTime);
+		}
+		partials.push_back(&partition->bookings);
+	}
+	action(partials);
+}
+
+size_t HotHotelBookings::GetDistinctClientCount(size_t spanIndex) const
+{
+	size_t clientCount = 0;
+	WithMergedPartitions(spanIndex, [spanIndex, &clientCount](const std::vector<const HotelBookings*>& partials) {
+		if (partials.size() == 1)
+		{
+			clientCount = partials.front()->GetDistinctClientCount(spanIndex);
+			return;
+		}
+		size_t partialClientCount = 0;
+		for (auto partial : partials)
+		{
+			partialClientCount += partial->GetDistinctClientCount(spanIndex);
+		}
+		std::unordered_map<ClientId, unsigned> clientBookingCount;
+		clientBookingCount.reserve(partialClientCount);
+		for (auto partial : partials)
+		{
+			partial->ForEachClient(spanIndex, [&clientBookingCount](ClientId clientId, unsigned bookingCount) {
+				clientBookingCount[clientId] += bookingCount;
+			});
+		}
+		clientCount = clientBookingCount.size();
+	});
+	return clientCount;
+}
+
+RoomCount HotHotelBookings::GetBookedRoomCount(size_t spanIndex) const
+{
+	RoomCount roomCount = 0;
+	WithMergedPartitions(spanIndex, [spanIndex, &roomCount](const std::vector<const HotelBookings*>& partials) {
+		for (auto partial : partials)
+		{
+			roomCount += partial->GetBookedRoomCount(spanIndex);
+		}
+	});
+	return roomCount;
+}
+
+unsigned HotHotelBookings::GetPartitionCount() const noexcept
+{
+	return static_cast<unsigned>(m_partitions.size());
+}
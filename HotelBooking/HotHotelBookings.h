@@ -0,0 +1,55 @@
+#pragma once
+#include "HotelBookings.h"
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+/*
+Bookings of a hotel booked by several ingest threads at once. Every thread books its own partition,
+a partial HotelBookings guarded by a mutex that only readers contend for, so bookings of the hotel scale
+across cores. A read locks all partitions, advances them to the latest booking of the hotel and merges
+their windows: rooms are summed and per-client booking counts are merged, in O(number of clients in partitions).
+Bookings of a partition must be made in time order (up to maxLateness), but partitions may lag behind each other:
+bookings falling out of the time spans of the latest booking of the hotel are left out of statistics.
+Lateness is measured from the latest booking of the partition, so reads don't change which bookings are accepted
+*/
+class HotHotelBookings final
+{
+public:
+	// timeSpans must not be empty. Throws std::invalid_argument if partitionCount is 0
+	HotHotelBookings(const std::vector<Time>& timeSpans, unsigned partitionCount, const BookingHistoryOptions& options = {});
+
+	HotHotelBookings(const HotHotelBookings&) = delete;
+	HotHotelBookings& operator=(const HotHotelBookings&) = delete;
+
+	// Concurrent calls must book distinct partitions. Throws what HotelBookings::Book throws
+	void Book(unsigned partitionIndex, Time time, ClientId clientId, RoomCount roomCount);
+
+	// Are thread-safe. Throw std::out_of_range if spanIndex is out of range
+	size_t GetDistinctClientCount(size_t spanIndex = 0) const;
+	RoomCount GetBookedRoomCount(size_t spanIndex = 0) const;
+
+	unsigned GetPartitionCount() const noexcept;
+
+private:
+	struct alignas(64) Partition
+	{
+		Partition(const std::vector<Time>& timeSpans, const BookingHistoryOptions& options)
+			: bookings(timeSpans, nullptr, options)
+		{
+		}
+
+		std::mutex mutex;
+		HotelBookings bookings;
+		std::optional<Time> latestTime;
+	};
+
+	// Calls action(partitions) with all partitions locked and advanced to the latest booking of the hotel
+	template <typename Action>
+	void WithMergedPartitions(size_t spanIndex, Action&& action) const;
+
+	size_t m_spanCount;
+	// Reads advance the windows of the partitions, which doesn't change the statistics they report
+	mutable std::vector<std::unique_ptr<Partition>> m_partitions;
+};
@@ -1,66 +1,686 @@
 #include "HotelBookings.h"
 #include <algorithm>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+#include <utility>
 
-HotelBookings::HotelBookings(Time timeSpan)
-	: m_timeSpan(timeSpan)
+HotelBookings::HotelBookings(Time timeSpan, BookingMemoryCounters* memoryCounters)
+	: HotelBookings(std::vector<Time>{ timeSpan }, memoryCounters)
 {
 }
 
-void HotelBookings::Book(Time time, ClientId clientId, RoomCount roomCount)
+HotelBookings::HotelBookings(const std::vector<Time>& timeSpans, BookingMemoryCounters* memoryCounters,
+	const BookingHistoryOptions& options)
+	: m_options(options)
+	, m_latestBookingTime(std::numeric_limits<Time>::min())
+	, m_latestDiscardedTime(std::numeric_limits<Time>::min())
+	, m_windowTime(std::numeric_limits<Time>::min())
+	, m_memoryCounters(memoryCounters)
+	, m_bookings(memoryCounters ? &memoryCounters->bookings : nullptr)
+	, m_reportedClientCounts(memoryCounters ? &memoryCounters->bookings : nullptr)
+	, m_cancelledRooms(memoryCounters ? &memoryCounters->bookings : nullptr)
+	, m_windows(memoryCounters ? &memoryCounters->windows : nullptr)
 {
-	AddBooking(time, clientId, roomCount);
-	RemoveBookingsDeprecatedBy(time - m_timeSpan);
+	assert(!timeSpans.empty());
+	const ClientBookingCountMap::allocator_type clientsAllocator(memoryCounters ? &memoryCounters->clients : nullptr);
+	m_windows.reserve(timeSpans.size());
+	for (auto timeSpan : timeSpans)
+	{
+		m_windows.emplace_back(timeSpan, clientsAllocator);
+	}
+	m_longestSpanIndex = static_cast<size_t>(std::max_element(timeSpans.begin(), timeSpans.end()) - timeSpans.begin());
+	if (options.cancellable)
+	{
+		m_bookingIds.emplace(memoryCounters ? &memoryCounters->bookings : nullptr);
+	}
+}
+
+std::optional<std::uint64_t> HotelBookings::Book(Time time, ClientId clientId, RoomCount roomCount,
+	BookingObserver* observer, BookingId id)
+{
+	assert(!m_options.cancellable || id != 0);
+	std::optional<std::uint64_t> sequence;
+	if (CheckLateness(time))
+	{
+		sequence = InsertLateBooking(time, clientId, roomCount, observer, id);
+	}
+	else
+	{
+		sequence = AddBooking(time, clientId, roomCount, observer, id);
+		RemoveBookingsDeprecatedBy(time, observer);
+		if (*sequence < m_firstSequence)
+		{
+			// Zero time span evicts the booking at once
+			sequence.reset();
+		}
+		else if (RetainsHistory())
+		{
+			RecordClientCounts(m_bookings.size() - 1);
+		}
+	}
+	ShrinkIfIdle();
+	return sequence;
+}
+
+void HotelBookings::BookBatch(const std::vector<BookingRequest>& bookings, std::vector<std::exception_ptr>& errors)
+{
+	assert(!RetainsHistory() && !m_options.cancellable);
+	errors.assign(bookings.size(), nullptr);
+	// Time of the latest booking added without removing the bookings it deprecates
+	std::optional<Time> pendingRemovalTime;
+	for (size_t i = 0; i < bookings.size(); ++i)
+	{
+		auto booking = bookings[i];
+		try
+		{
+			if (CheckLateness(booking.time))
+			{
+				// Late bookings are inserted into up-to-date windows
+				if (pendingRemovalTime)
+				{
+					RemoveBookingsDeprecatedBy(*std::exchange(pendingRemovalTime, std::nullopt), nullptr);
+				}
+				InsertLateBooking(booking.time, booking.clientId, booking.roomCount, nullptr, 0);
+			}
+			else
+			{
+				AddBooking(booking.time, booking.clientId, booking.roomCount, nullptr, 0);
+				pendingRemovalTime = booking.time;
+			}
+		}
+		catch (...)
+		{
+			errors[i] = std::current_exception();
+		}
+	}
+	if (pendingRemovalTime)
+	{
+		RemoveBookingsDeprecatedBy(*pendingRemovalTime, nullptr);
+	}
+	ShrinkIfIdle();
+}
+
+void HotelBookings::Cancel(std::uint64_t sequence, BookingObserver* observer) noexcept
+{
+	assert(m_options.cancellable && sequence >= m_firstSequence && sequence < m_firstSequence + m_bookings.size());
+	const auto position = static_cast<size_t>(sequence - m_firstSequence);
+	assert(!IsCancelled(position));
+	auto& booking = m_bookings[position];
+	for (auto& window : m_windows)
+	{
+		if (sequence < window.begin)
+		{
+			continue;
+		}
+		++window.cancelledCount;
+		window.bookedRooms -= booking.roomCount;
+		if (DecrementClientBookingCount(window.clientBookingCount, booking.clientId) && observer && &window == &m_windows.front())
+		{
+			observer->OnClientRemoved(booking.clientId);
+		}
+	}
+	AddCancelledRooms(sequence, booking.roomCount);
+	(*m_bookingIds)[position] = 0;
+	++m_cancelledCount;
+}
+
+size_t HotelBookings::GetDistinctClientCount(size_t spanIndex) const noexcept
+{
+	return m_windows[spanIndex].clientBookingCount.size();
+}
+
+RoomCount HotelBookings::GetBookedRoomCount(size_t spanIndex) const noexcept
+{
+	return m_windows[spanIndex].bookedRooms;
+}
+
+RoomCount HotelBookings::GetBookedRoomCount(Time from, Time to) const noexcept
+{
+	if (from > to)
+	{
+		return 0;
+	}
+	auto begin = std::lower_bound(m_bookings.begin(), m_bookings.end(), from,
+		[](const Booking& booking, Time time) { return booking.time < time; });
+	auto end = std::upper_bound(begin, m_bookings.end(), to,
+		[](Time time, const Booking& booking) { return time < booking.time; });
+	return static_cast<RoomCount>(GetRoomsBookedBefore(end) - GetRoomsBookedBefore(begin));
+}
+
+size_t HotelBookings::GetDistinctClientCountAt(Time time, size_t spanIndex) const
+{
+	auto it = FindBookingAt(time);
+	if (it == m_bookings.end())
+	{
+		return 0;
+	}
+	return m_reportedClientCounts[static_cast<size_t>(it - m_bookings.begin()) * m_windows.size() + spanIndex];
+}
+
+RoomCount HotelBookings::GetBookedRoomCountAt(Time time, size_t spanIndex) const
+{
+	auto it = FindBookingAt(time);
+	if (it == m_bookings.end())
+	{
+		return 0;
+	}
+	const auto deprecationTime = it->time - m_windows[spanIndex].timeSpan;
+	if (m_latestDiscardedTime > deprecationTime)
+	{
+		throw std::out_of_range("Bookings within the time span are beyond the retention horizon");
+	}
+	auto begin = std::upper_bound(m_bookings.begin(), it, deprecationTime,
+		[](Time time, const Booking& booking) { return time < booking.time; });
+	return static_cast<RoomCount>(GetRoomsBookedBefore(std::next(it)) - GetRoomsBookedBefore(begin));
+}
+
+size_t HotelBookings::GetBookingCount() const noexcept
+{
+	return m_bookings.size() - m_cancelledCount;
+}
+
+size_t HotelBookings::GetBookingCount(size_t spanIndex) const noexcept
+{
+	const auto& window = m_windows[spanIndex];
+	return static_cast<size_t>(m_firstSequence + m_bookings.size() - window.begin) - window.cancelledCount;
+}
+
+size_t HotelBookings::GetWindowBookingCount() const noexcept
+{
+	return GetBookingCount(m_longestSpanIndex);
+}
+
+std::uint64_t HotelBookings::GetEvictedBookingCount() const noexcept
+{
+	return m_evictedBookingCount;
 }
 
-size_t HotelBookings::GetDistinctClientCount() const noexcept
+Time HotelBookings::GetLatestBookingTime() const noexcept
 {
-	return m_clientBookingCount.size();
+	return m_latestBookingTime;
 }
 
-RoomCount HotelBookings::GetBookedRoomCount() const noexcept
+size_t HotelBookings::GetClientBucketCount() const noexcept
 {
-	return m_bookedRoomsWithinTimeSpan;
+	size_t bucketCount = 0;
+	for (auto& window : m_windows)
+	{
+		bucketCount += window.clientBookingCount.bucket_count();
+	}
+	return bucketCount;
+}
+
+void HotelBookings::AdvanceTime(Time time, BookingObserver* observer) noexcept
+{
+	if (time <= m_windowTime)
+	{
+		return;
+	}
+	RemoveBookingsDeprecatedBy(time, observer);
+}
+
+std::uint64_t HotelBookings::GetRoomsBookedBefore(BookingHistory::const_iterator it) const noexcept
+{
+	const auto roomsBookedBefore = it != m_bookings.end() ? it->roomsBookedBefore : m_bookedRoomsInTotal;
+	if (m_cancelledCount == 0)
+	{
+		// Cancelled rooms before any booking in history are the same
+		return roomsBookedBefore;
+	}
+	return roomsBookedBefore - GetCancelledRoomsBefore(m_firstSequence + static_cast<std::uint64_t>(it - m_bookings.begin()));
+}
+
+void HotelBookings::ReserveCancelledRooms()
+{
+	const auto endSequence = m_firstSequence + m_bookings.size() + 1;
+	if (!m_bookingIds || endSequence - m_cancelledRoomsBase <= m_cancelledRooms.size())
+	{
+		return;
+	}
+	// Leaving room for as many bookings as there are makes rebuilding O(1) amortized per booking
+	CancelledRoomTree cancelledRooms(2 * (m_bookings.size() + 1), 0, m_cancelledRooms.get_allocator());
+	for (size_t position = 0; position < m_bookings.size(); ++position)
+	{
+		if (IsCancelled(position))
+		{
+			cancelledRooms[position] = m_bookings[position].roomCount;
+		}
+	}
+	// Builds the tree in place from the values
+	for (size_t index = 1; index <= cancelledRooms.size(); ++index)
+	{
+		const auto parent = index + (index & (0 - index));
+		if (parent <= cancelledRooms.size())
+		{
+			cancelledRooms[parent - 1] += cancelledRooms[index - 1];
+		}
+	}
+	m_cancelledRooms.swap(cancelledRooms);
+	m_cancelledRoomsBase = m_firstSequence;
+}
+
+void HotelBookings::AddCancelledRooms(std::uint64_t sequence, std::uint64_t roomCount) noexcept
+{
+	assert(sequence >= m_cancelledRoomsBase && sequence - m_cancelledRoomsBase < m_cancelledRooms.size());
+	for (auto index = static_cast<size_t>(sequence - m_cancelledRoomsBase) + 1; index <= m_cancelledRooms.size(); index += index & (0 - index))
+	{
+		m_cancelledRooms[index - 1] += roomCount;
+	}
+}
+
+std::uint64_t HotelBookings::GetCancelledRoomsBefore(std::uint64_t sequence) const noexcept
+{
+	std::uint64_t roomCount = 0;
+	for (auto index = std::min(static_cast<size_t>(sequence - m_cancelledRoomsBase), m_cancelledRooms.size()); index != 0; index -= index & (0 - index))
+	{
+		roomCount += m_cancelledRooms[index - 1];
+	}
+	return roomCount;
 }
 
-void HotelBookings::AddBooking(Time time, ClientId clientId, RoomCount roomCount)
+bool HotelBookings::CheckLateness(Time& time) const
 {
-	m_bookings.emplace_back(time, clientId, roomCount);
+	if (time >= m_latestBookingTime)
+	{
+		return false;
+	}
+	if (m_latestBookingTime - time <= m_options.maxLateness)
+	{
+		return true;
+	}
+	if (m_options.rejectTooLate)
+	{
+		throw std::invalid_argument("Booking is earlier than the latest one by more than the lateness bound");
+	}
+	time = m_latestBookingTime;
+	return false;
+}
+
+std::uint64_t HotelBookings::AddBooking(Time time, ClientId clientId, RoomCount roomCount, BookingObserver* observer, BookingId id)
+{
+	ReserveCancelledRooms();
+	m_bookings.emplace_back(time, clientId, roomCount, m_bookedRoomsInTotal);
+	try
+	{
+		AppendBookingAttributes(id);
+	}
+	catch (...)
+	{
+		m_bookings.pop_back();
+		throw;
+	}
+	try
+	{
+		AddClientBooking(clientId, time, time, observer);
+	}
+	catch (...)
+	{
+		PopBookingAttributes();
+		m_bookings.pop_back();
+		throw;
+	}
+	for (auto& window : m_windows)
+	{
+		window.bookedRooms += roomCount;
+	}
+	m_bookedRoomsInTotal += roomCount;
+	m_latestBookingTime = time;
+	return m_firstSequence + m_bookings.size() - 1;
+}
+
+std::optional<std::uint64_t> HotelBookings::InsertLateBooking(Time time, ClientId clientId, RoomCount roomCount,
+	BookingObserver* observer, BookingId id)
+{
+	// Windows may have been advanced past the latest booking
+	const auto latestTime = m_windowTime;
+	if (!IsWithinRetentionHorizon(time, latestTime)
+		&& std::none_of(m_windows.begin(), m_windows.end(),
+			[=](const Window& window) { return IsWithinWindow(window, time, latestTime); }))
+	{
+		// As if the booking was made in time and has already been evicted
+		m_latestDiscardedTime = std::max(m_latestDiscardedTime, time);
+		return std::nullopt;
+	}
+
+	// The booking follows the bookings made at the same time. Late bookings are close to the end of history
+	auto it = m_bookings.end();
+	while (it != m_bookings.begin() && std::prev(it)->time > time)
+	{
+		--it;
+	}
+	const auto position = it - m_bookings.begin();
+	const auto sequence = m_firstSequence + static_cast<std::uint64_t>(position);
+	const auto roomsBookedBefore = it != m_bookings.end() ? it->roomsBookedBefore : m_bookedRoomsInTotal;
+	ReserveCancelledRooms();
+	m_bookings.emplace_back(time, clientId, roomCount, roomsBookedBefore);
+	try
+	{
+		AppendBookingAttributes(id);
+	}
+	catch (...)
+	{
+		m_bookings.pop_back();
+		throw;
+	}
 	try
 	{
-		++m_clientBookingCount[clientId];
-		m_bookedRoomsWithinTimeSpan += roomCount;
+		AddClientBooking(clientId, time, latestTime, observer);
 	}
 	catch (...)
 	{
-		// Rollback booking history changes if m_clientBookingCount[] throws
+		PopBookingAttributes();
 		m_bookings.pop_back();
 		throw;
 	}
+
+	// Bookings, client counts and ids are trivially copyable, so nothing below throws
+	std::rotate(m_bookings.begin() + position, m_bookings.end() - 1, m_bookings.end());
+	if (RetainsHistory())
+	{
+		const auto windowCount = static_cast<ptrdiff_t>(m_windows.size());
+		std::rotate(m_reportedClientCounts.begin() + position * windowCount,
+			m_reportedClientCounts.end() - windowCount, m_reportedClientCounts.end());
+	}
+	if (m_bookingIds)
+	{
+		std::rotate(m_bookingIds->begin() + position, m_bookingIds->end() - 1, m_bookingIds->end());
+		for (auto later = static_cast<size_t>(position) + 1; later < m_bookingIds->size(); ++later)
+		{
+			const auto laterSequence = m_firstSequence + later;
+			if ((*m_bookingIds)[later] == 0)
+			{
+				// Cancelled rooms are shifted along with the bookings
+				const RoomCount cancelledRoomCount = m_bookings[later].roomCount;
+				AddCancelledRooms(laterSequence - 1, std::uint64_t{ 0 } - cancelledRoomCount);
+				AddCancelledRooms(laterSequence, cancelledRoomCount);
+			}
+			else if (observer)
+			{
+				observer->OnBookingMoved((*m_bookingIds)[later], laterSequence);
+			}
+		}
+	}
+	for (auto later = m_bookings.begin() + position + 1; later != m_bookings.end(); ++later)
+	{
+		later->roomsBookedBefore += roomCount;
+	}
+	for (auto& window : m_windows)
+	{
+		if (IsWithinWindow(window, time, latestTime))
+		{
+			window.bookedRooms += roomCount;
+		}
+		else
+		{
+			// The booking precedes the window, shifting the sequence number of its first booking
+			++window.begin;
+		}
+	}
+	m_bookedRoomsInTotal += roomCount;
+	if (RetainsHistory())
+	{
+		RecordClientCounts(static_cast<size_t>(position));
+	}
+	return sequence;
 }
 
-void HotelBookings::RemoveBookingsDeprecatedBy(Time time) noexcept
+void HotelBookings::AddClientBooking(ClientId clientId, Time time, Time latestTime, BookingObserver* observer)
 {
-	auto endOfOutdatedBookings = std::find_if(m_bookings.begin(), m_bookings.end(),
-		[time, this](auto&& booking) {
-			if (booking.time > time)
+	size_t updatedWindowCount = 0;
+	try
+	{
+		bool isNewClient = false;
+		for (; updatedWindowCount < m_windows.size(); ++updatedWindowCount)
+		{
+			auto& window = m_windows[updatedWindowCount];
+			if (IsWithinWindow(window, time, latestTime))
 			{
-				return true;
+				const auto clientBookingCount = ++window.clientBookingCount[clientId];
+				isNewClient = isNewClient || (updatedWindowCount == 0 && clientBookingCount == 1);
 			}
-			else
+		}
+		if (observer && isNewClient)
+		{
+			observer->OnClientAdded(clientId);
+		}
+	}
+	catch (...)
+	{
+		// Rollback client counters changes if clientBookingCount[] or the observer throws
+		for (size_t i = 0; i < updatedWindowCount; ++i)
+		{
+			if (IsWithinWindow(m_windows[i], time, latestTime))
+			{
+				DecrementClientBookingCount(m_windows[i].clientBookingCount, clientId);
+			}
+		}
+		throw;
+	}
+}
+
+bool HotelBookings::IsWithinWindow(const Window& window, Time time, Time latestTime) noexcept
+{
+	return time >= latestTime || time > latestTime - window.timeSpan;
+}
+
+bool HotelBookings::IsWithinRetentionHorizon(Time time, Time latestTime) const noexcept
+{
+	return RetainsHistory() && time > latestTime - m_options.retentionHorizon;
+}
+
+bool HotelBookings::RetainsHistory() const noexcept
+{
+	return m_options.retentionHorizon > 0;
+}
+
+void HotelBookings::AppendBookingAttributes(BookingId id)
+{
+	size_t appendedCount = 0;
+	try
+	{
+		// The counts are recorded once the booking is made
+		for (; RetainsHistory() && appendedCount < m_windows.size(); ++appendedCount)
+		{
+			m_reportedClientCounts.push_back(0);
+		}
+		if (m_bookingIds)
+		{
+			m_bookingIds->push_back(id);
+		}
+	}
+	catch (...)
+	{
+		m_reportedClientCounts.erase(m_reportedClientCounts.end() - static_cast<ptrdiff_t>(appendedCount), m_reportedClientCounts.end());
+		throw;
+	}
+}
+
+void HotelBookings::PopBookingAttributes() noexcept
+{
+	if (RetainsHistory())
+	{
+		m_reportedClientCounts.erase(m_reportedClientCounts.end() - static_cast<ptrdiff_t>(m_windows.size()), m_reportedClientCounts.end());
+	}
+	if (m_bookingIds)
+	{
+		m_bookingIds->pop_back();
+	}
+}
+
+void HotelBookings::RecordClientCounts(size_t position) noexcept
+{
+	for (size_t i = 0; i < m_windows.size(); ++i)
+	{
+		m_reportedClientCounts[position * m_windows.size() + i] = static_cast<std::uint32_t>(m_windows[i].clientBookingCount.size());
+	}
+}
+
+HotelBookings::BookingHistory::const_iterator HotelBookings::FindBookingAt(Time time) const
+{
+	if (!RetainsHistory())
+	{
+		throw std::logic_error("Booking history is not retained");
+	}
+	auto it = std::upper_bound(m_bookings.begin(), m_bookings.end(), time,
+		[](Time time, const Booking& booking) { return time < booking.time; });
+	if (it != m_bookings.begin())
+	{
+		return std::prev(it);
+	}
+	if (m_latestDiscardedTime != std::numeric_limits<Time>::min())
+	{
+		throw std::out_of_range("Point-in-time query is beyond the retention horizon");
+	}
+	// No bookings were made at or before time
+	return m_bookings.end();
+}
+
+void HotelBookings::RemoveBookingsDeprecatedBy(Time time, BookingObserver* observer) noexcept
+{
+	time = std::max(time, m_windowTime);
+	m_windowTime = time;
+	const auto endSequence = m_firstSequence + m_bookings.size();
+	auto historyBegin = endSequence;
+	for (auto& window : m_windows)
+	{
+		// Only the first time span is observed
+		const auto windowObserver = &window == &m_windows.front() ? observer : nullptr;
+		const auto deprecationTime = time - window.timeSpan;
+		auto it = m_bookings.begin() + static_cast<ptrdiff_t>(window.begin - m_firstSequence);
+		for (; window.begin != endSequence && it->time <= deprecationTime; ++window.begin, ++it)
+		{
+			if (IsCancelled(static_cast<size_t>(window.begin - m_firstSequence)))
+			{
+				// The booking has already been removed from statistics
+				--window.cancelledCount;
+				continue;
+			}
+			if (DecrementClientBookingCount(window.clientBookingCount, it->clientId) && windowObserver)
+			{
+				windowObserver->OnClientRemoved(it->clientId);
+			}
+			window.bookedRooms -= it->roomCount;
+			if (&window == &m_windows[m_longestSpanIndex])
+			{
+				++m_evictedBookingCount;
+			}
+		}
+		historyBegin = std::min(historyBegin, window.begin);
+	}
+	if (RetainsHistory())
+	{
+		// Bookings out of all time spans are retained within the retention horizon
+		auto sequence = m_firstSequence;
+		for (auto it = m_bookings.begin(); sequence != historyBegin && !IsWithinRetentionHorizon(it->time, time); ++it)
+		{
+			++sequence;
+		}
+		historyBegin = sequence;
+	}
+	const auto discardedCount = static_cast<ptrdiff_t>(historyBegin - m_firstSequence);
+	if (discardedCount == 0)
+	{
+		return;
+	}
+	m_latestDiscardedTime = m_bookings[static_cast<size_t>(discardedCount - 1)].time;
+	m_bookings.erase(m_bookings.begin(), m_bookings.begin() + discardedCount);
+	if (RetainsHistory())
+	{
+		m_reportedClientCounts.erase(m_reportedClientCounts.begin(),
+			m_reportedClientCounts.begin() + discardedCount * static_cast<ptrdiff_t>(m_windows.size()));
+	}
+	if (m_bookingIds)
+	{
+		for (auto it = m_bookingIds->begin(); it != m_bookingIds->begin() + discardedCount; ++it)
+		{
+			if (*it == 0)
 			{
-				DecrementClientBookingCount(booking.clientId);
-				m_bookedRoomsWithinTimeSpan -= booking.roomCount;
-				return false;
+				--m_cancelledCount;
 			}
-		});
-	m_bookings.erase(m_bookings.begin(), endOfOutdatedBookings);
+			else if (observer)
+			{
+				observer->OnBookingDiscarded(*it);
+			}
+		}
+		m_bookingIds->erase(m_bookingIds->begin(), m_bookingIds->begin() + discardedCount);
+	}
+	m_firstSequence = historyBegin;
+}
+
+bool HotelBookings::IsCancelled(size_t position) const noexcept
+{
+	return m_bookingIds && (*m_bookingIds)[position] == 0;
+}
+
+bool HotelBookings::DecrementClientBookingCount(ClientBookingCountMap& clientBookingCount, ClientId clientId) noexcept
+{
+	if (auto it = clientBookingCount.find(clientId);
+		(it != clientBookingCount.end() && (--it->second == 0))) // no client bookings within current time span
+	{
+		clientBookingCount.erase(it);
+		return true;
+	}
+	return false;
 }
 
-void HotelBookings::DecrementClientBookingCount(ClientId clientId) noexcept
+void HotelBookings::ShrinkIfIdle() noexcept
 {
-	if (auto it = m_clientBookingCount.find(clientId);
-		(it != m_clientBookingCount.end() && (--it->second == 0))) // no client bookings within current time span
+	const auto bookingCount = m_bookings.size();
+	if (bookingCount * ShrinkRatio >= m_peakBookingCount)
+	{
+		m_peakBookingCount = std::max(m_peakBookingCount, bookingCount);
+		m_booksBelowPeak = 0;
+		return;
+	}
+	if (++m_booksBelowPeak < ShrinkDelay)
+	{
+		return;
+	}
+	// Another thread allocating through the counters would be taken for the memory returned by the shrink
+	[[maybe_unused]] const bool shrinking = m_memoryCounters && m_memoryCounters->shrinking.exchange(true, std::memory_order_relaxed);
+	assert(!shrinking);
+	try
+	{
+		Shrink();
+	}
+	catch (...)
+	{
+		// Shrinking is an optimization, the containers stay valid if it fails
+	}
+	if (m_memoryCounters)
+	{
+		m_memoryCounters->shrinking.store(false, std::memory_order_relaxed);
+	}
+	m_peakBookingCount = bookingCount;
+	m_booksBelowPeak = 0;
+}
+
+void HotelBookings::Shrink()
+{
+	auto getAllocatedBytes = [this] {
+		return m_memoryCounters
+			? m_memoryCounters->bookings.GetStatistics().GetTotalBytes() + m_memoryCounters->clients.GetStatistics().GetTotalBytes()
+			: 0;
+	};
+	const auto allocatedBytes = getAllocatedBytes();
+
+	m_bookings.shrink_to_fit();
+	m_reportedClientCounts.shrink_to_fit();
+	if (m_bookingIds)
+	{
+		m_bookingIds->shrink_to_fit();
+	}
+	for (auto& window : m_windows)
+	{
+		// Leave room to double before the client map grows again
+		window.clientBookingCount.rehash(window.clientBookingCount.size() * 2);
+	}
+
+	if (m_memoryCounters)
 	{
-		m_clientBookingCount.erase(it);
+		const auto shrunkBytes = getAllocatedBytes();
+		m_memoryCounters->shrinkCount.fetch_add(1, std::memory_order_relaxed);
+		m_memoryCounters->reclaimedBytes.fetch_add(allocatedBytes > shrunkBytes ? allocatedBytes - shrunkBytes : 0, std::memory_order_relaxed);
 	}
 }
@@ -1,46 +1,270 @@
 #pragma once
 
+#include "CountingAllocator.h"
+#include <atomic>
 #include <cstdint>
 #include <deque>
+#include <exception>
+#include <optional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 using Time = std::int64_t;
 using ClientId = std::uint32_t;
 using RoomCount = std::uint32_t;
+using BookingId = std::uint64_t;
+
+// Accumulate memory allocated by the containers of HotelBookings instances sharing them.
+// The memory returned by a shrink is measured as the drop of the counters over it, so the instances
+// sharing counters must not be used by several threads at once (overlapping shrinks are checked in debug builds)
+struct BookingMemoryCounters
+{
+	AllocationCounter bookings;
+	AllocationCounter clients;
+	AllocationCounter windows;
+	// Containers shrunk after a drop of the number of bookings and the memory it returned
+	std::atomic<std::uint64_t> shrinkCount{ 0 };
+	std::atomic<std::uint64_t> reclaimedBytes{ 0 };
+	std::atomic<bool> shrinking{ false };
+};
+
+// Optional features of the booking history of a hotel
+struct BookingHistoryOptions
+{
+	// Bookings may arrive up to maxLateness earlier than the latest booking. An earlier booking is booked
+	// at the time of the latest booking unless rejectTooLate is set
+	Time maxLateness = 0;
+	// A positive retentionHorizon retains bookings made within it before the latest booking (in addition to
+	// the bookings within the time spans) to answer point-in-time queries
+	Time retentionHorizon = 0;
+	// Keep booking ids to allow cancellation
+	bool cancellable = false;
+	// Throw std::invalid_argument for a booking more than maxLateness earlier than the latest booking
+	bool rejectTooLate = false;
+};
+
+// Is notified of changes of the booking history of a hotel
+class BookingObserver
+{
+public:
+	// A client gets its first booking or loses its last one within the first time span
+	virtual void OnClientAdded(ClientId clientId) = 0;
+	virtual void OnClientRemoved(ClientId clientId) noexcept = 0;
+	// A booking made with an id gets another sequence number since a late booking is inserted before it
+	virtual void OnBookingMoved(BookingId id, std::uint64_t sequence) noexcept = 0;
+	// A booking made with an id leaves the booking history
+	virtual void OnBookingDiscarded(BookingId id) noexcept = 0;
+
+protected:
+	~BookingObserver() = default;
+};
+
+struct BookingRequest
+{
+	Time time;
+	ClientId clientId;
+	RoomCount roomCount;
+};
 
 class HotelBookings final
 {
 public:
-	explicit HotelBookings(Time timeSpan);
+	// The booking history and client maps are shrunk once the number of bookings stays ShrinkRatio times
+	// below its peak for ShrinkDelay bookings in a row, so that a burst doesn't hold its memory forever
+	// and a hotel oscillating around its size doesn't reallocate on every booking
+	static constexpr size_t ShrinkRatio = 8;
+	static constexpr unsigned ShrinkDelay = 64;
+
+	// memoryCounters (if any) must outlive HotelBookings
+	explicit HotelBookings(Time timeSpan, BookingMemoryCounters* memoryCounters = nullptr);
+
+	// Collects statistics for every time span over a single booking history retained for the longest one.
+	// timeSpans must not be empty
+	explicit HotelBookings(const std::vector<Time>& timeSpans, BookingMemoryCounters* memoryCounters = nullptr,
+		const BookingHistoryOptions& options = {});
+
+	/*
+	A booking earlier than the latest one is inserted in time order in O(number of bookings made after it).
+	The latest booking is remembered after it leaves the history, so lateness is checked even if the history is empty.
+	Throws std::invalid_argument if the booking is more than maxLateness earlier than the latest booking and rejectTooLate is set.
+	If OnClientAdded throws, the booking is not made.
+	Returns the sequence number of the booking unless it has already left the booking history.
+	id must not be 0 if the history is cancellable
+	*/
+	std::optional<std::uint64_t> Book(Time time, ClientId clientId, RoomCount roomCount,
+		BookingObserver* observer = nullptr, BookingId id = 0);
+
+	/*
+	Makes the bookings as Book would, but removes the bookings deprecated by a run of bookings in time order
+	once after the run instead of after each of them, so bookings sorted by time are made in one pass.
+	errors receives the exception thrown by each booking (or nullptr).
+	History must be neither retained nor cancellable, since they record every booking as it is made
+	*/
+	void BookBatch(const std::vector<BookingRequest>& bookings, std::vector<std::exception_ptr>& errors);
+
+	// Removes the booking from statistics of all time spans in O(number of time spans + log(number of bookings)).
+	// The booking stays in history as a tombstone until it is evicted. The history must be cancellable, and sequence must refer
+	// to a booking in history that hasn't been cancelled yet
+	void Cancel(std::uint64_t sequence, BookingObserver* observer = nullptr) noexcept;
+
+	// spanIndex must be less than the number of time spans
+	size_t GetDistinctClientCount(size_t spanIndex = 0) const noexcept;
 
-	void Book(Time time, ClientId clientId, RoomCount roomCount);
+	// spanIndex must be less than the number of time spans
+	RoomCount GetBookedRoomCount(size_t spanIndex = 0) const noexcept;
 
-	size_t GetDistinctClientCount() const noexcept;
+	// Rooms booked at time in [from, to] among the retained bookings. O(log(number of bookings))
+	RoomCount GetBookedRoomCount(Time from, Time to) const noexcept;
 
-	RoomCount GetBookedRoomCount() const noexcept;
+	/*
+	Point-in-time statistics as of the latest booking made at or before time, O(log(number of bookings)).
+	Rooms are summed over the retained bookings within the time span ending at that booking, including
+	bookings that arrived late. The number of clients is the one reported right after that booking was made.
+	Throw std::logic_error unless history is retained and std::out_of_range if the bookings needed
+	are beyond the retention horizon
+	*/
+	size_t GetDistinctClientCountAt(Time time, size_t spanIndex = 0) const;
+	RoomCount GetBookedRoomCountAt(Time time, size_t spanIndex = 0) const;
+
+	// Number of retained bookings (the bookings within the longest time span unless history is retained)
+	// except cancelled ones
+	size_t GetBookingCount() const noexcept;
+
+	// Number of bookings within the given time span except cancelled ones
+	size_t GetBookingCount(size_t spanIndex) const noexcept;
+
+	// Number of bookings within the longest time span except cancelled ones
+	size_t GetWindowBookingCount() const noexcept;
+
+	// Number of bookings that have left the longest time span (and so all statistics), except cancelled ones
+	std::uint64_t GetEvictedBookingCount() const noexcept;
+
+	size_t GetClientBucketCount() const noexcept;
+
+	// Time of the latest booking made, even if it has left the history. The minimum time if there were none
+	Time GetLatestBookingTime() const noexcept;
+
+	// Removes bookings that are out of the time spans of a booking made at time, without making one.
+	// Does nothing if time is not later than the time windows are advanced to. Doesn't change the time lateness
+	// is measured from, but later bookings earlier than time are counted as if they were made before this call
+	void AdvanceTime(Time time, BookingObserver* observer = nullptr) noexcept;
+
+	// Calls callback(clientId, bookingCount) for every client having bookings within the time span.
+	// spanIndex must be less than the number of time spans
+	template <typename Callback>
+	void ForEachClient(size_t spanIndex, Callback&& callback) const
+	{
+		for (auto& [clientId, bookingCount] : m_windows[spanIndex].clientBookingCount)
+		{
+			callback(clientId, bookingCount);
+		}
+	}
 
 private:
 	struct Booking
 	{
-		Booking(Time time, ClientId clientId, RoomCount roomCount) noexcept
+		Booking(Time time, ClientId clientId, RoomCount roomCount, std::uint64_t roomsBookedBefore) noexcept
 			: time(time)
 			, clientId(clientId)
 			, roomCount(roomCount)
+			, roomsBookedBefore(roomsBookedBefore)
 		{
 		}
 		Time time;
 		ClientId clientId;
 		RoomCount roomCount;
+		// Rooms booked by all preceding bookings of the hotel, including evicted and cancelled ones.
+		// The difference of two values less rooms of the bookings cancelled in between gives rooms booked in between
+		std::uint64_t roomsBookedBefore;
 	};
 
-	void AddBooking(Time time, ClientId clientId, RoomCount roomCount);
-	void RemoveBookingsDeprecatedBy(Time time) noexcept;
-	void DecrementClientBookingCount(ClientId clientId) noexcept;
+	using BookingHistory = std::deque<Booking, CountingAllocator<Booking>>;
+	// Number of distinct clients of every window reported after a booking, for each retained booking
+	using ClientCountHistory = std::deque<std::uint32_t, CountingAllocator<std::uint32_t>>;
+	// Id of every retained booking, 0 for cancelled ones
+	using BookingIdHistory = std::deque<BookingId, CountingAllocator<BookingId>>;
+	using CancelledRoomTree = std::vector<std::uint64_t, CountingAllocator<std::uint64_t>>;
+	using ClientBookingCountMap = std::unordered_map<ClientId, unsigned, std::hash<ClientId>, std::equal_to<ClientId>,
+		CountingAllocator<std::pair<const ClientId, unsigned>>>;
+
+	// Statistics of bookings within a time span
+	struct Window
+	{
+		Window(Time timeSpan, const ClientBookingCountMap::allocator_type& allocator)
+			: timeSpan(timeSpan)
+			, clientBookingCount(allocator)
+		{
+		}
+		Time timeSpan;
+		std::uint64_t begin = 0; // Sequence number of the first booking within time span
+		RoomCount bookedRooms = 0;
+		size_t cancelledCount = 0; // Cancelled bookings within time span
+		ClientBookingCountMap clientBookingCount;
+	};
+
+	// Rooms booked before the given booking (or by all bookings if it is the end) except cancelled ones.
+	// O(log(number of bookings)) if history is cancellable
+	std::uint64_t GetRoomsBookedBefore(BookingHistory::const_iterator it) const noexcept;
+	// Makes the cancelled room tree cover one more booking, rebuilding it from history once bookings outgrow it
+	void ReserveCancelledRooms();
+	// Adds rooms (modulo 2^64) to the cancelled rooms at the sequence number in O(log(number of bookings))
+	void AddCancelledRooms(std::uint64_t sequence, std::uint64_t roomCount) noexcept;
+	// Rooms of the bookings cancelled before the sequence number, including evicted ones since the tree was rebuilt
+	std::uint64_t GetCancelledRoomsBefore(std::uint64_t sequence) const noexcept;
+
+	// Returns whether the booking made at time is late. Moves a booking later than maxLateness to the latest
+	// booking time or throws std::invalid_argument if it is rejected
+	bool CheckLateness(Time& time) const;
+	// Return the sequence number of the booking
+	std::uint64_t AddBooking(Time time, ClientId clientId, RoomCount roomCount, BookingObserver* observer, BookingId id);
+	// Inserts a booking made before the latest one into the windows whose time spans contain it
+	std::optional<std::uint64_t> InsertLateBooking(Time time, ClientId clientId, RoomCount roomCount,
+		BookingObserver* observer, BookingId id);
+	// Counts the client booking in the windows containing a booking made at time (see IsWithinWindow).
+	// Leaves the counts unchanged if it throws
+	void AddClientBooking(ClientId clientId, Time time, Time latestTime, BookingObserver* observer);
+	// Whether the window contains a booking made at time when the latest booking is made at latestTime
+	static bool IsWithinWindow(const Window& window, Time time, Time latestTime) noexcept;
+	bool IsWithinRetentionHorizon(Time time, Time latestTime) const noexcept;
+	bool RetainsHistory() const noexcept;
+
+	// Appends the id and client counts of the latest booking to their histories with a rollback if it throws
+	void AppendBookingAttributes(BookingId id);
+	void PopBookingAttributes() noexcept;
+	// Stores current client counts of all windows as reported after the booking at position
+	void RecordClientCounts(size_t position) noexcept;
+	// Returns the latest retained booking made at or before time or end() if there is none.
+	// Throws if history is not retained or the booking may have been discarded
+	BookingHistory::const_iterator FindBookingAt(Time time) const;
+	// Removes bookings that are out of time span of a booking made at the given time (or at m_windowTime if it is later)
+	void RemoveBookingsDeprecatedBy(Time time, BookingObserver* observer) noexcept;
+	bool IsCancelled(size_t position) const noexcept;
+	// Returns true if the client has no more bookings within the time span
+	static bool DecrementClientBookingCount(ClientBookingCountMap& clientBookingCount, ClientId clientId) noexcept;
+	void ShrinkIfIdle() noexcept;
+	// Reports the memory returned as the drop of the shared memory counters
+	void Shrink();
 
-	Time m_timeSpan;
-	RoomCount m_bookedRoomsWithinTimeSpan = 0;
+	std::uint64_t m_bookedRoomsInTotal = 0;
+	std::uint64_t m_firstSequence = 0; // Sequence number of m_bookings.front()
+	BookingHistoryOptions m_options;
+	Time m_latestBookingTime; // Whether or not the booking is still in history
+	Time m_latestDiscardedTime; // Time of the latest booking removed from history
+	Time m_windowTime; // Time windows are advanced to, the latest booking time or a later one given to AdvanceTime
+	size_t m_cancelledCount = 0; // Cancelled bookings in history
+	BookingMemoryCounters* m_memoryCounters;
+	size_t m_longestSpanIndex = 0;
+	std::uint64_t m_evictedBookingCount = 0;
+	size_t m_peakBookingCount = 0; // Since the last shrink
+	unsigned m_booksBelowPeak = 0; // Consecutive bookings leaving less than 1 / ShrinkRatio of peak bookings
 
-	std::deque<Booking> m_bookings; // Booking history within time span
-	std::unordered_map<ClientId, unsigned> m_clientBookingCount;
+	BookingHistory m_bookings; // Booking history within the longest time span or the retention horizon
+	ClientCountHistory m_reportedClientCounts; // Only if history is retained
+	std::optional<BookingIdHistory> m_bookingIds; // Only if history is cancellable
+	// Fenwick tree of rooms of cancelled bookings indexed by sequence number less m_cancelledRoomsBase.
+	// Covers the sequence numbers of history. Only if history is cancellable
+	CancelledRoomTree m_cancelledRooms;
+	std::uint64_t m_cancelledRoomsBase = 0;
+	std::vector<Window, CountingAllocator<Window>> m_windows;
 };
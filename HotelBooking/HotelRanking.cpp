@@ -0,0 +1,48 @@
+#include "HotelRanking.h"
+#include <algorithm>
+
+HotelRanking::HotelRanking(AllocationCounter* memoryCounter)
+	: m_entries(CountingAllocator<Entry>(memoryCounter))
+{
+}
+
+void HotelRanking::Insert(const std::string& hotelName)
+{
+	m_entries.insert({ 0, &hotelName });
+}
+
+void HotelRanking::Update(const std::string& hotelName, RoomCount oldRoomCount, RoomCount newRoomCount) noexcept
+{
+	if (oldRoomCount == newRoomCount)
+	{
+		return;
+	}
+	// Reuse the node to keep the update allocation-free
+	auto node = m_entries.extract({ oldRoomCount, &hotelName });
+	if (node)
+	{
+		node.value().roomCount = newRoomCount;
+		m_entries.insert(std::move(node));
+	}
+}
+
+void HotelRanking::Erase(const std::string& hotelName, RoomCount roomCount) noexcept
+{
+	m_entries.erase({ roomCount, &hotelName });
+}
+
+std::vector<HotelRoomCount> HotelRanking::GetTop(size_t count) const
+{
+	std::vector<HotelRoomCount> top;
+	top.reserve(std::min(count, m_entries.size()));
+	for (auto it = m_entries.begin(); it != m_entries.end() && top.size() < count; ++it)
+	{
+		top.push_back({ *it->hotelName, it->roomCount });
+	}
+	return top;
+}
+
+size_t HotelRanking::GetSize() const noexcept
+{
+	return m_entries.size();
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "HotelBookings.h"
+#include <set>
+#include <string>
+#include <vector>
+
+struct HotelRoomCount
+{
+	std::string hotelName;
+	RoomCount roomCount;
+};
+
+// Hotels ordered by booked rooms (and by name among hotels with equal room count).
+// Updating a hotel takes O(log(number of hotels)) and doesn't allocate memory,
+// the hotels with most rooms are enumerated in O(1) per hotel
+class HotelRanking final
+{
+public:
+	// memoryCounter (if any) must outlive HotelRanking
+	explicit HotelRanking(AllocationCounter* memoryCounter = nullptr);
+
+	// Adds a hotel with no booked rooms. hotelName must stay alive and unchanged while the hotel is ranked
+	void Insert(const std::string& hotelName);
+
+	void Update(const std::string& hotelName, RoomCount oldRoomCount, RoomCount newRoomCount) noexcept;
+
+	void Erase(const std::string& hotelName, RoomCount roomCount) noexcept;
+
+	// Returns up to count hotels with most booked rooms in descending order
+	std::vector<HotelRoomCount> GetTop(size_t count) const;
+
+	size_t GetSize() const noexcept;
+
+private:
+	struct Entry
+	{
+		RoomCount roomCount;
+		const std::string* hotelName;
+	};
+
+	struct MoreRooms
+	{
+		bool operator()(const Entry& lhs, const Entry& rhs) const noexcept
+		{
+			return lhs.roomCount != rhs.roomCount ? lhs.roomCount > rhs.roomCount : *lhs.hotelName < *rhs.hotelName;
+		}
+	};
+
+	std::set<Entry, MoreRooms, CountingAllocator<Entry>> m_entries;
+};
@@ -0,0 +1,91 @@
+#include "LatencyHistogram.h"
+#include <algorithm>
+#include <cmath>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+unsigned GetMostSignificantBit(std::uint64_t value) noexcept
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return index;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+} // namespace
+
+void LatencyHistogram::Record(std::uint64_t value) noexcept
+{
+	++m_buckets[GetBucketIndex(value)];
+	++m_count;
+	m_sum += value;
+	m_max = std::max(m_max, value);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) noexcept
+{
+	for (unsigned i = 0; i < BucketCount; ++i)
+	{
+		m_buckets[i] += other.m_buckets[i];
+	}
+	m_count += other.m_count;
+	m_sum += other.m_sum;
+	m_max = std::max(m_max, other.m_max);
+}
+
+void LatencyHistogram::Reset() noexcept
+{
+	*this = LatencyHistogram();
+}
+
+double LatencyHistogram::GetMean() const noexcept
+{
+	return m_count ? static_cast<double>(m_sum) / m_count : 0.0;
+}
+
+std::uint64_t LatencyHistogram::GetPercentile(double percentile) const noexcept
+{
+	if (m_count == 0)
+	{
+		return 0;
+	}
+	const auto rank = std::max<std::uint64_t>(1,
+		static_cast<std::uint64_t>(std::ceil(percentile / 100.0 * m_count)));
+	std::uint64_t seen = 0;
+	for (unsigned i = 0; i < BucketCount; ++i)
+	{
+		seen += m_buckets[i];
+		if (seen >= rank)
+		{
+			return std::min(GetBucketUpperBound(i), m_max);
+		}
+	}
+	return m_max;
+}
+
+unsigned LatencyHistogram::GetBucketIndex(std::uint64_t value) noexcept
+{
+	if (value < (1u << PrecisionBits))
+	{
+		return static_cast<unsigned>(value);
+	}
+	// value >> shift lies in [SubBucketCount, 2 * SubBucketCount)
+	const unsigned shift = GetMostSignificantBit(value) - (PrecisionBits - 1);
+	return (shift + 1) * SubBucketCount + static_cast<unsigned>((value >> shift) - SubBucketCount);
+}
+
+std::uint64_t LatencyHistogram::GetBucketUpperBound(unsigned index) noexcept
+{
+	if (index < (1u << PrecisionBits))
+	{
+		return index;
+	}
+	const unsigned shift = index / SubBucketCount - 1;
+	const std::uint64_t subBucket = index % SubBucketCount + SubBucketCount;
+	return ((subBucket + 1) << shift) - 1;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+/*
+Log-linear latency histogram in the spirit of HdrHistogram.
+Values below 2^PrecisionBits are stored exactly, larger values are grouped into
+2^(PrecisionBits-1) sub-buckets per power of two, so every recorded value is reported
+with a relative error below 1/16 (about 6%). Recording is O(1) and allocation-free.
+*/
+class LatencyHistogram final
+{
+public:
+	void Record(std::uint64_t value) noexcept;
+
+	void Merge(const LatencyHistogram& other) noexcept;
+
+	void Reset() noexcept;
+
+	std::uint64_t GetCount() const noexcept { return m_count; }
+	std::uint64_t GetMax() const noexcept { return m_max; }
+	std::uint64_t GetSum() const noexcept { return m_sum; }
+	double GetMean() const noexcept;
+
+	// Returns the highest value equivalent to the one at the given percentile (0..100]
+	std::uint64_t GetPercentile(double percentile) const noexcept;
+
+private:
+	static constexpr unsigned PrecisionBits = 5;
+	static constexpr unsigned SubBucketCount = 1u << (PrecisionBits - 1);
+	static constexpr unsigned BucketCount = (64 - PrecisionBits + 2) * SubBucketCount;
+
+	static unsigned GetBucketIndex(std::uint64_t value) noexcept;
+	static std::uint64_t GetBucketUpperBound(unsigned index) noexcept;
+
+	std::array<std::uint64_t, BucketCount> m_buckets{};
+	std::uint64_t m_count = 0;
+	std::uint64_t m_sum = 0;
+	std::uint64_t m_max = 0;
+};
@@ -0,0 +1,49 @@
+#include "MemoryUsage.h"
+#include <ostream>
+
+namespace
+{
+void PrintStatistics(std::ostream& output, const char* name, const AllocationStatistics& statistics)
+{
+	output << name << ": " << statistics.bytes << " bytes in " << statistics.blocks
+		   << " blocks, overhead " << statistics.overheadBytes << " bytes\n";
+}
+} // namespace
+
+AllocationStatistics MemoryUsage::GetTotal() const noexcept
+{
+	AllocationStatistics total = hotelMap;
+	total += hotelNames;
+	total += bookings;
+	total += clientMaps;
+	total += windows;
+	total += hotelRanking;
+	total += clientHotelIndex;
+	total += bookingHandles;
+	return total;
+}
+
+std::ostream& operator<<(std::ostream& output, const MemoryUsage& usage)
+{
+	PrintStatistics(output, "hotel map", usage.hotelMap);
+	PrintStatistics(output, "hotel names", usage.hotelNames);
+	PrintStatistics(output, "bookings", usage.bookings);
+	PrintStatistics(output, "client maps", usage.clientMaps);
+	PrintStatistics(output, "windows", usage.windows);
+	PrintStatistics(output, "hotel ranking", usage.hotelRanking);
+	PrintStatistics(output, "client hotel index", usage.clientHotelIndex);
+	PrintStatistics(output, "booking handles", usage.bookingHandles);
+	const auto total = usage.GetTotal();
+	PrintStatistics(output, "total", total);
+
+	output << "hotels: " << usage.hotelCount << ", bookings: " << usage.bookingCount << "\n";
+	if (usage.hotelCount != 0)
+	{
+		output << "bytes per hotel: " << total.GetTotalBytes() / usage.hotelCount << "\n";
+	}
+	if (usage.bookingCount != 0)
+	{
+		output << "bytes per booking: " << usage.bookings.GetTotalBytes() / usage.bookingCount << "\n";
+	}
+	return output;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "CountingAllocator.h"
+#include <iosfwd>
+
+// Breakdown of heap memory used by BookingService
+struct MemoryUsage
+{
+	AllocationStatistics hotelMap; // Nodes and buckets of the hotel map and the queue of hotels to expire
+	AllocationStatistics hotelNames; // Hotel names too long for the small string buffer
+	AllocationStatistics bookings; // Booking history deques of all hotels
+	AllocationStatistics clientMaps; // Client booking counters of all hotels
+	AllocationStatistics windows; // Statistic time span descriptors of all hotels
+	AllocationStatistics hotelRanking; // Hotels ordered by booked rooms
+	AllocationStatistics clientHotelIndex; // Hotels booked by every client
+	AllocationStatistics bookingHandles; // Locations of cancellable bookings
+
+	std::size_t hotelCount = 0;
+	std::size_t bookingCount = 0;
+
+	AllocationStatistics GetTotal() const noexcept;
+};
+
+std::ostream& operator<<(std::ostream& output, const MemoryUsage& usage);
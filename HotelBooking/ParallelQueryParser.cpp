@@ -0,0 +1,355 @@
+#include "ParallelQueryParser.h"
+#include "UserInterface.h"
+#include <algorithm>
+#include <istream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <sstream>
+#endif
+
+using namespace std::literals;
+
+namespace
+{
+// Contents of a file, mapped into memory on Linux and read otherwise
+class FileText final
+{
+public:
+	// Throws std::runtime_error if the file can't be opened
+	explicit FileText(const std::string& path)
+	{
+#ifdef __linux__
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		struct stat status;
+		if (fd < 0 || ::fstat(fd, &status) != 0)
+		{
+			if (fd >= 0)
+			{
+				::close(fd);
+			}
+			throw std::runtime_error("Can't open " + path);
+		}
+		m_size = static_cast<size_t>(status.st_size);
+		if (m_size != 0)
+		{
+			m_address = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		::close(fd);
+		if (m_address == MAP_FAILED)
+		{
+			throw std::runtime_error("Can't map " + path);
+		}
+		if (m_address)
+		{
+			::madvise(m_address, m_size, MADV_SEQUENTIAL);
+		}
+#else
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+		{
+			throw std::runtime_error("Can't open " + path);
+		}
+		std::ostringstream text;
+		text << file.rdbuf();
+		m_text = std::move(text).str();
+#endif
+	}
+
+	~FileText()
+	{
+#ifdef __linux__
+		if (m_address)
+		{
+			::munmap(m_address, m_size);
+		}
+#endif
+	}
+
+	FileText(const FileText&) = delete;
+	FileText& operator=(const FileText&) = delete;
+
+	std::string_view GetText() const noexcept
+	{
+#ifdef __linux__
+		return { static_cast<const char*>(m_address), m_size };
+#else
+		return m_text;
+#endif
+	}
+
+private:
+#ifdef __linux__
+	void* m_address = nullptr;
+	size_t m_size = 0;
+#else
+	std::string m_text;
+#endif
+};
+
+void ParseChunk(std::string_view text, std::vector<QueryRecord>& records)
+{
+	if (text.size() > std::numeric_limits<std::uint32_t>::max())
+	{
+		throw std::runtime_error("Query line is too long");
+	}
+	records.clear();
+	size_t lineBegin = 0;
+	while (lineBegin < text.size())
+	{
+		auto lineEnd = text.find('\n', lineBegin);
+		if (lineEnd == std::string_view::npos)
+		{
+			lineEnd = text.size();
+		}
+		const auto line = text.substr(lineBegin, lineEnd - lineBegin);
+		auto& record = records.emplace_back();
+		std::string_view hotelName;
+		record.parsed = ParseQueryRecord(line, record, hotelName);
+		const auto recordText = record.parsed ? hotelName : line;
+		record.textOffset = recordText.empty() ? 0 : static_cast<std::uint32_t>(recordText.data() - text.data());
+		record.textSize = static_cast<std::uint32_t>(recordText.size());
+		lineBegin = lineEnd + 1;
+	}
+}
+} // namespace
+
+ParallelQueryParser::ParallelQueryParser(BookingService& service, unsigned threadCount)
+	: m_service(service)
+	, m_threadCount(threadCount)
+{
+	if (threadCount == 0 || threadCount > MaxThreadCount)
+	{
+		throw std::invalid_argument("Thread count is out of range");
+	}
+	// Every thread parses a chunk while the calling thread reads one and executes another
+	m_chunks.resize(threadCount + 2);
+}
+
+unsigned ParallelQueryParser::GetThreadCount() const noexcept
+{
+	return m_threadCount;
+}
+
+void ParallelQueryParser::Run(std::istream& input, std::ostream& output)
+{
+	std::string line;
+	std::getline(input, line);
+	const unsigned queryCount = std::stoul(line);
+	// getline leaves the line as it was once the stream fails, so UserInterface::Run
+	// gets the last line past the end of the input unless the input ends with a line end
+	std::string lastLine = input.eof() ? line : "";
+	std::string carry; // A line split between chunks
+	RunChunks(
+		queryCount,
+		[&input, &lastLine, &carry](Chunk& chunk) {
+			auto& buffer = chunk.buffer;
+			if (buffer.size() < carry.size() + ChunkSize)
+			{
+				buffer.resize(carry.size() + ChunkSize);
+			}
+			carry.copy(buffer.data(), carry.size());
+			size_t size = carry.size();
+			carry.clear();
+			for (;;)
+			{
+				input.read(buffer.data() + size, buffer.size() - size);
+				size += static_cast<size_t>(input.gcount());
+				chunk.text = std::string_view(buffer.data(), size);
+				if (!input)
+				{
+					if (size != 0)
+					{
+						const auto lastLineBegin = chunk.text.rfind('\n') + 1;
+						lastLine.assign(chunk.text.substr(lastLineBegin));
+					}
+					return size != 0;
+				}
+				const auto lineEnd = chunk.text.rfind('\n');
+				if (lineEnd != std::string_view::npos)
+				{
+					carry.assign(chunk.text.substr(lineEnd + 1));
+					chunk.text = chunk.text.substr(0, lineEnd + 1);
+					return true;
+				}
+				// The line is longer than the buffer
+				buffer.resize(buffer.size() * 2);
+			}
+		},
+		[&lastLine](std::string& line) { line = lastLine; },
+		output);
+}
+
+void ParallelQueryParser::Run(const std::string& path, std::ostream& output)
+{
+	const FileText file(path);
+	auto text = file.GetText();
+	const auto countLineEnd = std::min(text.find('\n'), text.size());
+	const unsigned queryCount = std::stoul(std::string(text.substr(0, countLineEnd)));
+	text.remove_prefix(std::min(countLineEnd + 1, text.size()));
+	RunChunks(
+		queryCount,
+		[&text](Chunk& chunk) {
+			if (text.empty())
+			{
+				return false;
+			}
+			auto chunkEnd = text.size();
+			if (chunkEnd > ChunkSize)
+			{
+				chunkEnd = std::min(text.find('\n', ChunkSize - 1), text.size() - 1) + 1;
+			}
+			chunk.text = text.substr(0, chunkEnd);
+			text.remove_prefix(chunkEnd);
+			return true;
+		},
+		// FileReader returns empty lines past the end of the file
+		[](std::string& line) { line.clear(); },
+		output);
+}
+
+template <typename NextChunk, typename LineAfterEnd>
+void ParallelQueryParser::RunChunks(unsigned queryCount, NextChunk&& nextChunk, LineAfterEnd&& lineAfterEnd, std::ostream& output)
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_dispatchedChunkCount = 0;
+		m_takenChunkCount = 0;
+		m_finishing = false;
+	}
+	std::vector<std::thread> threads;
+	const auto stopThreads = [this, &threads] {
+		{
+			std::lock_guard lock(m_mutex);
+			m_finishing = true;
+		}
+		m_chunkDispatched.notify_all();
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		threads.clear();
+	};
+
+	try
+	{
+		for (unsigned i = 0; i < m_threadCount; ++i)
+		{
+			threads.emplace_back([this] { ParseChunks(); });
+		}
+
+		std::uint64_t dispatchedChunkCount = 0;
+		std::uint64_t executedChunkCount = 0;
+		bool inputEnded = false;
+		while (queryCount != 0)
+		{
+			// Reads ahead into the free chunks
+			while (!inputEnded && dispatchedChunkCount - executedChunkCount < m_chunks.size())
+			{
+				auto& chunk = m_chunks[dispatchedChunkCount % m_chunks.size()];
+				if (!nextChunk(chunk))
+				{
+					inputEnded = true;
+					break;
+				}
+				chunk.error = nullptr;
+				{
+					std::lock_guard lock(m_mutex);
+					chunk.parsed = false;
+					m_dispatchedChunkCount = ++dispatchedChunkCount;
+				}
+				m_chunkDispatched.notify_one();
+			}
+			if (executedChunkCount == dispatchedChunkCount)
+			{
+				break;
+			}
+
+			auto& chunk = m_chunks[executedChunkCount % m_chunks.size()];
+			{
+				std::unique_lock lock(m_mutex);
+				m_chunkParsed.wait(lock, [&chunk] { return chunk.parsed; });
+			}
+			if (chunk.error)
+			{
+				std::rethrow_exception(chunk.error);
+			}
+			for (size_t i = 0; i < chunk.records.size() && queryCount != 0; ++i, --queryCount)
+			{
+				ExecuteRecord(chunk.records[i], chunk.text, output);
+			}
+			++executedChunkCount;
+		}
+		stopThreads();
+	}
+	catch (...)
+	{
+		stopThreads();
+		throw;
+	}
+
+	// The count exceeds the number of lines
+	if (queryCount != 0)
+	{
+		lineAfterEnd(m_line);
+		for (; queryCount != 0; --queryCount)
+		{
+			ParseQuery(m_line, m_query);
+			WriteAnswer(output, ExecuteQuery(m_service, m_query));
+		}
+	}
+}
+
+void ParallelQueryParser::ParseChunks() noexcept
+{
+	for (;;)
+	{
+		Chunk* chunk = nullptr;
+		{
+			std::unique_lock lock(m_mutex);
+			m_chunkDispatched.wait(lock, [this] { return m_finishing || m_takenChunkCount != m_dispatchedChunkCount; });
+			if (m_takenChunkCount == m_dispatchedChunkCount)
+			{
+				return;
+			}
+			chunk = &m_chunks[m_takenChunkCount++ % m_chunks.size()];
+		}
+		try
+		{
+			ParseChunk(chunk->text, chunk->records);
+		}
+		catch (...)
+		{
+			chunk->error = std::current_exception();
+		}
+		{
+			std::lock_guard lock(m_mutex);
+			chunk->parsed = true;
+		}
+		// Only the calling thread waits for parsed chunks
+		m_chunkParsed.notify_one();
+	}
+}
+
+void ParallelQueryParser::ExecuteRecord(const QueryRecord& record, std::string_view text, std::ostream& output)
+{
+	const auto recordText = text.substr(record.textOffset, record.textSize);
+	if (record.parsed)
+	{
+		RecordToQuery(record, recordText, m_query);
+	}
+	else
+	{
+		m_line.assign(recordText.data(), recordText.size());
+		ParseQuery(m_line, m_query);
+	}
+	WriteAnswer(output, ExecuteQuery(m_service, m_query));
+}
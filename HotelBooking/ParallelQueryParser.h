@@ -0,0 +1,73 @@
+#pragma once
+#include "Query.h"
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class BookingService;
+
+/*
+Processes queries in the UserInterface format with a single BookingService, parsing them on several threads.
+The input is split into chunks of about ChunkSize bytes at line ends, and the worker threads parse chunks
+into QueryRecord arrays while the calling thread reads the following chunks and executes the parsed ones
+in input order. Only the number of queries given by the first line is executed, as UserInterface::Run does.
+Lines the record parser doesn't accept (a syntax error or a number with a sign ParseQuery skips)
+are parsed with ParseQuery when they are executed, so the answers and errors are the same as UserInterface::Run gives
+*/
+class ParallelQueryParser final
+{
+public:
+	static constexpr size_t ChunkSize = 1024 * 1024;
+	static constexpr unsigned MaxThreadCount = 256;
+
+	// Throws std::invalid_argument unless threadCount is in [1, MaxThreadCount]
+	ParallelQueryParser(BookingService& service, unsigned threadCount);
+
+	ParallelQueryParser(const ParallelQueryParser&) = delete;
+	ParallelQueryParser& operator=(const ParallelQueryParser&) = delete;
+
+	void Run(std::istream& input, std::ostream& output);
+
+	// Reads queries from the file, mapping it into memory where possible, as UserInterface::Run(FileReader&) does.
+	// Throws std::runtime_error if the file can't be opened
+	void Run(const std::string& path, std::ostream& output);
+
+	unsigned GetThreadCount() const noexcept;
+
+private:
+	struct Chunk
+	{
+		std::string buffer; // Holds the text read from a stream
+		std::string_view text; // Whole lines
+		std::vector<QueryRecord> records;
+		std::exception_ptr error; // Thrown while parsing
+		bool parsed = false; // Guarded by the mutex
+	};
+
+	// Executes queries of the chunks, calling nextChunk(Chunk&) to fill the text of the following chunk
+	// until it returns false. lineAfterEnd(std::string&) gives the line read past the end of the input
+	template <typename NextChunk, typename LineAfterEnd>
+	void RunChunks(unsigned queryCount, NextChunk&& nextChunk, LineAfterEnd&& lineAfterEnd, std::ostream& output);
+	void ParseChunks() noexcept;
+	// Executes the query of the record, parsing its line with ParseQuery if needed
+	void ExecuteRecord(const QueryRecord& record, std::string_view text, std::ostream& output);
+
+	BookingService& m_service;
+	unsigned m_threadCount;
+	std::vector<Chunk> m_chunks;
+	Query m_query; // Reused for executing records
+	std::string m_line;
+
+	std::mutex m_mutex;
+	std::condition_variable m_chunkDispatched;
+	std::condition_variable m_chunkParsed;
+	// Guarded by the mutex
+	std::uint64_t m_dispatchedChunkCount = 0;
+	std::uint64_t m_takenChunkCount = 0; // Chunks taken by the worker threads
+	bool m_finishing = false;
+};
@@ -0,0 +1,322 @@
+#include "ParallelReplay.h"
+#include "FileReader.h"
+#include "UserInterface.h"
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <functional>
+#include <istream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+
+namespace
+{
+constexpr unsigned BookingNumberBits = 48;
+constexpr std::uint64_t BookingNumberMask = (std::uint64_t(1) << BookingNumberBits) - 1;
+
+// Returns the answer to the next query of the partition or throws the error the partition stopped at
+const Answer& TakeAnswer(const std::vector<Answer>& answers, const std::exception_ptr& error, size_t& cursor)
+{
+	if (cursor == answers.size())
+	{
+		assert(error);
+		std::rethrow_exception(error);
+	}
+	return answers[cursor++];
+}
+} // namespace
+
+ParallelReplay::ParallelReplay(const BookingServiceOptions& options, unsigned partitionCount)
+	: m_cancellable(options.cancellable)
+	, m_chunks(ChunkCount)
+{
+	if (partitionCount == 0 || partitionCount > MaxPartitionCount)
+	{
+		throw std::invalid_argument("Partition count is out of range");
+	}
+	if (options.expireIdleHotels)
+	{
+		throw std::invalid_argument("Idle hotels can't expire without the latest booking of all hotels");
+	}
+	m_partitions.reserve(partitionCount);
+	for (unsigned i = 0; i < partitionCount; ++i)
+	{
+		m_partitions.push_back(std::make_unique<Partition>(options));
+	}
+	for (auto& chunk : m_chunks)
+	{
+		chunk.lines.resize(ChunkLineCount);
+		chunk.routes.resize(ChunkLineCount);
+		chunk.work.resize(partitionCount);
+	}
+}
+
+ParallelReplay::~ParallelReplay() = default;
+
+void ParallelReplay::Run(std::istream& input, std::ostream& output)
+{
+	RunQueries([&input, previousLine = static_cast<const std::string*>(nullptr)](std::string& line) mutable {
+		// getline leaves the line as it was once the stream fails, so UserInterface::Run gets the previous line again
+		if (!input.good() && previousLine)
+		{
+			line = *previousLine;
+		}
+		else
+		{
+			std::getline(input, line);
+		}
+		previousLine = &line;
+	},
+		output);
+}
+
+void ParallelReplay::Run(FileReader& input, std::ostream& output)
+{
+	RunQueries([&input](std::string& line) {
+		std::string_view fileLine;
+		input.ReadLine(fileLine);
+		line.assign(fileLine.data(), fileLine.size());
+	},
+		output);
+}
+
+unsigned ParallelReplay::GetPartitionCount() const noexcept
+{
+	return static_cast<unsigned>(m_partitions.size());
+}
+
+template <typename ReadLine>
+void ParallelReplay::RunQueries(ReadLine&& readLine, std::ostream& output)
+{
+	std::string line;
+	readLine(line);
+	const unsigned size = std::stoul(line);
+
+	m_dispatchedChunkCount = 0;
+	m_finishing = false;
+	for (auto& partition : m_partitions)
+	{
+		partition->failed = false;
+	}
+	std::vector<std::thread> threads;
+	// The partition threads execute the chunks dispatched so far and exit
+	auto stopPartitions = [this, &threads]() noexcept {
+		{
+			std::lock_guard lock(m_mutex);
+			m_finishing = true;
+		}
+		m_chunkDispatched.notify_all();
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+	};
+
+	try
+	{
+		threads.reserve(m_partitions.size());
+		for (unsigned i = 0; i < m_partitions.size(); ++i)
+		{
+			threads.emplace_back([this, i] { RunPartition(i); });
+		}
+
+		// A failed read stops the replay after the queries read before it, as in UserInterface::Run
+		std::exception_ptr readError;
+		std::uint64_t chunkCount = 0;
+		for (size_t remainingLineCount = size; remainingLineCount != 0 && !readError; ++chunkCount)
+		{
+			auto& chunk = m_chunks[chunkCount % ChunkCount];
+			if (chunkCount >= ChunkCount)
+			{
+				// Frees the chunk
+				WriteAnswers(chunk, output);
+			}
+			for (auto& work : chunk.work)
+			{
+				work.entries.clear();
+				work.answers.clear();
+				work.error = nullptr;
+			}
+			chunk.lineCount = std::min(remainingLineCount, ChunkLineCount);
+			remainingLineCount -= chunk.lineCount;
+			for (size_t i = 0; i < chunk.lineCount; ++i)
+			{
+				try
+				{
+					readLine(chunk.lines[i]);
+				}
+				catch (...)
+				{
+					readError = std::current_exception();
+					chunk.lineCount = i;
+					break;
+				}
+				Entry entry{ static_cast<std::uint32_t>(i), 0 };
+				const auto route = RouteLine(chunk.lines[i], entry);
+				chunk.routes[i] = route;
+				if (route == Broadcast)
+				{
+					for (auto& work : chunk.work)
+					{
+						work.entries.push_back(entry);
+					}
+				}
+				else
+				{
+					chunk.work[route].entries.push_back(entry);
+				}
+			}
+			{
+				std::lock_guard lock(m_mutex);
+				chunk.pendingPartitions = static_cast<unsigned>(m_partitions.size());
+				++m_dispatchedChunkCount;
+			}
+			m_chunkDispatched.notify_all();
+		}
+		for (auto chunkIndex = chunkCount > ChunkCount ? chunkCount - ChunkCount : 0; chunkIndex < chunkCount; ++chunkIndex)
+		{
+			WriteAnswers(m_chunks[chunkIndex % ChunkCount], output);
+		}
+		if (readError)
+		{
+			std::rethrow_exception(readError);
+		}
+	}
+	catch (...)
+	{
+		stopPartitions();
+		throw;
+	}
+	stopPartitions();
+}
+
+std::uint32_t ParallelReplay::RouteLine(const std::string& line, Entry& entry)
+{
+	std::string_view rest(line);
+	const auto name = NextQueryToken(rest);
+	if (name == "TOTAL" || name == "HOTELS")
+	{
+		return Broadcast;
+	}
+	if (name == "CANCEL")
+	{
+		auto numberText = NextQueryToken(rest);
+		if (!numberText.empty() && numberText.front() == '+')
+		{
+			numberText.remove_prefix(1);
+		}
+		BookingId bookingNumber = 0;
+		std::from_chars(numberText.data(), numberText.data() + numberText.size(), bookingNumber);
+		if (m_cancellable && bookingNumber != 0 && bookingNumber <= m_bookingLocations.size())
+		{
+			const auto location = m_bookingLocations[static_cast<size_t>(bookingNumber - 1)];
+			entry.bookingId = location & BookingNumberMask;
+			return static_cast<std::uint32_t>(location >> BookingNumberBits);
+		}
+		// There is no booking 0 in any partition, and it is a syntax error if the number is malformed
+		return 0;
+	}
+
+	const bool isBooking = name == "BOOK";
+	if (isBooking)
+	{
+		// Time precedes the hotel name
+		NextQueryToken(rest);
+	}
+	// Queries lacking the hotel name fail to parse in any partition
+	const auto hotelName = NextQueryToken(rest);
+	const auto partitionIndex = static_cast<std::uint32_t>(std::hash<std::string_view>()(hotelName) % m_partitions.size());
+	if (isBooking)
+	{
+		const auto bookingNumber = ++m_partitions[partitionIndex]->bookingCount;
+		if (m_cancellable)
+		{
+			m_bookingLocations.push_back((std::uint64_t(partitionIndex) << BookingNumberBits) | bookingNumber);
+		}
+	}
+	return partitionIndex;
+}
+
+void ParallelReplay::RunPartition(unsigned partitionIndex) noexcept
+{
+	auto& partition = *m_partitions[partitionIndex];
+	Query query;
+	for (std::uint64_t chunkIndex = 0;; ++chunkIndex)
+	{
+		{
+			std::unique_lock lock(m_mutex);
+			m_chunkDispatched.wait(lock, [this, chunkIndex] {
+				return m_dispatchedChunkCount > chunkIndex || m_finishing;
+			});
+			if (m_dispatchedChunkCount <= chunkIndex)
+			{
+				return;
+			}
+		}
+		auto& chunk = m_chunks[chunkIndex % ChunkCount];
+		auto& work = chunk.work[partitionIndex];
+		for (auto& entry : work.entries)
+		{
+			if (partition.failed)
+			{
+				break;
+			}
+			try
+			{
+				ParseQuery(chunk.lines[entry.lineIndex], query);
+				if (query.type == QueryType::Cancel)
+				{
+					query.bookingId = entry.bookingId;
+				}
+				work.answers.push_back(ExecuteQuery(partition.service, query));
+			}
+			catch (...)
+			{
+				work.error = std::current_exception();
+				partition.failed = true;
+			}
+		}
+		bool executed;
+		{
+			std::lock_guard lock(m_mutex);
+			executed = --chunk.pendingPartitions == 0;
+		}
+		if (executed)
+		{
+			m_chunkExecuted.notify_one();
+		}
+	}
+}
+
+void ParallelReplay::WriteAnswers(Chunk& chunk, std::ostream& output)
+{
+	{
+		std::unique_lock lock(m_mutex);
+		m_chunkExecuted.wait(lock, [&chunk] { return chunk.pendingPartitions == 0; });
+	}
+	std::vector<size_t> cursors(m_partitions.size());
+	for (size_t i = 0; i < chunk.lineCount; ++i)
+	{
+		const auto route = chunk.routes[i];
+		if (route != Broadcast)
+		{
+			auto& work = chunk.work[route];
+			WriteAnswer(output, TakeAnswer(work.answers, work.error, cursors[route]));
+			continue;
+		}
+		// Statistics of all hotels are sums over partitions
+		Answer sum;
+		for (size_t partitionIndex = 0; partitionIndex < chunk.work.size(); ++partitionIndex)
+		{
+			auto& work = chunk.work[partitionIndex];
+			const auto& answer = TakeAnswer(work.answers, work.error, cursors[partitionIndex]);
+			sum.size = answer.size;
+			for (unsigned valueIndex = 0; valueIndex < answer.size; ++valueIndex)
+			{
+				sum.values[valueIndex] += answer.values[valueIndex];
+			}
+		}
+		WriteAnswer(output, sum);
+	}
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "BookingService.h"
+#include "Query.h"
+#include <condition_variable>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class FileReader;
+
+/*
+Replays queries in the UserInterface format on several threads, writing the same output as UserInterface::Run
+with a single BookingService. Hotels are independent, so they are partitioned over services by the hash
+of their names, and every partition executes its queries in input order on its own thread:
+- BOOK, CLIENTS, ROOMS, ROOMS_RANGE, CLIENTS_AT and ROOMS_AT go to the partition of the hotel
+- TOTAL and HOTELS go to all partitions, and their answers are summed
+- CANCEL goes to the partition of the booking with the number the booking has in that partition
+The calling thread reads lines and writes answers in chunks, so that parsing and execution of a chunk
+overlap with reading the following chunks and writing the preceding ones.
+A query failing to parse or execute stops the replay with its exception once the answers to the preceding
+queries are written, as UserInterface::Run does
+*/
+class ParallelReplay final
+{
+public:
+	static constexpr size_t ChunkLineCount = 4096;
+	static constexpr size_t ChunkCount = 4; // Chunks being read, executed and written at once
+	static constexpr unsigned MaxPartitionCount = 1024;
+
+	// Throws std::invalid_argument unless partitionCount is in [1, MaxPartitionCount] or if idle hotels expire,
+	// since a partition would expire its hotels against its own latest booking
+	ParallelReplay(const BookingServiceOptions& options, unsigned partitionCount);
+	~ParallelReplay();
+
+	ParallelReplay(const ParallelReplay&) = delete;
+	ParallelReplay& operator=(const ParallelReplay&) = delete;
+
+	void Run(std::istream& input, std::ostream& output);
+
+	// Reads queries from the file instead of the input stream
+	void Run(FileReader& input, std::ostream& output);
+
+	unsigned GetPartitionCount() const noexcept;
+
+private:
+	// Route of a line executed by all partitions
+	static constexpr std::uint32_t Broadcast = ~std::uint32_t(0);
+
+	struct Entry
+	{
+		std::uint32_t lineIndex;
+		BookingId bookingId; // The number of the booking in the partition for CANCEL
+	};
+
+	// Queries of a chunk for a partition
+	struct PartitionWork
+	{
+		std::vector<Entry> entries;
+		std::vector<Answer> answers;
+		std::exception_ptr error; // Thrown by entries[answers.size()]
+	};
+
+	struct Chunk
+	{
+		std::vector<std::string> lines;
+		size_t lineCount = 0;
+		std::vector<std::uint32_t> routes; // Partition of every line or Broadcast
+		std::vector<PartitionWork> work; // Per partition
+		unsigned pendingPartitions = 0; // Guarded by the mutex
+	};
+
+	struct Partition
+	{
+		explicit Partition(const BookingServiceOptions& options)
+			: service(options)
+		{
+		}
+
+		BookingService service;
+		BookingId bookingCount = 0; // BOOK queries routed to the partition
+		bool failed = false; // Stops executing queries after an error
+	};
+
+	template <typename ReadLine>
+	void RunQueries(ReadLine&& readLine, std::ostream& output);
+	// Returns the partition of the line, adjusting the entry for CANCEL
+	std::uint32_t RouteLine(const std::string& line, Entry& entry);
+	void RunPartition(unsigned partitionIndex) noexcept;
+	// Waits for the partitions to execute the chunk and writes its answers in line order.
+	// Throws the error of the first failed query of the chunk
+	void WriteAnswers(Chunk& chunk, std::ostream& output);
+
+	std::vector<std::unique_ptr<Partition>> m_partitions;
+	// Partition (in the high 16 bits) and the number there of every booking, if bookings are cancellable
+	std::vector<std::uint64_t> m_bookingLocations;
+	bool m_cancellable;
+
+	std::vector<Chunk> m_chunks;
+	std::mutex m_mutex;
+	std::condition_variable m_chunkDispatched;
+	std::condition_variable m_chunkExecuted;
+	// Guarded by the mutex
+	std::uint64_t m_dispatchedChunkCount = 0;
+	bool m_finishing = false;
+};
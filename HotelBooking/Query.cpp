@@ -0,0 +1,288 @@
+#include "Query.h"
+#include <charconv>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+bool IsSpace(char ch) noexcept
+{
+	return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\v' || ch == '\f' || ch == '\r';
+}
+
+// Reads an optional statistic time span index ending the query. Nothing may follow it
+bool ReadSpanIndex(istream& lineStream, size_t& spanIndex)
+{
+	spanIndex = 0;
+	return (lineStream >> ws).eof() || ((lineStream >> spanIndex) && (lineStream >> ws).eof());
+}
+
+// Accepts the token if it is a whole number in range without a plus sign, otherwise ParseQuery must read it
+template <typename T>
+bool ParseNumber(string_view token, T& value) noexcept
+{
+	const auto end = token.data() + token.size();
+	const auto [numberEnd, error] = from_chars(token.data(), end, value);
+	return error == errc() && numberEnd == end;
+}
+
+// Parses an optional statistic time span index ending the query as ReadSpanIndex does
+bool ParseSpanIndex(string_view rest, std::uint64_t& spanIndex) noexcept
+{
+	const auto token = NextQueryToken(rest);
+	spanIndex = 0;
+	return token.empty() || (ParseNumber(token, spanIndex) && NextQueryToken(rest).empty());
+}
+
+bool ParseHotelName(string_view& rest, string_view& hotelName) noexcept
+{
+	hotelName = NextQueryToken(rest);
+	return !hotelName.empty();
+}
+} // namespace
+
+const char* GetQueryName(QueryType type) noexcept
+{
+	switch (type)
+	{
+	case QueryType::Book:
+		return "BOOK";
+	case QueryType::Clients:
+		return "CLIENTS";
+	case QueryType::Rooms:
+		return "ROOMS";
+	case QueryType::RoomsRange:
+		return "ROOMS_RANGE";
+	case QueryType::Total:
+		return "TOTAL";
+	case QueryType::Hotels:
+		return "HOTELS";
+	case QueryType::ClientsAt:
+		return "CLIENTS_AT";
+	case QueryType::RoomsAt:
+		return "ROOMS_AT";
+	case QueryType::Cancel:
+		return "CANCEL";
+	}
+	return "";
+}
+
+void ParseQuery(const string& line, Query& query)
+{
+	istringstream lineStream(line);
+	string name;
+	lineStream >> name;
+
+	if (name == "BOOK"sv)
+	{
+		query.type = QueryType::Book;
+		if (!(lineStream >> query.time >> query.hotelName >> query.clientId >> query.roomCount))
+		{
+			throw runtime_error("BOOK query syntax error");
+		}
+	}
+	else if (name == "CLIENTS"sv)
+	{
+		query.type = QueryType::Clients;
+		if (!(lineStream >> query.hotelName) || !ReadSpanIndex(lineStream, query.spanIndex))
+		{
+			throw runtime_error("CLIENTS query syntax error");
+		}
+	}
+	else if (name == "ROOMS"sv)
+	{
+		query.type = QueryType::Rooms;
+		if (!(lineStream >> query.hotelName) || !ReadSpanIndex(lineStream, query.spanIndex))
+		{
+			throw runtime_error("ROOMS query syntax error");
+		}
+	}
+	else if (name == "ROOMS_RANGE"sv)
+	{
+		query.type = QueryType::RoomsRange;
+		if (!(lineStream >> query.hotelName >> query.from >> query.to))
+		{
+			throw runtime_error("ROOMS_RANGE query syntax error");
+		}
+	}
+	else if (name == "TOTAL"sv)
+	{
+		query.type = QueryType::Total;
+		if (!ReadSpanIndex(lineStream, query.spanIndex))
+		{
+			throw runtime_error("TOTAL query syntax error");
+		}
+	}
+	else if (name == "HOTELS"sv)
+	{
+		query.type = QueryType::Hotels;
+		if (!(lineStream >> query.clientId))
+		{
+			throw runtime_error("HOTELS query syntax error");
+		}
+	}
+	else if (name == "CLIENTS_AT"sv)
+	{
+		query.type = QueryType::ClientsAt;
+		if (!(lineStream >> query.hotelName >> query.asOf) || !ReadSpanIndex(lineStream, query.spanIndex))
+		{
+			throw runtime_error("CLIENTS_AT query syntax error");
+		}
+	}
+	else if (name == "ROOMS_AT"sv)
+	{
+		query.type = QueryType::RoomsAt;
+		if (!(lineStream >> query.hotelName >> query.asOf) || !ReadSpanIndex(lineStream, query.spanIndex))
+		{
+			throw runtime_error("ROOMS_AT query syntax error");
+		}
+	}
+	else if (name == "CANCEL"sv)
+	{
+		query.type = QueryType::Cancel;
+		if (!(lineStream >> query.bookingId))
+		{
+			throw runtime_error("CANCEL query syntax error");
+		}
+	}
+	else
+	{
+		throw runtime_error("Unknown query " + name);
+	}
+}
+
+bool ParseQueryRecord(string_view line, QueryRecord& record, string_view& hotelName) noexcept
+{
+	const auto name = NextQueryToken(line);
+	if (name == "BOOK"sv)
+	{
+		record.type = QueryType::Book;
+		return ParseNumber(NextQueryToken(line), record.time) && ParseHotelName(line, hotelName)
+			&& ParseNumber(NextQueryToken(line), record.clientId) && ParseNumber(NextQueryToken(line), record.roomCount);
+	}
+	if (name == "CLIENTS"sv || name == "ROOMS"sv)
+	{
+		record.type = name == "CLIENTS"sv ? QueryType::Clients : QueryType::Rooms;
+		return ParseHotelName(line, hotelName) && ParseSpanIndex(line, record.number);
+	}
+	if (name == "ROOMS_RANGE"sv)
+	{
+		record.type = QueryType::RoomsRange;
+		Time to = 0;
+		const bool parsed = ParseHotelName(line, hotelName) && ParseNumber(NextQueryToken(line), record.time)
+			&& ParseNumber(NextQueryToken(line), to);
+		record.number = static_cast<std::uint64_t>(to);
+		return parsed;
+	}
+	if (name == "TOTAL"sv)
+	{
+		record.type = QueryType::Total;
+		return ParseSpanIndex(line, record.number);
+	}
+	if (name == "HOTELS"sv)
+	{
+		record.type = QueryType::Hotels;
+		return ParseNumber(NextQueryToken(line), record.clientId);
+	}
+	if (name == "CLIENTS_AT"sv || name == "ROOMS_AT"sv)
+	{
+		record.type = name == "CLIENTS_AT"sv ? QueryType::ClientsAt : QueryType::RoomsAt;
+		return ParseHotelName(line, hotelName) && ParseNumber(NextQueryToken(line), record.time)
+			&& ParseSpanIndex(line, record.number);
+	}
+	if (name == "CANCEL"sv)
+	{
+		record.type = QueryType::Cancel;
+		return ParseNumber(NextQueryToken(line), record.number);
+	}
+	return false;
+}
+
+void RecordToQuery(const QueryRecord& record, string_view hotelName, Query& query)
+{
+	// ParseQueryRecord sets only the fields of the record type
+	query.type = record.type;
+	query.hotelName.assign(hotelName.data(), hotelName.size());
+	switch (record.type)
+	{
+	case QueryType::Book:
+		query.time = record.time;
+		query.clientId = record.clientId;
+		query.roomCount = record.roomCount;
+		break;
+	case QueryType::Clients:
+	case QueryType::Rooms:
+	case QueryType::Total:
+		query.spanIndex = static_cast<size_t>(record.number);
+		break;
+	case QueryType::RoomsRange:
+		query.from = record.time;
+		query.to = static_cast<Time>(record.number);
+		break;
+	case QueryType::Hotels:
+		query.clientId = record.clientId;
+		break;
+	case QueryType::ClientsAt:
+	case QueryType::RoomsAt:
+		query.asOf = record.time;
+		query.spanIndex = static_cast<size_t>(record.number);
+		break;
+	case QueryType::Cancel:
+		query.bookingId = record.number;
+		break;
+	}
+}
+
+string_view NextQueryToken(string_view& text) noexcept
+{
+	size_t begin = 0;
+	while (begin < text.size() && IsSpace(text[begin]))
+	{
+		++begin;
+	}
+	size_t end = begin;
+	while (end < text.size() && !IsSpace(text[end]))
+	{
+		++end;
+	}
+	const auto token = text.substr(begin, end - begin);
+	text.remove_prefix(end);
+	return token;
+}
+
+void AppendAnswer(string& output, const Answer& answer)
+{
+	if (answer.size == 0)
+	{
+		return;
+	}
+	// Numbers are formatted without allocating
+	char number[24];
+	for (unsigned i = 0; i < answer.size; ++i)
+	{
+		if (i != 0)
+		{
+			output += ' ';
+		}
+		const auto numberEnd = to_chars(number, number + sizeof(number), answer.values[i]).ptr;
+		output.append(number, numberEnd);
+	}
+	output += '\n';
+}
+
+void WriteAnswer(ostream& output, const Answer& answer)
+{
+	if (answer.size == 0)
+	{
+		return;
+	}
+	output << answer.values[0];
+	for (unsigned i = 1; i < answer.size; ++i)
+	{
+		output << " " << answer.values[i];
+	}
+	output << "\n";
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "HotelBookings.h"
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+enum class QueryType
+{
+	Book,
+	Clients,
+	Rooms,
+	RoomsRange,
+	Total,
+	Hotels,
+	ClientsAt,
+	RoomsAt,
+	Cancel,
+};
+
+constexpr unsigned QueryTypeCount = 9;
+
+const char* GetQueryName(QueryType type) noexcept;
+
+struct Query
+{
+	QueryType type = QueryType::Book;
+	std::string hotelName;
+	// BOOK
+	Time time = 0;
+	ClientId clientId = 0; // Also HOTELS
+	RoomCount roomCount = 0;
+	// CLIENTS/ROOMS/TOTAL/CLIENTS_AT/ROOMS_AT: index of the statistic time span
+	size_t spanIndex = 0;
+	// CLIENTS_AT/ROOMS_AT
+	Time asOf = 0;
+	// ROOMS_RANGE
+	Time from = 0;
+	Time to = 0;
+	// CANCEL: the n-th BOOK query makes booking n
+	BookingId bookingId = 0;
+};
+
+// Parses a query line into query (reusing its storage). Throws std::runtime_error on syntax errors
+void ParseQuery(const std::string& line, Query& query);
+
+// Query parsed into a fixed-size record, the hotel name being left in the parsed text
+struct QueryRecord
+{
+	Time time; // BOOK time, ROOMS_RANGE from, CLIENTS_AT and ROOMS_AT time
+	std::uint64_t number; // ROOMS_RANGE to, CANCEL booking number or the statistic time span index
+	ClientId clientId; // BOOK and HOTELS
+	RoomCount roomCount;
+	std::uint32_t textOffset; // The hotel name or the whole line if it is not parsed, within the text of the caller
+	std::uint32_t textSize;
+	QueryType type;
+	bool parsed; // Lines of unusual syntax and syntax errors are left to ParseQuery
+};
+
+// Parses a query line of the usual syntax into the record without allocating. Only the fields of the query type are set.
+// Returns false if ParseQuery must parse the line: it has unusual syntax (such as a plus sign) or a syntax error
+bool ParseQueryRecord(std::string_view line, QueryRecord& record, std::string_view& hotelName) noexcept;
+
+// Fills the query parsed into the record (reusing its storage), reading only the fields of the record type
+void RecordToQuery(const QueryRecord& record, std::string_view hotelName, Query& query);
+
+// Splits off the next token of a query line separated by whitespace, as ParseQuery reads it.
+// Returns an empty token at the end of the text
+std::string_view NextQueryToken(std::string_view& text) noexcept;
+
+// Numbers answering a query: none for BOOK and CANCEL, two (rooms and bookings) for TOTAL, one for the others
+struct Answer
+{
+	unsigned size = 0;
+	std::array<std::uint64_t, 2> values{};
+};
+
+// Writes a line with space separated answer values unless the answer is empty
+void WriteAnswer(std::ostream& output, const Answer& answer);
+
+// Appends the line WriteAnswer writes to the text
+void AppendAnswer(std::string& output, const Answer& answer);
@@ -0,0 +1,488 @@
+#include "QueryServer.h"
+#ifdef __linux__
+#include "UserInterface.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <istream>
+#include <netinet/in.h>
+#include <ostream>
+#include <poll.h>
+#include <stdexcept>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace
+{
+constexpr int MaxEvents = 64;
+constexpr size_t ReadChunkSize = 64 * 1024;
+// Reads of a connection per readiness event, so a client streaming queries doesn't starve the others
+constexpr int MaxReadsPerEvent = 4;
+
+[[noreturn]] void ThrowSystemError(const char* what)
+{
+	throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Builds the address for bind or connect. Returns its length
+socklen_t MakeSocketAddress(const SocketAddress& address, sockaddr_storage& storage)
+{
+	std::memset(&storage, 0, sizeof(storage));
+	if (address.family == SocketAddress::Family::Tcp)
+	{
+		auto& inet = reinterpret_cast<sockaddr_in&>(storage);
+		inet.sin_family = AF_INET;
+		inet.sin_port = htons(address.port);
+		inet.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		return sizeof(inet);
+	}
+	auto& local = reinterpret_cast<sockaddr_un&>(storage);
+	if (address.path.size() >= sizeof(local.sun_path))
+	{
+		throw std::invalid_argument("Unix socket path is too long");
+	}
+	local.sun_family = AF_UNIX;
+	std::memcpy(local.sun_path, address.path.c_str(), address.path.size() + 1);
+	return sizeof(local);
+}
+
+int OpenSocket(const SocketAddress& address)
+{
+	const int fd = ::socket(address.family == SocketAddress::Family::Tcp ? AF_INET : AF_UNIX,
+		SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		ThrowSystemError("socket");
+	}
+	return fd;
+}
+} // namespace
+
+SocketAddress ParseSocketAddress(const std::string& text)
+{
+	SocketAddress address;
+	if (text.rfind("tcp:", 0) == 0)
+	{
+		size_t end = 0;
+		const auto port = std::stoul(text.substr(4), &end);
+		if (end != text.size() - 4 || port > 0xFFFF)
+		{
+			throw std::invalid_argument("Bad TCP port in " + text);
+		}
+		address.port = static_cast<std::uint16_t>(port);
+	}
+	else if (text.rfind("unix:", 0) == 0 && text.size() > 5)
+	{
+		address.family = SocketAddress::Family::Unix;
+		address.path = text.substr(5);
+	}
+	else
+	{
+		throw std::invalid_argument("Socket address must be tcp:PORT or unix:PATH, not " + text);
+	}
+	return address;
+}
+
+QueryServer::FileDescriptor::FileDescriptor(int fd) noexcept
+	: m_fd(fd)
+{
+}
+
+QueryServer::FileDescriptor::FileDescriptor(FileDescriptor&& other) noexcept
+	: m_fd(other.m_fd)
+{
+	other.m_fd = -1;
+}
+
+QueryServer::FileDescriptor& QueryServer::FileDescriptor::operator=(FileDescriptor&& other) noexcept
+{
+	std::swap(m_fd, other.m_fd);
+	return *this;
+}
+
+QueryServer::FileDescriptor::~FileDescriptor()
+{
+	if (m_fd >= 0)
+	{
+		::close(m_fd);
+	}
+}
+
+int QueryServer::FileDescriptor::Get() const noexcept
+{
+	return m_fd;
+}
+
+QueryServer::QueryServer(BookingService& service)
+	: m_service(service)
+	, m_epoll(::epoll_create1(EPOLL_CLOEXEC))
+	, m_wakeup(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+	if (m_epoll.Get() < 0 || m_wakeup.Get() < 0)
+	{
+		ThrowSystemError("epoll setup");
+	}
+	epoll_event event{};
+	event.events = EPOLLIN;
+	event.data.fd = m_wakeup.Get();
+	if (::epoll_ctl(m_epoll.Get(), EPOLL_CTL_ADD, m_wakeup.Get(), &event) != 0)
+	{
+		ThrowSystemError("epoll_ctl");
+	}
+}
+
+QueryServer::~QueryServer()
+{
+	for (auto& path : m_unixSocketPaths)
+	{
+		::unlink(path.c_str());
+	}
+}
+
+std::uint16_t QueryServer::Listen(const SocketAddress& address)
+{
+	sockaddr_storage storage;
+	const auto length = MakeSocketAddress(address, storage);
+	FileDescriptor listener(OpenSocket(address));
+	if (address.family == SocketAddress::Family::Tcp)
+	{
+		const int reuse = 1;
+		::setsockopt(listener.Get(), SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	}
+	else
+	{
+		::unlink(address.path.c_str());
+	}
+	if (::bind(listener.Get(), reinterpret_cast<const sockaddr*>(&storage), length) != 0)
+	{
+		ThrowSystemError("bind");
+	}
+	if (address.family == SocketAddress::Family::Unix)
+	{
+		m_unixSocketPaths.push_back(address.path);
+	}
+	if (::listen(listener.Get(), SOMAXCONN) != 0)
+	{
+		ThrowSystemError("listen");
+	}
+
+	std::uint16_t port = 0;
+	if (address.family == SocketAddress::Family::Tcp)
+	{
+		sockaddr_in bound{};
+		socklen_t boundLength = sizeof(bound);
+		if (::getsockname(listener.Get(), reinterpret_cast<sockaddr*>(&bound), &boundLength) != 0)
+		{
+			ThrowSystemError("getsockname");
+		}
+		port = ntohs(bound.sin_port);
+	}
+
+	epoll_event event{};
+	event.events = EPOLLIN;
+	event.data.fd = listener.Get();
+	if (::epoll_ctl(m_epoll.Get(), EPOLL_CTL_ADD, listener.Get(), &event) != 0)
+	{
+		ThrowSystemError("epoll_ctl");
+	}
+	m_listeners.push_back(std::move(listener));
+	return port;
+}
+
+void QueryServer::Run()
+{
+	epoll_event events[MaxEvents];
+	for (;;)
+	{
+		const int eventCount = ::epoll_wait(m_epoll.Get(), events, MaxEvents, -1);
+		if (eventCount < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			ThrowSystemError("epoll_wait");
+		}
+		for (int i = 0; i < eventCount; ++i)
+		{
+			const int fd = events[i].data.fd;
+			if (fd == m_wakeup.Get())
+			{
+				std::uint64_t value;
+				[[maybe_unused]] auto result = ::read(fd, &value, sizeof(value));
+				m_connections.clear();
+				return;
+			}
+			auto it = m_connections.find(fd);
+			if (it == m_connections.end())
+			{
+				AcceptConnections(fd);
+				continue;
+			}
+			auto& connection = it->second;
+			const auto readyEvents = events[i].events;
+			bool keep = true;
+			if (readyEvents & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			{
+				keep = ReadQueries(connection);
+			}
+			if (keep && (readyEvents & EPOLLOUT))
+			{
+				keep = WriteAnswers(connection);
+			}
+			if (keep && connection.inputClosed && connection.output.empty())
+			{
+				keep = false;
+			}
+			if (keep)
+			{
+				UpdateEvents(connection);
+			}
+			else
+			{
+				CloseConnection(fd);
+			}
+		}
+	}
+}
+
+void QueryServer::Stop() noexcept
+{
+	const std::uint64_t value = 1;
+	[[maybe_unused]] auto result = ::write(m_wakeup.Get(), &value, sizeof(value));
+}
+
+void QueryServer::AcceptConnections(int listener)
+{
+	for (;;)
+	{
+		FileDescriptor socket(::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC));
+		if (socket.Get() < 0)
+		{
+			// EAGAIN ends the backlog. Other errors are specific to the connection being accepted
+			return;
+		}
+		const int fd = socket.Get();
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+		if (::epoll_ctl(m_epoll.Get(), EPOLL_CTL_ADD, fd, &event) != 0)
+		{
+			continue;
+		}
+		auto& connection = m_connections[fd];
+		connection.socket = std::move(socket);
+		connection.events = EPOLLIN;
+	}
+}
+
+bool QueryServer::ReadQueries(Connection& connection)
+{
+	char buffer[ReadChunkSize];
+	// Level-triggered epoll reports the rest of the input on the next wait, once the output is drained
+	for (int readCount = 0; readCount < MaxReadsPerEvent && !connection.inputClosed
+		 && connection.output.size() < MaxPendingOutput;
+		 ++readCount)
+	{
+		const auto size = ::recv(connection.socket.Get(), buffer, sizeof(buffer), 0);
+		if (size > 0)
+		{
+			connection.input.append(buffer, static_cast<size_t>(size));
+			ExecuteQueries(connection);
+			if (connection.input.size() > MaxLineLength)
+			{
+				return false;
+			}
+		}
+		else if (size == 0)
+		{
+			connection.inputClosed = true;
+			if (!connection.input.empty())
+			{
+				// The last query may lack the line end
+				connection.input += '\n';
+				ExecuteQueries(connection);
+			}
+		}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			break;
+		}
+		else if (errno != EINTR)
+		{
+			return false;
+		}
+	}
+	return WriteAnswers(connection);
+}
+
+void QueryServer::ExecuteQueries(Connection& connection)
+{
+	const std::string_view input = connection.input;
+	size_t lineBegin = 0;
+	for (size_t lineEnd; (lineEnd = input.find('\n', lineBegin)) != std::string_view::npos; lineBegin = lineEnd + 1)
+	{
+		const auto line = input.substr(lineBegin, lineEnd - lineBegin);
+		try
+		{
+			std::string_view hotelName;
+			if (ParseQueryRecord(line, m_record, hotelName))
+			{
+				RecordToQuery(m_record, hotelName, m_query);
+			}
+			else
+			{
+				// ParseQuery reports the syntax error or parses a number with a sign the record parser skips
+				m_line.assign(line);
+				ParseQuery(m_line, m_query);
+			}
+			AppendAnswer(connection.output, ExecuteQuery(m_service, m_query));
+		}
+		catch (const std::exception& e)
+		{
+			connection.output += "ERROR ";
+			connection.output += e.what();
+			connection.output += '\n';
+		}
+	}
+	connection.input.erase(0, lineBegin);
+}
+
+bool QueryServer::WriteAnswers(Connection& connection)
+{
+	size_t sentSize = 0;
+	while (sentSize < connection.output.size())
+	{
+		const auto size = ::send(connection.socket.Get(), connection.output.data() + sentSize,
+			connection.output.size() - sentSize, MSG_NOSIGNAL);
+		if (size >= 0)
+		{
+			sentSize += static_cast<size_t>(size);
+		}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			break;
+		}
+		else if (errno != EINTR)
+		{
+			return false;
+		}
+	}
+	connection.output.erase(0, sentSize);
+	return true;
+}
+
+void QueryServer::UpdateEvents(Connection& connection)
+{
+	std::uint32_t events = 0;
+	if (!connection.inputClosed && connection.output.size() < MaxPendingOutput)
+	{
+		events |= EPOLLIN;
+	}
+	if (!connection.output.empty())
+	{
+		events |= EPOLLOUT;
+	}
+	if (events == connection.events)
+	{
+		return;
+	}
+	epoll_event event{};
+	event.events = events;
+	event.data.fd = connection.socket.Get();
+	if (::epoll_ctl(m_epoll.Get(), EPOLL_CTL_MOD, connection.socket.Get(), &event) != 0)
+	{
+		ThrowSystemError("epoll_ctl");
+	}
+	connection.events = events;
+}
+
+void QueryServer::CloseConnection(int fd) noexcept
+{
+	// Closing the socket removes it from epoll
+	m_connections.erase(fd);
+}
+
+void RunQueryClient(const SocketAddress& address, std::istream& input, std::ostream& output)
+{
+	sockaddr_storage storage;
+	const auto length = MakeSocketAddress(address, storage);
+	const int fd = OpenSocket(address);
+	struct Closer
+	{
+		int fd;
+		~Closer() { ::close(fd); }
+	} closer{ fd };
+	if (::connect(fd, reinterpret_cast<const sockaddr*>(&storage), length) != 0 && errno != EINPROGRESS)
+	{
+		ThrowSystemError("connect");
+	}
+
+	std::string line;
+	std::getline(input, line);
+	auto remainingQueries = std::stoul(line);
+	std::string request;
+	size_t sentSize = 0;
+	bool requestClosed = false;
+	char buffer[ReadChunkSize];
+	// Queries are sent while answers are received, so neither side blocks on a full socket buffer
+	for (;;)
+	{
+		if (sentSize == request.size() && !requestClosed)
+		{
+			request.clear();
+			sentSize = 0;
+			while (remainingQueries != 0 && request.size() < ReadChunkSize && std::getline(input, line))
+			{
+				request += line;
+				request += '\n';
+				--remainingQueries;
+			}
+			if (request.empty())
+			{
+				::shutdown(fd, SHUT_WR);
+				requestClosed = true;
+			}
+		}
+
+		pollfd pollFd{ fd, static_cast<short>(POLLIN | (requestClosed ? 0 : POLLOUT)), 0 };
+		if (::poll(&pollFd, 1, -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			ThrowSystemError("poll");
+		}
+		if (pollFd.revents & POLLOUT)
+		{
+			const auto size = ::send(fd, request.data() + sentSize, request.size() - sentSize, MSG_NOSIGNAL);
+			if (size < 0 && errno != EAGAIN && errno != EINTR)
+			{
+				ThrowSystemError("send");
+			}
+			sentSize += size > 0 ? static_cast<size_t>(size) : 0;
+		}
+		if (pollFd.revents & (POLLIN | POLLHUP | POLLERR))
+		{
+			const auto size = ::recv(fd, buffer, sizeof(buffer), 0);
+			if (size == 0)
+			{
+				return;
+			}
+			if (size < 0 && errno != EAGAIN && errno != EINTR)
+			{
+				ThrowSystemError("recv");
+			}
+			output.write(buffer, size > 0 ? size : 0);
+		}
+	}
+}
+#endif
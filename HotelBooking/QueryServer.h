@@ -0,0 +1,110 @@
+#pragma once
+#ifdef __linux__
+#include "Query.h"
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class BookingService;
+
+// Address of a stream socket: "tcp:PORT" (loopback interface) or "unix:PATH"
+struct SocketAddress
+{
+	enum class Family
+	{
+		Tcp,
+		Unix,
+	};
+
+	Family family = Family::Tcp;
+	std::uint16_t port = 0; // Tcp. 0 makes Listen bind an ephemeral port
+	std::string path; // Unix
+};
+
+// Throws std::invalid_argument if the address is malformed
+SocketAddress ParseSocketAddress(const std::string& text);
+
+/*
+Serves the query protocol of UserInterface (without the leading query count) to many concurrent connections.
+Connections are multiplexed by epoll over non-blocking sockets in a single thread, so the service needs no locking.
+A client may send many queries without waiting for answers, which are written in query order.
+A query failing to parse or execute is answered with an "ERROR <message>" line and doesn't close the connection.
+Once the client shuts down its side, the connection is closed after the pending answers are sent
+*/
+class QueryServer final
+{
+public:
+	// Throws std::system_error if epoll can't be set up
+	explicit QueryServer(BookingService& service);
+	~QueryServer();
+
+	QueryServer(const QueryServer&) = delete;
+	QueryServer& operator=(const QueryServer&) = delete;
+
+	// Accepts connections at the address once Run is called. A Unix socket file left at the path is replaced.
+	// Returns the bound port for a TCP address. Throws std::system_error on failure
+	std::uint16_t Listen(const SocketAddress& address);
+
+	// Serves connections until Stop is called. Throws std::system_error if epoll fails
+	void Run();
+
+	// Makes Run return. Is async-signal-safe and may be called from any thread
+	void Stop() noexcept;
+
+	// A connection sending a line longer than this is closed
+	static constexpr size_t MaxLineLength = 64 * 1024;
+	// A connection is not read while this many bytes of its answers are not sent yet
+	static constexpr size_t MaxPendingOutput = 1024 * 1024;
+
+private:
+	// Closes the owned descriptor
+	class FileDescriptor final
+	{
+	public:
+		explicit FileDescriptor(int fd = -1) noexcept;
+		FileDescriptor(FileDescriptor&& other) noexcept;
+		FileDescriptor& operator=(FileDescriptor&& other) noexcept;
+		~FileDescriptor();
+
+		int Get() const noexcept;
+
+	private:
+		int m_fd;
+	};
+
+	struct Connection
+	{
+		FileDescriptor socket;
+		std::string input; // Received bytes not forming a complete line yet
+		std::string output; // Answers not sent yet
+		bool inputClosed = false;
+		std::uint32_t events = 0; // Events the socket is registered for
+	};
+
+	void AcceptConnections(int listener);
+	// Returns false if the connection must be closed
+	bool ReadQueries(Connection& connection);
+	void ExecuteQueries(Connection& connection);
+	bool WriteAnswers(Connection& connection);
+	// Registers the connection for reading unless its output is backed up, and for writing while it has output
+	void UpdateEvents(Connection& connection);
+	void CloseConnection(int fd) noexcept;
+
+	BookingService& m_service;
+	FileDescriptor m_epoll;
+	FileDescriptor m_wakeup; // eventfd signalled by Stop
+	std::vector<FileDescriptor> m_listeners;
+	std::vector<std::string> m_unixSocketPaths; // Unlinked on destruction
+	std::unordered_map<int, Connection> m_connections;
+	// Reused for executing queries
+	QueryRecord m_record{};
+	Query m_query;
+	std::string m_line;
+};
+
+// Sends queries read from input in the UserInterface format to the server and writes the answers to output
+// as UserInterface would. Throws std::system_error on connection failures
+void RunQueryClient(const SocketAddress& address, std::istream& input, std::ostream& output);
+#endif
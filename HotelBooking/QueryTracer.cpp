@@ -0,0 +1,43 @@
+#include "QueryTracer.h"
+#include <iomanip>
+#include <ostream>
+
+using namespace std::chrono;
+
+void QueryTracer::Record(QueryType type, Phase phase, steady_clock::duration duration) noexcept
+{
+	m_latencies[static_cast<unsigned>(type)][static_cast<unsigned>(phase)].Record(duration_cast<nanoseconds>(duration).count());
+}
+
+const LatencyHistogram& QueryTracer::GetLatencies(QueryType type, Phase phase) const noexcept
+{
+	return m_latencies[static_cast<unsigned>(type)][static_cast<unsigned>(phase)];
+}
+
+void QueryTracer::PrintSummary(std::ostream& output) const
+{
+	const char* phaseNames[PhaseCount] = { "parse", "service", "output" };
+
+	output << std::left << std::setw(12) << "query" << std::setw(8) << "phase" << std::right
+		   << std::setw(10) << "count" << std::setw(12) << "total_us" << std::setw(10) << "p50_ns"
+		   << std::setw(10) << "p99_ns" << std::setw(10) << "p999_ns" << std::setw(12) << "max_ns" << "\n";
+	for (unsigned type = 0; type < QueryTypeCount; ++type)
+	{
+		for (unsigned phase = 0; phase < PhaseCount; ++phase)
+		{
+			auto& latencies = m_latencies[type][phase];
+			if (latencies.GetCount() == 0)
+			{
+				continue;
+			}
+			output << std::left << std::setw(12) << GetQueryName(static_cast<QueryType>(type))
+				   << std::setw(8) << phaseNames[phase] << std::right
+				   << std::setw(10) << latencies.GetCount()
+				   << std::setw(12) << latencies.GetSum() / 1'000
+				   << std::setw(10) << latencies.GetPercentile(50)
+				   << std::setw(10) << latencies.GetPercentile(99)
+				   << std::setw(10) << latencies.GetPercentile(99.9)
+				   << std::setw(12) << latencies.GetMax() << "\n";
+		}
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "LatencyHistogram.h"
+#include "Query.h"
+#include <array>
+#include <chrono>
+#include <iosfwd>
+
+// Collects per query type latencies of the query processing phases
+class QueryTracer final
+{
+public:
+	enum class Phase
+	{
+		Parse, // Reading the query line and parsing it
+		Service, // Calling BookingService
+		Output, // Writing the answer
+	};
+	static constexpr unsigned PhaseCount = 3;
+
+	void Record(QueryType type, Phase phase, std::chrono::steady_clock::duration duration) noexcept;
+
+	const LatencyHistogram& GetLatencies(QueryType type, Phase phase) const noexcept;
+
+	void PrintSummary(std::ostream& output) const;
+
+private:
+	std::array<std::array<LatencyHistogram, PhaseCount>, QueryTypeCount> m_latencies;
+};
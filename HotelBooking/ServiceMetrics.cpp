@@ -0,0 +1,57 @@
+#include "ServiceMetrics.h"
+#include <ostream>
+
+void ServiceMetricCounters::CopyTo([[maybe_unused]] ServiceMetrics& metrics) const noexcept
+{
+#ifdef COLLECT_SERVICE_METRICS
+	auto load = [](const Counter& counter) {
+		return counter.load(std::memory_order_relaxed);
+	};
+	metrics.bookCount = load(m_bookCount);
+	metrics.cancelCount = load(m_cancelCount);
+	metrics.clientsQueryCount = load(m_clientsQueryCount);
+	metrics.roomsQueryCount = load(m_roomsQueryCount);
+	metrics.roomsRangeQueryCount = load(m_roomsRangeQueryCount);
+	metrics.evictedBookingCount = load(m_evictedBookingCount);
+	metrics.maxEvictedPerBook = load(m_maxEvictedPerBook);
+	for (std::size_t i = 0; i < m_evictedPerBook.size(); ++i)
+	{
+		metrics.evictedPerBook[i] = load(m_evictedPerBook[i]);
+	}
+	metrics.maxWindowSize = load(m_maxWindowSize);
+	metrics.droppedHotelCount = load(m_droppedHotelCount);
+	metrics.hotelMapRehashCount = load(m_hotelMapRehashCount);
+	metrics.clientMapRehashCount = load(m_clientMapRehashCount);
+#endif
+}
+
+std::ostream& operator<<(std::ostream& output, const ServiceMetrics& metrics)
+{
+	output << "book: " << metrics.bookCount << "\n"
+		   << "cancel: " << metrics.cancelCount << "\n"
+		   << "clients queries: " << metrics.clientsQueryCount << "\n"
+		   << "rooms queries: " << metrics.roomsQueryCount << "\n"
+		   << "rooms range queries: " << metrics.roomsRangeQueryCount << "\n"
+		   << "evicted bookings: " << metrics.evictedBookingCount << "\n"
+		   << "max evicted per book: " << metrics.maxEvictedPerBook << "\n"
+		   << "evicted per book:";
+	for (std::size_t i = 0; i < metrics.evictedPerBook.size(); ++i)
+	{
+		if (metrics.evictedPerBook[i] != 0)
+		{
+			const auto lowerBound = i == 0 ? 0 : std::uint64_t(1) << (i - 1);
+			output << " " << lowerBound << (i + 1 == metrics.evictedPerBook.size() ? "+" : "") << ":" << metrics.evictedPerBook[i];
+		}
+	}
+	return output << "\n"
+				  << "max window size: " << metrics.maxWindowSize << "\n"
+				  << "hotels: " << metrics.hotelCount << ", dropped: " << metrics.droppedHotelCount << "\n"
+				  << "hotel map buckets: " << metrics.hotelMapBucketCount
+				  << ", load factor: " << metrics.hotelMapLoadFactor
+				  << ", rehashes: " << metrics.hotelMapRehashCount << "\n"
+				  << "client map entries: " << metrics.clientMapEntryCount
+				  << ", buckets: " << metrics.clientMapBucketCount
+				  << ", load factor: " << metrics.clientMapLoadFactor
+				  << ", rehashes: " << metrics.clientMapRehashCount << "\n"
+				  << "shrinks: " << metrics.shrinkCount << ", reclaimed bytes: " << metrics.reclaimedBytes << "\n";
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+/*
+Determines whether BookingService collects hot path metrics.
+Every update is a relaxed atomic operation, so the counters may be read by a monitoring thread
+while the service is running. Comment this macro to compile the counters out completely.
+*/
+#define COLLECT_SERVICE_METRICS
+
+// Snapshot of BookingService metrics
+struct ServiceMetrics
+{
+	// Number of bookings evicted by a single Book grouped by powers of two: 0, 1, 2-3, 4-7, ..., 32768+
+	static constexpr std::size_t EvictionBucketCount = 17;
+
+	std::uint64_t bookCount = 0;
+	std::uint64_t cancelCount = 0;
+	std::uint64_t clientsQueryCount = 0;
+	std::uint64_t roomsQueryCount = 0;
+	std::uint64_t roomsRangeQueryCount = 0;
+
+	std::uint64_t evictedBookingCount = 0;
+	std::uint64_t maxEvictedPerBook = 0;
+	std::array<std::uint64_t, EvictionBucketCount> evictedPerBook{};
+	// The largest number of bookings ever held within the time span of a single hotel
+	std::uint64_t maxWindowSize = 0;
+	// Hotels dropped from the hotel map by compaction
+	std::uint64_t droppedHotelCount = 0;
+
+	std::size_t hotelCount = 0;
+	std::size_t hotelMapBucketCount = 0;
+	float hotelMapLoadFactor = 0;
+	std::uint64_t hotelMapRehashCount = 0;
+
+	// Client maps of all hotels taken together
+	std::size_t clientMapEntryCount = 0;
+	std::size_t clientMapBucketCount = 0;
+	float clientMapLoadFactor = 0;
+	std::uint64_t clientMapRehashCount = 0;
+
+	// Containers shrunk after the number of their elements dropped, and the heap memory returned by shrinking
+	std::uint64_t shrinkCount = 0;
+	std::uint64_t reclaimedBytes = 0;
+};
+
+std::ostream& operator<<(std::ostream& output, const ServiceMetrics& metrics);
+
+// Hot path counters of BookingService. The methods do nothing unless COLLECT_SERVICE_METRICS is defined
+class ServiceMetricCounters final
+{
+public:
+	void CountBook(std::size_t evictedBookings, std::size_t windowSize, bool hotelMapRehashed, bool clientMapRehashed) noexcept;
+	void CountCancel() noexcept;
+	void CountClientsQuery() noexcept;
+	void CountRoomsQuery() noexcept;
+	void CountRoomsRangeQuery() noexcept;
+	void CountDroppedHotels(std::size_t hotelCount) noexcept;
+
+	void CopyTo(ServiceMetrics& metrics) const noexcept;
+
+#ifdef COLLECT_SERVICE_METRICS
+private:
+	using Counter = std::atomic<std::uint64_t>;
+
+	static void Increment(Counter& counter, std::uint64_t value = 1) noexcept
+	{
+		counter.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	// Counters are updated by a single writer, so load and store are enough
+	static void UpdateMax(Counter& counter, std::uint64_t value) noexcept
+	{
+		if (value > counter.load(std::memory_order_relaxed))
+		{
+			counter.store(value, std::memory_order_relaxed);
+		}
+	}
+
+	static std::size_t GetEvictionBucket(std::size_t evictedBookings) noexcept
+	{
+		std::size_t bucket = 0;
+		for (; evictedBookings != 0 && bucket + 1 < ServiceMetrics::EvictionBucketCount; evictedBookings >>= 1)
+		{
+			++bucket;
+		}
+		return bucket;
+	}
+
+	Counter m_bookCount{ 0 };
+	Counter m_cancelCount{ 0 };
+	Counter m_clientsQueryCount{ 0 };
+	Counter m_roomsQueryCount{ 0 };
+	Counter m_roomsRangeQueryCount{ 0 };
+	Counter m_evictedBookingCount{ 0 };
+	Counter m_maxEvictedPerBook{ 0 };
+	std::array<Counter, ServiceMetrics::EvictionBucketCount> m_evictedPerBook{};
+	Counter m_maxWindowSize{ 0 };
+	Counter m_droppedHotelCount{ 0 };
+	Counter m_hotelMapRehashCount{ 0 };
+	Counter m_clientMapRehashCount{ 0 };
+#endif
+};
+
+inline void ServiceMetricCounters::CountBook([[maybe_unused]] std::size_t evictedBookings, [[maybe_unused]] std::size_t windowSize,
+	[[maybe_unused]] bool hotelMapRehashed, [[maybe_unused]] bool clientMapRehashed) noexcept
+{
+#ifdef COLLECT_SERVICE_METRICS
+	Increment(m_bookCount);
+	Increment(m_evictedBookingCount, evictedBookings);
+	Increment(m_evictedPerBook[GetEvictionBucket(evictedBookings)]);
+	UpdateMax(m_maxEvictedPerBook, evictedBookings);
+	UpdateMax(m_maxWindowSize, windowSize);
+	if (hotelMapRehashed)
+	{
+		Increment(m_hotelMapRehashCount);
+	}
+	if (clientMapRehashed)
+	{
+		Increment(m_clientMapRehashCount);
+	}
+#endif
+}
+
+inline void ServiceMetricCounters::CountCancel() noexcept
+{
+#ifdef COLLECT_SERVICE_METRICS
+	Increment(m_cancelCount);
+#endif
+}
+
+inline void ServiceMetricCounters::CountClientsQuery() noexcept
+{
+#ifdef COLLECT_SERVICE_METRICS
+	Increment(m_clientsQueryCount);
+#endif
+}
+
+inline void ServiceMetricCounters::CountRoomsQuery() noexcept
+{
+#ifdef COLLECT_SERVICE_METRICS
+	Increment(m_roomsQueryCount);
+#endif
+}
+
+inline void ServiceMetricCounters::CountRoomsRangeQuery() noexcept
+{
+#ifdef COLLECT_SERVICE_METRICS
+	Increment(m_roomsRangeQueryCount);
+#endif
+}
+
+inline void ServiceMetricCounters::CountDroppedHotels([[maybe_unused]] std::size_t hotelCount) noexcept
+{
+#ifdef COLLECT_SERVICE_METRICS
+	Increment(m_droppedHotelCount, hotelCount);
+#endif
+}
@@ -0,0 +1,364 @@
+#include "ShardedBookingEngine.h"
+#include "Backoff.h"
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+namespace
+{
+// Requests of a producer executed in a row, so a busy producer doesn't delay the others
+constexpr size_t MaxBatchSize = 64;
+} // namespace
+
+bool PinCurrentThread(unsigned core) noexcept
+{
+	const auto coreCount = std::max(std::thread::hardware_concurrency(), 1u);
+	core %= coreCount;
+#ifdef __linux__
+	if (core >= CPU_SETSIZE)
+	{
+		return false;
+	}
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(core, &cpus);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#elif defined(_WIN32)
+	if (core >= sizeof(DWORD_PTR) * 8)
+	{
+		return false;
+	}
+	return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core) != 0;
+#else
+	return false;
+#endif
+}
+
+ShardedBookingEngine::Producer::Producer(ShardedBookingEngine& engine, unsigned index)
+	: m_engine(engine)
+	, m_index(index)
+{
+}
+
+void ShardedBookingEngine::Producer::Book(Time time, const std::string& hotelName, ClientId clientId, RoomCount roomCount)
+{
+	if (auto hotHotel = m_engine.FindHotHotel(hotelName))
+	{
+		if (hotHotel->combining)
+		{
+			hotHotel->combining->Book(m_index, time, clientId, roomCount);
+		}
+		else
+		{
+			hotHotel->partialWindows->Book(m_index, time, clientId, roomCount);
+		}
+		return;
+	}
+	auto& channel = GetChannel(m_engine.GetShardIndex(hotelName));
+	auto& request = GetPushSlot(channel);
+	request.type = RequestType::Book;
+	request.time = time;
+	request.clientId = clientId;
+	request.roomCount = roomCount;
+	// Assigning keeps the capacity of the slot's string, so it doesn't allocate once the queue has wrapped around
+	request.hotelName.assign(hotelName);
+	channel.requests.Push();
+}
+
+size_t ShardedBookingEngine::Producer::GetDistinctClientCount(const std::string& hotelName, size_t spanIndex)
+{
+	if (auto hotHotel = m_engine.FindHotHotel(hotelName))
+	{
+		return hotHotel->combining ? hotHotel->combining->GetDistinctClientCount(spanIndex)
+								   : hotHotel->partialWindows->GetDistinctClientCount(spanIndex);
+	}
+	return static_cast<size_t>(Query(RequestType::Clients, hotelName, spanIndex));
+}
+
+RoomCount ShardedBookingEngine::Producer::GetBookedRoomCount(const std::string& hotelName, size_t spanIndex)
+{
+	if (auto hotHotel = m_engine.FindHotHotel(hotelName))
+	{
+		return hotHotel->combining ? hotHotel->combining->GetBookedRoomCount(spanIndex)
+								   : hotHotel->partialWindows->GetBookedRoomCount(spanIndex);
+	}
+	return static_cast<RoomCount>(Query(RequestType::Rooms, hotelName, spanIndex));
+}
+
+void ShardedBookingEngine::Producer::Flush()
+{
+	const auto shardCount = m_engine.GetShardCount();
+	const auto firstSequence = m_querySequence + 1;
+	for (unsigned shardIndex = 0; shardIndex < shardCount; ++shardIndex)
+	{
+		auto& channel = GetChannel(shardIndex);
+		auto& request = GetPushSlot(channel);
+		request.type = RequestType::Flush;
+		request.querySequence = ++m_querySequence;
+		channel.requests.Push();
+	}
+	// Every shard is waited for before an error is thrown
+	std::exception_ptr error;
+	for (unsigned shardIndex = 0; shardIndex < shardCount; ++shardIndex)
+	{
+		try
+		{
+			WaitAnswer(GetChannel(shardIndex), firstSequence + shardIndex);
+		}
+		catch (...)
+		{
+			if (!error)
+			{
+				error = std::current_exception();
+			}
+		}
+	}
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
+
+ShardedBookingEngine::Channel& ShardedBookingEngine::Producer::GetChannel(size_t shardIndex) const noexcept
+{
+	return *m_engine.m_channels[m_index * m_engine.m_shards.size() + shardIndex];
+}
+
+ShardedBookingEngine::Request& ShardedBookingEngine::Producer::GetPushSlot(Channel& channel) const noexcept
+{
+	Backoff backoff;
+	for (;;)
+	{
+		if (auto request = channel.requests.GetPushSlot())
+		{
+			return *request;
+		}
+		backoff.Pause();
+	}
+}
+
+std::uint64_t ShardedBookingEngine::Producer::Query(RequestType type, const std::string& hotelName, size_t spanIndex)
+{
+	auto& channel = GetChannel(m_engine.GetShardIndex(hotelName));
+	auto& request = GetPushSlot(channel);
+	request.type = type;
+	request.spanIndex = spanIndex;
+	request.querySequence = ++m_querySequence;
+	request.hotelName.assign(hotelName);
+	channel.requests.Push();
+	WaitAnswer(channel, m_querySequence);
+	return channel.answer;
+}
+
+void ShardedBookingEngine::Producer::WaitAnswer(Channel& channel, std::uint64_t querySequence) const
+{
+	Backoff backoff;
+	while (channel.answeredQuery.load(std::memory_order_acquire) != querySequence)
+	{
+		backoff.Pause();
+	}
+	// The shard has executed every request of the channel, so it doesn't touch the errors now
+	if (channel.bookingError)
+	{
+		std::rethrow_exception(std::exchange(channel.bookingError, nullptr));
+	}
+	if (channel.queryError)
+	{
+		std::rethrow_exception(channel.queryError);
+	}
+}
+
+ShardedBookingEngine::ShardedBookingEngine(const BookingServiceOptions& serviceOptions, const ShardedEngineOptions& options)
+	: m_options(options)
+{
+	if (options.shardCount == 0 || options.producerCount == 0)
+	{
+		throw std::invalid_argument("Shard and producer counts must be positive");
+	}
+	if (serviceOptions.expireIdleHotels)
+	{
+		throw std::invalid_argument("Idle hotels can't expire without the latest booking of all hotels");
+	}
+	m_shards.reserve(options.shardCount);
+	for (unsigned i = 0; i < options.shardCount; ++i)
+	{
+		m_shards.push_back(std::make_unique<Shard>(serviceOptions));
+	}
+	m_channels.reserve(size_t(options.producerCount) * options.shardCount);
+	for (size_t i = 0; i < size_t(options.producerCount) * options.shardCount; ++i)
+	{
+		m_channels.push_back(std::make_unique<Channel>(options.queueCapacity));
+	}
+	BookingHistoryOptions hotHotelOptions;
+	hotHotelOptions.maxLateness = serviceOptions.maxLateness;
+	hotHotelOptions.rejectTooLate = serviceOptions.rejectTooLate;
+	for (auto& hotelName : options.hotHotels)
+	{
+		auto& hotHotel = m_hotHotels[hotelName];
+		if (options.combineHotHotels)
+		{
+			hotHotel.combining = std::make_unique<CombiningHotelBookings>(
+				serviceOptions.statisticTimeSpans, options.producerCount, hotHotelOptions);
+		}
+		else
+		{
+			hotHotel.partialWindows = std::make_unique<HotHotelBookings>(
+				serviceOptions.statisticTimeSpans, options.producerCount, hotHotelOptions);
+		}
+	}
+	m_producers.reserve(options.producerCount);
+	for (unsigned i = 0; i < options.producerCount; ++i)
+	{
+		m_producers.push_back(std::unique_ptr<Producer>(new Producer(*this, i)));
+	}
+	try
+	{
+		for (unsigned i = 0; i < options.shardCount; ++i)
+		{
+			m_shards[i]->thread = std::thread([this, i] {
+				RunShard(i);
+			});
+		}
+	}
+	catch (...)
+	{
+		StopShards();
+		throw;
+	}
+}
+
+ShardedBookingEngine::~ShardedBookingEngine()
+{
+	StopShards();
+}
+
+void ShardedBookingEngine::StopShards() noexcept
+{
+	m_stopping.store(true, std::memory_order_release);
+	for (auto& shard : m_shards)
+	{
+		if (shard->thread.joinable())
+		{
+			shard->thread.join();
+		}
+	}
+}
+
+ShardedBookingEngine::Producer& ShardedBookingEngine::GetProducer(unsigned index)
+{
+	return *m_producers.at(index);
+}
+
+unsigned ShardedBookingEngine::GetShardCount() const noexcept
+{
+	return static_cast<unsigned>(m_shards.size());
+}
+
+size_t ShardedBookingEngine::GetShardIndex(const std::string& hotelName) const noexcept
+{
+	return std::hash<std::string>()(hotelName) % m_shards.size();
+}
+
+ShardedBookingEngine::HotHotel* ShardedBookingEngine::FindHotHotel(const std::string& hotelName) noexcept
+{
+	if (m_hotHotels.empty())
+	{
+		return nullptr;
+	}
+	const auto it = m_hotHotels.find(hotelName);
+	return it != m_hotHotels.end() ? &it->second : nullptr;
+}
+
+void ShardedBookingEngine::RunShard(unsigned shardIndex) noexcept
+{
+	if (m_options.pinShardThreads)
+	{
+		PinCurrentThread(shardIndex);
+	}
+	auto& shard = *m_shards[shardIndex];
+	Backoff backoff;
+	for (;;)
+	{
+		// Requests sent before the destruction are seen by the pass after the stop flag
+		const bool stopping = m_stopping.load(std::memory_order_acquire);
+		bool idle = true;
+		for (unsigned producerIndex = 0; producerIndex < m_options.producerCount; ++producerIndex)
+		{
+			auto& channel = *m_channels[producerIndex * m_shards.size() + shardIndex];
+			for (size_t i = 0; i < MaxBatchSize; ++i)
+			{
+				auto request = channel.requests.GetFront();
+				if (!request)
+				{
+					break;
+				}
+				Execute(shard, channel, *request);
+				channel.requests.Pop();
+				idle = false;
+			}
+		}
+		if (!idle)
+		{
+			backoff.Reset();
+		}
+		else if (stopping)
+		{
+			return;
+		}
+		else
+		{
+			backoff.Pause();
+		}
+	}
+}
+
+void ShardedBookingEngine::Execute(Shard& shard, Channel& channel, Request& request) noexcept
+{
+	if (request.type == RequestType::Book)
+	{
+		try
+		{
+			shard.service.Book(request.time, request.hotelName, request.clientId, request.roomCount);
+		}
+		catch (...)
+		{
+			if (!channel.bookingError)
+			{
+				channel.bookingError = std::current_exception();
+			}
+		}
+		return;
+	}
+	channel.answer = 0;
+	channel.queryError = nullptr;
+	try
+	{
+		if (request.type == RequestType::Clients)
+		{
+			channel.answer = shard.service.GetDistinctClientCount(request.hotelName, request.spanIndex);
+		}
+		else if (request.type == RequestType::Rooms)
+		{
+			channel.answer = shard.service.GetBookedRoomCount(request.hotelName, request.spanIndex);
+		}
+	}
+	catch (...)
+	{
+		channel.queryError = std::current_exception();
+	}
+	channel.answeredQuery.store(request.querySequence, std::memory_order_release);
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include "BookingService.h"
+#include "CombiningHotelBookings.h"
+#include "HotHotelBookings.h"
+#include "SpscQueue.h"
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct ShardedEngineOptions
+{
+	// Every shard owns a disjoint set of hotels, a BookingService partition and a thread
+	unsigned shardCount = 1;
+	// Threads sending requests. Every producer has a request queue to every shard
+	unsigned producerCount = 1;
+	// Requests a producer may send to a shard before it has to wait for the shard
+	size_t queueCapacity = 4096;
+	// Pin the thread of shard i to core i (modulo the number of cores)
+	bool pinShardThreads = false;
+	// Hotels booked by many producers at once. Each producer books its own partial window
+	// of such a hotel on its thread, and queries merge the partial windows (see HotHotelBookings)
+	std::vector<std::string> hotHotels;
+	// Book hot hotels through flat combining (see CombiningHotelBookings) instead of partial windows
+	bool combineHotHotels = false;
+};
+
+/*
+Shared-nothing engine: hotels are distributed over shards by the hash of their names, and only the thread
+of a shard touches its BookingService. Producers send requests over single-producer/single-consumer queues,
+one per producer and shard, so the hot path shares no mutable state but the queue positions.
+Bookings are sent without waiting. Queries wait for the answer of the shard, which has executed
+all requests the producer sent to it before, so a producer always sees its own bookings.
+Requests of different producers to a hotel are executed in no particular order relative to each other,
+so every hotel should be booked by a single producer. Statistics over all hotels are not available.
+Hot hotels bypass the shards: they may be booked by all producers, each keeping its bookings in time order.
+They keep partial windows per producer or are booked through flat combining
+*/
+class ShardedBookingEngine final
+{
+	enum class RequestType
+	{
+		Book,
+		Clients,
+		Rooms,
+		Flush,
+	};
+
+	struct Request
+	{
+		RequestType type = RequestType::Flush;
+		Time time = 0;
+		ClientId clientId = 0;
+		RoomCount roomCount = 0;
+		size_t spanIndex = 0;
+		std::uint64_t querySequence = 0;
+		std::string hotelName;
+	};
+
+	// Requests of a producer to a shard and the answer to the latest query
+	struct Channel
+	{
+		explicit Channel(size_t queueCapacity)
+			: requests(queueCapacity)
+		{
+		}
+
+		SpscQueue<Request> requests;
+		// Written by the shard and read by the producer once it sees the query sequence
+		alignas(64) std::atomic<std::uint64_t> answeredQuery{ 0 };
+		std::uint64_t answer = 0;
+		std::exception_ptr queryError;
+		// The first error of a booking, reported by the next query or Flush of the producer
+		std::exception_ptr bookingError;
+	};
+
+public:
+	// Sends requests of one thread. Is not thread-safe
+	class Producer final
+	{
+	public:
+		Producer(const Producer&) = delete;
+		Producer& operator=(const Producer&) = delete;
+
+		// Returns without waiting for the booking. If it fails, the next query or Flush
+		// to the shard of the hotel throws the exception instead. Hot hotels are booked at once and throw at once
+		void Book(Time time, const std::string& hotelName, ClientId clientId, RoomCount roomCount);
+
+		// Throw what BookingService throws
+		size_t GetDistinctClientCount(const std::string& hotelName, size_t spanIndex = 0);
+		RoomCount GetBookedRoomCount(const std::string& hotelName, size_t spanIndex = 0);
+
+		// Waits until all shards have executed the requests sent before
+		void Flush();
+
+	private:
+		friend class ShardedBookingEngine;
+
+		Producer(ShardedBookingEngine& engine, unsigned index);
+
+		Channel& GetChannel(size_t shardIndex) const noexcept;
+		Request& GetPushSlot(Channel& channel) const noexcept;
+		std::uint64_t Query(RequestType type, const std::string& hotelName, size_t spanIndex);
+		// Waits for the answer to the query and throws the errors reported by the shard
+		void WaitAnswer(Channel& channel, std::uint64_t querySequence) const;
+
+		ShardedBookingEngine& m_engine;
+		unsigned m_index;
+		std::uint64_t m_querySequence = 0;
+	};
+
+	// Starts the shard threads. Throws std::invalid_argument if there are no shards or producers
+	// or if idle hotels expire, since a shard would expire its hotels against its own latest booking
+	ShardedBookingEngine(const BookingServiceOptions& serviceOptions, const ShardedEngineOptions& options);
+	// Executes the requests sent and stops the shard threads. Producers may not be used meanwhile
+	~ShardedBookingEngine();
+
+	ShardedBookingEngine(const ShardedBookingEngine&) = delete;
+	ShardedBookingEngine& operator=(const ShardedBookingEngine&) = delete;
+
+	// Every producer must be used by a single thread at a time
+	Producer& GetProducer(unsigned index);
+
+	unsigned GetShardCount() const noexcept;
+
+private:
+	struct Shard
+	{
+		explicit Shard(const BookingServiceOptions& options)
+			: service(options)
+		{
+		}
+
+		BookingService service;
+		std::thread thread;
+	};
+
+	size_t GetShardIndex(const std::string& hotelName) const noexcept;
+	// Either of the bookings is set
+	struct HotHotel
+	{
+		std::unique_ptr<HotHotelBookings> partialWindows;
+		std::unique_ptr<CombiningHotelBookings> combining;
+	};
+
+	// Returns nullptr unless the hotel is hot
+	HotHotel* FindHotHotel(const std::string& hotelName) noexcept;
+	void RunShard(unsigned shardIndex) noexcept;
+	void Execute(Shard& shard, Channel& channel, Request& request) noexcept;
+	void StopShards() noexcept;
+
+	ShardedEngineOptions m_options;
+	std::vector<std::unique_ptr<Shard>> m_shards;
+	// The channel of producer p to shard s is at p * shardCount + s
+	std::vector<std::unique_ptr<Channel>> m_channels;
+	std::vector<std::unique_ptr<Producer>> m_producers;
+	// Is not changed after construction, so producers look hotels up without locking
+	std::unordered_map<std::string, HotHotel> m_hotHotels;
+	std::atomic<bool> m_stopping{ false };
+};
+
+// Binds the calling thread to the core (modulo the number of cores).
+// Returns false if it is not supported or fails
+bool PinCurrentThread(unsigned core) noexcept;
@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/*
+Bounded lock-free queue of one producer thread and one consumer thread.
+Elements are constructed once and reused: the producer fills a slot in place (so a string assigned to it
+keeps its capacity) and the consumer reads it in place. The producer and consumer positions live
+on separate cache lines, and each side rereads the other one's position only when the queue looks full or empty
+*/
+template <typename T>
+class SpscQueue final
+{
+public:
+	// The capacity is rounded up to a power of two
+	explicit SpscQueue(size_t capacity)
+	{
+		size_t roundedCapacity = 1;
+		while (roundedCapacity < capacity)
+		{
+			roundedCapacity *= 2;
+		}
+		m_slots = std::make_unique<T[]>(roundedCapacity);
+		m_mask = roundedCapacity - 1;
+	}
+
+	SpscQueue(const SpscQueue&) = delete;
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+	// Producer: returns the slot to fill before Push or nullptr if the queue is full
+	T* GetPushSlot() noexcept
+	{
+		const auto tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_cachedHead > m_mask)
+		{
+			m_cachedHead = m_head.load(std::memory_order_acquire);
+			if (tail - m_cachedHead > m_mask)
+			{
+				return nullptr;
+			}
+		}
+		return &m_slots[tail & m_mask];
+	}
+
+	// Producer: publishes the slot returned by GetPushSlot
+	void Push() noexcept
+	{
+		m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Consumer: returns the oldest element or nullptr if the queue is empty
+	T* GetFront() noexcept
+	{
+		const auto head = m_head.load(std::memory_order_relaxed);
+		if (head == m_cachedTail)
+		{
+			m_cachedTail = m_tail.load(std::memory_order_acquire);
+			if (head == m_cachedTail)
+			{
+				return nullptr;
+			}
+		}
+		return &m_slots[head & m_mask];
+	}
+
+	// Consumer: releases the slot returned by GetFront to the producer
+	void Pop() noexcept
+	{
+		m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+private:
+	static constexpr size_t CacheLineSize = 64;
+
+	std::unique_ptr<T[]> m_slots;
+	size_t m_mask = 0;
+	alignas(CacheLineSize) std::atomic<size_t> m_head{ 0 }; // Written by the consumer
+	size_t m_cachedTail = 0; // The consumer's copy of m_tail
+	alignas(CacheLineSize) std::atomic<size_t> m_tail{ 0 }; // Written by the producer
+	size_t m_cachedHead = 0; // The producer's copy of m_head
+};
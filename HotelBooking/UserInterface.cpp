@@ -1,6 +1,55 @@
 #include "UserInterface.h"
 #include "BookingService.h"
-#include <sstream>
+#include "FileReader.h"
+#include <istream>
+#include <ostream>
+#include <string>
+
+namespace
+{
+// Parses the line without allocating, unless it has unusual syntax or a syntax error
+void ParseQueryLine(const std::string& line, Query& query)
+{
+	QueryRecord record{};
+	std::string_view hotelName;
+	if (ParseQueryRecord(line, record, hotelName))
+	{
+		RecordToQuery(record, hotelName, query);
+	}
+	else
+	{
+		ParseQuery(line, query);
+	}
+}
+} // namespace
+
+Answer ExecuteQuery(BookingService& service, const Query& query)
+{
+	switch (query.type)
+	{
+	case QueryType::Book:
+		service.Book(query.time, query.hotelName, query.clientId, query.roomCount);
+		return {};
+	case QueryType::Clients:
+		return { 1, { service.GetDistinctClientCount(query.hotelName, query.spanIndex) } };
+	case QueryType::Rooms:
+		return { 1, { service.GetBookedRoomCount(query.hotelName, query.spanIndex) } };
+	case QueryType::RoomsRange:
+		return { 1, { service.GetBookedRoomCount(query.hotelName, query.from, query.to) } };
+	case QueryType::Total:
+		return { 2, { service.GetTotalBookedRoomCount(query.spanIndex), service.GetTotalBookingCount(query.spanIndex) } };
+	case QueryType::Hotels:
+		return { 1, { service.GetClientHotelCount(query.clientId) } };
+	case QueryType::ClientsAt:
+		return { 1, { service.GetDistinctClientCountAt(query.hotelName, query.asOf, query.spanIndex) } };
+	case QueryType::RoomsAt:
+		return { 1, { service.GetBookedRoomCountAt(query.hotelName, query.asOf, query.spanIndex) } };
+	case QueryType::Cancel:
+		service.Cancel(query.bookingId);
+		return {};
+	}
+	return {};
+}
 
 UserInterface::UserInterface(std::istream& input, std::ostream& output, BookingService& service)
 	: m_input(input)
@@ -9,54 +58,133 @@ UserInterface::UserInterface(std::istream& input, std::ostream& output, BookingS
 {
 }
 
+void UserInterface::EnableTracing(std::ostream& summaryOutput)
+{
+	m_tracer = std::make_unique<QueryTracer>();
+	m_traceOutput = &summaryOutput;
+}
+
 void UserInterface::Run()
+{
+	RunQueries([this](std::string& line) { std::getline(m_input, line); });
+}
+
+void UserInterface::Run(FileReader& input)
+{
+	RunQueries([&input](std::string& line) {
+		std::string_view fileLine;
+		input.ReadLine(fileLine);
+		// The line is copied since ParseQuery may read it with a string stream
+		line.assign(fileLine.data(), fileLine.size());
+	});
+}
+
+template <typename ReadLine>
+void UserInterface::RunQueries(ReadLine&& readLine)
 {
 	using namespace std;
+	using Phase = QueryTracer::Phase;
 
 	string line;
-	getline(m_input, line);
+	readLine(line);
 	unsigned size = std::stoul(line);
+	Query query;
 	for (unsigned i = 0; i < size; ++i)
 	{
-		getline(m_input, line);
-		istringstream lineStream(line);
-		string query;
-		lineStream >> query;
+		auto phaseBegin = m_tracer ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+
+		readLine(line);
+		ParseQueryLine(line, query);
+		Trace(query.type, Phase::Parse, phaseBegin);
 
-		string hotelName;
-		if (query == "BOOK"sv)
+		const auto answer = ExecuteQuery(m_service, query);
+		Trace(query.type, Phase::Service, phaseBegin);
+
+		WriteAnswer(m_output, answer);
+		Trace(query.type, Phase::Output, phaseBegin);
+	}
+
+	if (m_tracer)
+	{
+		m_tracer->PrintSummary(*m_traceOutput);
+	}
+}
+
+void UserInterface::RunStream(const StreamOptions& options)
+{
+	using namespace std;
+	using Phase = QueryTracer::Phase;
+
+	string line;
+	string answers;
+	Query query;
+	auto oldestAnswerTime = chrono::steady_clock::time_point();
+	while (getline(m_input, line))
+	{
+		auto phaseBegin = m_tracer ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+		const bool firstAnswer = answers.empty();
+		bool failed = false;
+		try
 		{
-			Time time;
-			ClientId clientId;
-			RoomCount roomCount;
-			if (!(lineStream >> time >> hotelName >> clientId >> roomCount))
-			{
-				throw runtime_error("BOOK query syntax error");
-			}
-
-			m_service.Book(time, hotelName, clientId, roomCount);
+			ParseQueryLine(line, query);
+			Trace(query.type, Phase::Parse, phaseBegin);
+			const auto answer = ExecuteQuery(m_service, query);
+			Trace(query.type, Phase::Service, phaseBegin);
+			AppendAnswer(answers, answer);
 		}
-		else if (query == "CLIENTS"sv)
+		catch (const exception& e)
 		{
-			if (!(lineStream >> hotelName))
-			{
-				throw runtime_error("CLIENTS query syntax error");
-			}
-
-			m_output << m_service.GetDistinctClientCount(hotelName) << "\n";
+			answers += "ERROR ";
+			answers += e.what();
+			answers += '\n';
+			failed = true;
 		}
-		else if (query == "ROOMS"sv)
-		{
-			if (!(lineStream >> hotelName))
-			{
-				throw runtime_error("ROOMS query syntax error");
-			}
 
-			m_output << m_service.GetBookedRoomCount(hotelName) << "\n";
+		if (!answers.empty() && ShouldFlush(options, answers.size(), firstAnswer, oldestAnswerTime))
+		{
+			m_output.write(answers.data(), static_cast<streamsize>(answers.size()));
+			m_output.flush();
+			answers.clear();
 		}
-		else
+		if (!failed)
 		{
-			throw runtime_error("Unknown query " + query);
+			Trace(query.type, Phase::Output, phaseBegin);
 		}
 	}
+	if (!answers.empty())
+	{
+		m_output.write(answers.data(), static_cast<streamsize>(answers.size()));
+		m_output.flush();
+	}
+
+	if (m_tracer)
+	{
+		m_tracer->PrintSummary(*m_traceOutput);
+	}
+}
+
+bool UserInterface::ShouldFlush(const StreamOptions& options, size_t answersSize, bool firstAnswer,
+	std::chrono::steady_clock::time_point& oldestAnswerTime) const
+{
+	// The next line may not have arrived yet, so the buffered answers mustn't wait for it
+	if (options.flushEveryAnswer || answersSize >= options.maxBufferedBytes || m_input.rdbuf()->in_avail() <= 0)
+	{
+		return true;
+	}
+	const auto now = std::chrono::steady_clock::now();
+	if (firstAnswer)
+	{
+		oldestAnswerTime = now;
+	}
+	return now - oldestAnswerTime >= options.maxFlushDelay;
+}
+
+void UserInterface::Trace(QueryType type, QueryTracer::Phase phase, std::chrono::steady_clock::time_point& phaseBegin)
+{
+	if (m_tracer)
+	{
+		const auto now = std::chrono::steady_clock::now();
+		m_tracer->Record(type, phase, now - phaseBegin);
+		phaseBegin = now;
+	}
 }
@@ -1,17 +1,60 @@
 #pragma once
+#include "Query.h"
+#include "QueryTracer.h"
+#include <chrono>
 #include <iosfwd>
+#include <memory>
+#include <string>
 
 class BookingService;
+class FileReader;
+
+// Executes the query against the service. Throws what the service throws
+Answer ExecuteQuery(BookingService& service, const Query& query);
+
+// How UserInterface::RunStream writes answers
+struct StreamOptions
+{
+	// Flush every answer for the lowest latency. Otherwise answers are buffered and flushed once maxBufferedBytes
+	// are buffered, maxFlushDelay has passed since the oldest buffered answer or no more input is buffered
+	bool flushEveryAnswer = false;
+	size_t maxBufferedBytes = 64 * 1024;
+	std::chrono::milliseconds maxFlushDelay{ 10 };
+};
 
 class UserInterface
 {
 public:
 	explicit UserInterface(std::istream& input, std::ostream& output, BookingService& service);
 
+	// Makes Run record parse, service and output latencies of every query
+	// and write their summary to summaryOutput once all queries are processed
+	void EnableTracing(std::ostream& summaryOutput);
+
 	void Run();
 
+	// Reads queries from the file instead of the input stream
+	void Run(FileReader& input);
+
+	// Processes queries without the count line until the end of the input.
+	// Errors are answered with ERROR lines, as QueryServer does, and the queries following them are processed
+	void RunStream(const StreamOptions& options = {});
+
 private:
+	// Processes queries in the input format, reading lines with readLine(std::string&)
+	template <typename ReadLine>
+	void RunQueries(ReadLine&& readLine);
+
+	// Checks the flush policy once an answer is buffered, remembering when the first answer of the batch was
+	bool ShouldFlush(const StreamOptions& options, size_t answersSize, bool firstAnswer,
+		std::chrono::steady_clock::time_point& oldestAnswerTime) const;
+
+	// Records time elapsed since phaseBegin and moves phaseBegin to the current time (if tracing is enabled)
+	void Trace(QueryType type, QueryTracer::Phase phase, std::chrono::steady_clock::time_point& phaseBegin);
+
 	BookingService& m_service;
 	std::istream& m_input;
 	std::ostream& m_output;
+	std::unique_ptr<QueryTracer> m_tracer;
+	std::ostream* m_traceOutput = nullptr;
 };
@@ -1,16 +1,297 @@
 #include "BookingService.h"
+#include "FileReader.h"
+#include "ParallelQueryParser.h"
+#include "ParallelReplay.h"
+#include "QueryServer.h"
 #include "UserInterface.h"
+#include <csignal>
 #include <iostream>
+#include <optional>
+#include <sstream>
+#include <string_view>
+#include <vector>
 
-int main(int /*argc*/, char* /*argv*/[])
+namespace
+{
+std::vector<Time> ParseTimeSpans(const std::string& text)
+{
+	std::vector<Time> timeSpans;
+	std::istringstream input(text);
+	std::string timeSpan;
+	while (std::getline(input, timeSpan, ','))
+	{
+		timeSpans.push_back(std::stoll(timeSpan));
+	}
+	return timeSpans;
+}
+
+#ifdef __linux__
+QueryServer* g_server = nullptr;
+
+void StopServer(int)
+{
+	g_server->Stop();
+}
+#endif
+} // namespace
+
+/*
+Usage: HotelBooking [--spans SPAN[,SPAN...]] [--max-lateness SECONDS [--reject-late]] [--retention SECONDS] [--expire-idle-hotels] [--cancellable] [--client-hotels] [--metrics] [--memory] [--trace]
+	[--input FILE [--no-io-uring]] [--threads N | --parse-threads N]
+	[--stream [--flush-every-answer] [--flush-bytes BYTES] [--flush-delay MILLISECONDS] | --interactive]
+	[--listen ADDRESS]...
+Usage: HotelBooking --connect ADDRESS
+	--spans - statistic time spans in seconds (one day by default). CLIENTS and ROOMS queries
+		may refer to them by index after the hotel name, the first one is used when the index is omitted
+	--max-lateness - accept bookings made up to SECONDS earlier than the latest booking of the hotel
+		(0 by default). An earlier booking is made at the time of the latest booking of the hotel
+	--reject-late - make a booking earlier than --max-lateness allows an error
+	--expire-idle-hotels - drop hotels whose latest booking has left all time spans as of the latest booking of all hotels
+	--retention - retain bookings made within SECONDS before the latest booking of the hotel
+		to answer CLIENTS_AT and ROOMS_AT queries
+	--cancellable - allow CANCEL queries cancelling bookings by number of the BOOK query (starting from 1)
+	--client-hotels - maintain hotels booked by every client to answer HOTELS queries
+	--metrics - write BookingService metrics to stderr after all queries are processed
+	--memory - write BookingService memory usage to stderr after all queries are processed
+	--trace - write parse, service and output latencies per query type to stderr after all queries are processed
+	--input - read queries from FILE instead of stdin, keeping several reads in flight with io_uring where available
+	--no-io-uring - read FILE with plain reads
+	--threads - execute queries on N threads, partitioning hotels between them. The output is the same
+		as with a single thread. Can't be combined with --parse-threads, --listen, --metrics, --memory, --trace
+		and --expire-idle-hotels
+	--parse-threads - parse queries on N threads in chunks, executing them in order on the main thread.
+		FILE is mapped into memory. Can't be combined with --listen and --trace
+	--stream - process queries from stdin without the count line until its end, answering errors with ERROR lines.
+		Answers are buffered and flushed once BYTES are buffered (64 KiB by default), MILLISECONDS have passed
+		since the oldest buffered answer (10 by default) or stdin has no more data buffered.
+		Can't be combined with --input, --threads, --parse-threads and --listen
+	--flush-every-answer - flush every answer in --stream mode for the lowest latency
+	--interactive - --stream --flush-every-answer for a frontend waiting for every answer
+	--listen - serve queries at tcp:PORT (loopback) or unix:PATH instead of stdin until SIGINT or SIGTERM.
+		May be repeated. Connections send queries without the count line, errors are answered with ERROR lines
+	--connect - send queries read from stdin to the server at ADDRESS and write the answers to stdout
+(--listen and --connect are only available on Linux)
+*/
+int main(int argc, char* argv[])
 {
 	using namespace std;
 
 	try
 	{
-		BookingService service;
-		UserInterface ui(cin, cout, service);
-		ui.Run();
+		BookingServiceOptions options;
+		bool dumpMetrics = false;
+		bool dumpMemoryUsage = false;
+		bool traceQueries = false;
+		std::vector<std::string> listenAddresses;
+		std::string connectAddress;
+		std::string inputPath;
+		auto inputBackend = FileReader::Backend::IoUring;
+		std::optional<unsigned> threadCount;
+		std::optional<unsigned> parseThreadCount;
+		bool streamQueries = false;
+		StreamOptions streamOptions;
+		for (int i = 1; i < argc; ++i)
+		{
+			if (argv[i] == "--spans"sv && i + 1 < argc)
+			{
+				options.statisticTimeSpans = ParseTimeSpans(argv[++i]);
+			}
+			else if (argv[i] == "--max-lateness"sv && i + 1 < argc)
+			{
+				options.maxLateness = std::stoll(argv[++i]);
+			}
+			else if (argv[i] == "--expire-idle-hotels"sv)
+			{
+				options.expireIdleHotels = true;
+			}
+			else if (argv[i] == "--reject-late"sv)
+			{
+				options.rejectTooLate = true;
+			}
+			else if (argv[i] == "--retention"sv && i + 1 < argc)
+			{
+				options.retentionHorizon = std::stoll(argv[++i]);
+			}
+			else if (argv[i] == "--cancellable"sv)
+			{
+				options.cancellable = true;
+			}
+			else if (argv[i] == "--client-hotels"sv)
+			{
+				options.indexClientHotels = true;
+			}
+			else if (argv[i] == "--metrics"sv)
+			{
+				dumpMetrics = true;
+			}
+			else if (argv[i] == "--memory"sv)
+			{
+				dumpMemoryUsage = true;
+			}
+			else if (argv[i] == "--trace"sv)
+			{
+				traceQueries = true;
+			}
+			else if (argv[i] == "--listen"sv && i + 1 < argc)
+			{
+				listenAddresses.push_back(argv[++i]);
+			}
+			else if (argv[i] == "--input"sv && i + 1 < argc)
+			{
+				inputPath = argv[++i];
+			}
+			else if (argv[i] == "--no-io-uring"sv)
+			{
+				inputBackend = FileReader::Backend::Read;
+			}
+			else if (argv[i] == "--threads"sv && i + 1 < argc)
+			{
+				threadCount = std::stoul(argv[++i]);
+			}
+			else if (argv[i] == "--parse-threads"sv && i + 1 < argc)
+			{
+				parseThreadCount = std::stoul(argv[++i]);
+			}
+			else if (argv[i] == "--stream"sv)
+			{
+				streamQueries = true;
+			}
+			else if (argv[i] == "--interactive"sv)
+			{
+				streamQueries = true;
+				streamOptions.flushEveryAnswer = true;
+			}
+			else if (argv[i] == "--flush-every-answer"sv)
+			{
+				streamOptions.flushEveryAnswer = true;
+			}
+			else if (argv[i] == "--flush-bytes"sv && i + 1 < argc)
+			{
+				streamOptions.maxBufferedBytes = std::stoull(argv[++i]);
+			}
+			else if (argv[i] == "--flush-delay"sv && i + 1 < argc)
+			{
+				streamOptions.maxFlushDelay = chrono::milliseconds(std::stoll(argv[++i]));
+			}
+			else if (argv[i] == "--connect"sv && i + 1 < argc)
+			{
+				connectAddress = argv[++i];
+			}
+			else
+			{
+				throw invalid_argument("Unknown option "s + argv[i]);
+			}
+		}
+
+		if (!connectAddress.empty())
+		{
+#ifdef __linux__
+			RunQueryClient(ParseSocketAddress(connectAddress), cin, cout);
+			return EXIT_SUCCESS;
+#else
+			throw invalid_argument("--connect is not supported on this platform");
+#endif
+		}
+
+		if (streamQueries && (!inputPath.empty() || threadCount || parseThreadCount || !listenAddresses.empty()))
+		{
+			throw invalid_argument("--stream can't be combined with --input, --threads, --parse-threads and --listen");
+		}
+
+		if (threadCount)
+		{
+			if (!listenAddresses.empty() || dumpMetrics || dumpMemoryUsage || traceQueries || parseThreadCount
+				|| options.expireIdleHotels)
+			{
+				throw invalid_argument("--threads can't be combined with --parse-threads, --listen, --metrics, --memory, --trace"
+									   " and --expire-idle-hotels");
+			}
+			ParallelReplay replay(options, *threadCount);
+			if (inputPath.empty())
+			{
+				replay.Run(cin, cout);
+			}
+			else
+			{
+				FileReader input(inputPath, inputBackend);
+				replay.Run(input, cout);
+			}
+			return EXIT_SUCCESS;
+		}
+
+		if (parseThreadCount && (!listenAddresses.empty() || traceQueries))
+		{
+			throw invalid_argument("--parse-threads can't be combined with --listen and --trace");
+		}
+
+		BookingService service(std::move(options));
+		if (!listenAddresses.empty())
+		{
+#ifdef __linux__
+			QueryServer server(service);
+			for (auto& address : listenAddresses)
+			{
+				server.Listen(ParseSocketAddress(address));
+			}
+			g_server = &server;
+			signal(SIGINT, StopServer);
+			signal(SIGTERM, StopServer);
+			server.Run();
+			g_server = nullptr;
+#else
+			throw invalid_argument("--listen is not supported on this platform");
+#endif
+		}
+		else if (streamQueries)
+		{
+			// A buffered stdin tells when no more input has arrived, so batched answers are flushed then.
+			// RunStream flushes the answers itself, so reading stdin doesn't flush stdout
+			ios::sync_with_stdio(false);
+			cin.tie(nullptr);
+			UserInterface ui(cin, cout, service);
+			if (traceQueries)
+			{
+				ui.EnableTracing(cerr);
+			}
+			ui.RunStream(streamOptions);
+		}
+		else if (parseThreadCount)
+		{
+			ParallelQueryParser parser(service, *parseThreadCount);
+			if (inputPath.empty())
+			{
+				parser.Run(cin, cout);
+			}
+			else
+			{
+				parser.Run(inputPath, cout);
+			}
+		}
+		else
+		{
+			UserInterface ui(cin, cout, service);
+			if (traceQueries)
+			{
+				ui.EnableTracing(cerr);
+			}
+			if (inputPath.empty())
+			{
+				ui.Run();
+			}
+			else
+			{
+				FileReader input(inputPath, inputBackend);
+				ui.Run(input);
+			}
+		}
+		if (dumpMetrics)
+		{
+			cerr << service.GetMetrics();
+		}
+		if (dumpMemoryUsage)
+		{
+			cerr << service.GetMemoryUsage();
+		}
 		return EXIT_SUCCESS;
 	}
 	catch (const exception& e)
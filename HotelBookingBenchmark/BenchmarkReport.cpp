@@ -0,0 +1,55 @@
+#include "BenchmarkReport.h"
+#include "../HotelBooking/LatencyHistogram.h"
+#include <iomanip>
+
+ReportLine& ReportLine::AddLatencies(const LatencyHistogram& histogram)
+{
+	return Add("count", histogram.GetCount())
+		.Add("mean_ns", histogram.GetMean())
+		.Add("p50_ns", histogram.GetPercentile(50))
+		.Add("p99_ns", histogram.GetPercentile(99))
+		.Add("p999_ns", histogram.GetPercentile(99.9))
+		.Add("max_ns", histogram.GetMax());
+}
+
+void ReportLine::WriteString(std::string_view text)
+{
+	m_stream << '"';
+	for (const char ch : text)
+	{
+		switch (ch)
+		{
+		case '"':
+			m_stream << "\\\"";
+			break;
+		case '\\':
+			m_stream << "\\\\";
+			break;
+		case '\n':
+			m_stream << "\\n";
+			break;
+		case '\r':
+			m_stream << "\\r";
+			break;
+		case '\t':
+			m_stream << "\\t";
+			break;
+		default:
+			if (static_cast<unsigned char>(ch) < 0x20)
+			{
+				m_stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(ch) << std::dec << std::setfill(' ');
+			}
+			else
+			{
+				m_stream << ch;
+			}
+		}
+	}
+	m_stream << '"';
+}
+
+double GetOperationsPerSecond(std::uint64_t operationCount, std::chrono::nanoseconds duration) noexcept
+{
+	const auto seconds = std::chrono::duration<double>(duration).count();
+	return seconds > 0 ? operationCount / seconds : 0.0;
+}
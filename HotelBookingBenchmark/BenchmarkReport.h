@@ -0,0 +1,56 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+class LatencyHistogram;
+
+/*
+Builds one line of the machine-readable benchmark report (a flat JSON object).
+Every measurement is written as a separate line so results of different versions
+can be collected and compared with standard line-oriented tools.
+*/
+class ReportLine final
+{
+public:
+	// Numbers are written as they are, other values as JSON strings of their text
+	template <typename T>
+	ReportLine& Add(std::string_view name, const T& value)
+	{
+		m_stream << (m_empty ? "{" : ",");
+		m_empty = false;
+		WriteString(name);
+		m_stream << ':';
+		if constexpr (std::is_arithmetic_v<T>)
+		{
+			m_stream << value;
+		}
+		else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+		{
+			WriteString(value);
+		}
+		else
+		{
+			std::ostringstream text;
+			text << value;
+			WriteString(text.str());
+		}
+		return *this;
+	}
+
+	ReportLine& AddLatencies(const LatencyHistogram& histogram);
+
+	std::string str() const { return m_stream.str() + "}"; }
+
+private:
+	// Writes the text as a JSON string, escaping quotes, backslashes and control characters
+	void WriteString(std::string_view text);
+
+	std::ostringstream m_stream;
+	bool m_empty = true;
+};
+
+double GetOperationsPerSecond(std::uint64_t operationCount, std::chrono::nanoseconds duration) noexcept;
@@ -0,0 +1,131 @@
+#include "ContentionBenchmark.h"
+#include "../HotelBooking/CombiningHotelBookings.h"
+#include "../HotelBooking/HotHotelBookings.h"
+#include "BenchmarkReport.h"
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace
+{
+enum class ContentionMode
+{
+	Mutex,
+	FlatCombining,
+	PartialWindows,
+};
+
+const array<const char*, 3> ContentionModeNames = { "mutex", "flat_combining", "partial_windows" };
+
+// Bookings are made at the nanosecond they are issued, so bookings of different threads arrive almost in time order.
+// A thread preempted between taking the time and booking makes a late booking
+const vector<Time> TimeSpans = { 1'000'000 };
+constexpr Time MaxLateness = 10'000'000;
+
+void RunContentionWorkload(ostream& report, ContentionMode mode, unsigned threadCount, unsigned operationCount)
+{
+	cerr << "contention/" << ContentionModeNames[static_cast<size_t>(mode)] << ": threads=" << threadCount << "\n";
+
+	BookingHistoryOptions options;
+	options.maxLateness = MaxLateness;
+	mutex lockedBookingsMutex;
+	HotelBookings lockedBookings(TimeSpans, nullptr, options);
+	optional<CombiningHotelBookings> combiningBookings;
+	optional<HotHotelBookings> partialBookings;
+	if (mode == ContentionMode::FlatCombining)
+	{
+		combiningBookings.emplace(TimeSpans, threadCount, options);
+	}
+	else if (mode == ContentionMode::PartialWindows)
+	{
+		partialBookings.emplace(TimeSpans, threadCount, options);
+	}
+
+	const unsigned bookingsPerThread = operationCount / threadCount;
+	vector<uint64_t> rejectedCounts(threadCount);
+	vector<thread> threads;
+	const auto beginTime = steady_clock::now();
+	for (unsigned threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+	{
+		threads.emplace_back([&, threadIndex] {
+			mt19937 gen(threadIndex);
+			uniform_int_distribution<ClientId> randClient(0, 20'000);
+			uniform_int_distribution<RoomCount> randRoomCount(1, 1000);
+			for (unsigned i = 0; i < bookingsPerThread; ++i)
+			{
+				const auto clientId = randClient(gen);
+				const auto roomCount = randRoomCount(gen);
+				const Time time = duration_cast<nanoseconds>(steady_clock::now() - beginTime).count();
+				try
+				{
+					if (mode == ContentionMode::Mutex)
+					{
+						lock_guard lock(lockedBookingsMutex);
+						lockedBookings.Book(time, clientId, roomCount);
+					}
+					else if (mode == ContentionMode::FlatCombining)
+					{
+						combiningBookings->Book(threadIndex, time, clientId, roomCount);
+					}
+					else
+					{
+						partialBookings->Book(threadIndex, time, clientId, roomCount);
+					}
+				}
+				catch (const invalid_argument&)
+				{
+					++rejectedCounts[threadIndex];
+				}
+			}
+		});
+	}
+	for (auto& bookingThread : threads)
+	{
+		bookingThread.join();
+	}
+	const nanoseconds duration = steady_clock::now() - beginTime;
+
+	uint64_t rejectedCount = 0;
+	for (auto threadRejectedCount : rejectedCounts)
+	{
+		rejectedCount += threadRejectedCount;
+	}
+	const uint64_t bookingCount = uint64_t(bookingsPerThread) * threadCount;
+	double bookingsPerBatch = 1;
+	if (combiningBookings)
+	{
+		const auto statistics = combiningBookings->GetStatistics();
+		bookingsPerBatch = statistics.batchCount ? double(statistics.bookingCount) / statistics.batchCount : 0;
+	}
+	ReportLine line;
+	line.Add("suite", "contention")
+		.Add("scenario", ContentionModeNames[static_cast<size_t>(mode)])
+		.Add("threads", threadCount)
+		.Add("operation", "BOOK")
+		.Add("count", bookingCount)
+		.Add("ops_per_sec", GetOperationsPerSecond(bookingCount, duration))
+		.Add("bookings_per_batch", bookingsPerBatch)
+		.Add("rejected", rejectedCount);
+	report << line.str() << "\n";
+}
+} // namespace
+
+void RunContentionBenchmarks(ostream& report, unsigned operationCount)
+{
+	for (auto mode : { ContentionMode::Mutex, ContentionMode::FlatCombining, ContentionMode::PartialWindows })
+	{
+		for (unsigned threadCount : { 1u, 2u, 4u, 8u })
+		{
+			RunContentionWorkload(report, mode, threadCount, operationCount);
+		}
+	}
+}
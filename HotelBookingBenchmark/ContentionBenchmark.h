@@ -0,0 +1,6 @@
+#pragma once
+#include <iosfwd>
+
+// Books a single hotel from 1, 2, 4 and 8 threads under a mutex, through flat combining
+// and into partial windows, and writes a throughput report line per mode and thread count
+void RunContentionBenchmarks(std::ostream& report, unsigned operationCount);
@@ -0,0 +1,364 @@
+#include "ServiceBenchmark.h"
+#include "../HotelBooking/BookingService.h"
+#include "../HotelBooking/LatencyHistogram.h"
+#include "../HotelBooking/ShardedBookingEngine.h"
+#include "../HotelBookingTests/Generators.h"
+#include "BenchmarkReport.h"
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace
+{
+enum class OperationType
+{
+	Book,
+	Clients,
+	Rooms,
+	Cancel,
+};
+
+const array<const char*, 4> OperationNames = { "BOOK", "CLIENTS", "ROOMS", "CANCEL" };
+
+// Cancellations pick one of the latest bookings, which are likely to be within the time span
+constexpr BookingId CancelledBookingDepth = 1'000;
+
+struct Operation
+{
+	OperationType type;
+	unsigned hotelIndex;
+	ClientId clientId;
+	RoomCount roomCount;
+	Time time;
+	BookingId bookingId;
+};
+
+vector<Operation> GenerateOperations(const ServiceWorkload& workload)
+{
+	mt19937 gen(3);
+	uniform_int_distribution<unsigned> randHotel(0, workload.hotelCount - 1);
+	uniform_int_distribution<size_t> randClient(0, workload.clientCount - 1);
+	uniform_int_distribution<RoomCount> randRoomCount(1, 1000);
+	uniform_int_distribution<Time> randTimeDelta(0, workload.maxTimeDelta);
+	bernoulli_distribution randRead(workload.readRatio);
+	bernoulli_distribution randClientsQuery(0.5);
+	bernoulli_distribution randCancel(workload.cancelRatio);
+
+	const auto clients = GenerateClientIds(workload.clientCount);
+	vector<Operation> operations;
+	operations.reserve(workload.operationCount);
+	Time time = 0;
+	BookingId bookingCount = 0;
+	for (unsigned i = 0; i < workload.operationCount; ++i)
+	{
+		Operation op{ OperationType::Book, randHotel(gen), 0, 0, 0, 0 };
+		if (randRead(gen))
+		{
+			op.type = randClientsQuery(gen) ? OperationType::Clients : OperationType::Rooms;
+		}
+		else if (workload.cancelRatio > 0 && bookingCount != 0 && randCancel(gen))
+		{
+			// The service assigns id n to the n-th booking
+			op.type = OperationType::Cancel;
+			op.bookingId = uniform_int_distribution<BookingId>(
+				bookingCount > CancelledBookingDepth ? bookingCount - CancelledBookingDepth + 1 : 1, bookingCount)(gen);
+		}
+		else
+		{
+			time += randTimeDelta(gen);
+			op.clientId = clients[randClient(gen)];
+			op.roomCount = randRoomCount(gen);
+			op.time = time;
+			++bookingCount;
+		}
+		operations.push_back(op);
+	}
+	return operations;
+}
+
+// Returns a value depending on the query result so that the compiler can't drop the query
+size_t Execute(BookingService& service, const Operation& op, const vector<string>& hotels)
+{
+	const auto& hotel = hotels[op.hotelIndex];
+	switch (op.type)
+	{
+	case OperationType::Book:
+		service.Book(op.time, hotel, op.clientId, op.roomCount);
+		return 0;
+	case OperationType::Clients:
+		return service.GetDistinctClientCount(hotel);
+	case OperationType::Rooms:
+		return service.GetBookedRoomCount(hotel);
+	case OperationType::Cancel:
+		return service.Cancel(op.bookingId);
+	}
+	return 0;
+}
+
+void RunWorkload(ostream& report, const char* scenario, const ServiceWorkload& workload)
+{
+	cerr << "service/" << scenario << ": hotels=" << workload.hotelCount
+		 << " clients=" << workload.clientCount
+		 << " max_time_delta=" << workload.maxTimeDelta
+		 << " read_ratio=" << workload.readRatio
+		 << " rank_hotels=" << workload.rankHotels
+		 << " client_hotels=" << workload.indexClientHotels
+		 << " cancel_ratio=" << workload.cancelRatio << "\n";
+
+	const auto hotels = GenerateHotels(workload.hotelCount);
+	const auto operations = GenerateOperations(workload);
+	BookingServiceOptions options;
+	options.rankHotels = workload.rankHotels;
+	options.indexClientHotels = workload.indexClientHotels;
+	options.cancellable = workload.cancelRatio > 0;
+
+	// Throughput pass without per-operation timers
+	size_t checksum = 0;
+	nanoseconds duration;
+	MemoryUsage memoryUsage;
+	{
+		BookingService service(options);
+		const auto beginTime = steady_clock::now();
+		for (auto& op : operations)
+		{
+			checksum += Execute(service, op, hotels);
+		}
+		duration = steady_clock::now() - beginTime;
+		memoryUsage = service.GetMemoryUsage();
+	}
+
+	// Latency pass on a fresh service, replaying the same operations
+	array<LatencyHistogram, OperationNames.size()> latencies;
+	{
+		BookingService service(options);
+		for (auto& op : operations)
+		{
+			const auto beginTime = steady_clock::now();
+			checksum += Execute(service, op, hotels);
+			const auto endTime = steady_clock::now();
+			latencies[static_cast<size_t>(op.type)].Record(duration_cast<nanoseconds>(endTime - beginTime).count());
+		}
+	}
+
+	auto addWorkload = [&](ReportLine& line) -> ReportLine& {
+		return line.Add("suite", "service")
+			.Add("scenario", scenario)
+			.Add("hotels", workload.hotelCount)
+			.Add("clients", workload.clientCount)
+			.Add("max_time_delta", workload.maxTimeDelta)
+			.Add("read_ratio", workload.readRatio)
+			.Add("rank_hotels", workload.rankHotels)
+			.Add("client_hotels", workload.indexClientHotels)
+			.Add("cancel_ratio", workload.cancelRatio);
+	};
+
+	ReportLine total;
+	addWorkload(total)
+		.Add("operation", "ALL")
+		.Add("count", operations.size())
+		.Add("ops_per_sec", GetOperationsPerSecond(operations.size(), duration))
+		.Add("memory_bytes", memoryUsage.GetTotal().GetTotalBytes())
+		.Add("client_hotel_index_bytes", memoryUsage.clientHotelIndex.GetTotalBytes())
+		.Add("booking_handle_bytes", memoryUsage.bookingHandles.GetTotalBytes())
+		.Add("checksum", checksum);
+	report << total.str() << "\n";
+
+	for (size_t i = 0; i < latencies.size(); ++i)
+	{
+		if (latencies[i].GetCount() == 0)
+		{
+			continue;
+		}
+		ReportLine line;
+		addWorkload(line)
+			.Add("operation", OperationNames[i])
+			.AddLatencies(latencies[i]);
+		report << line.str() << "\n";
+	}
+}
+// Producer p executes the operations on hotels with indices p, p + threadCount, ...,
+// so every hotel sees its operations in the same order as with one thread.
+// With hotHotels, every hotel is hot and producer p executes operations p, p + threadCount, ... instead.
+// Bookings of each producer stay in time order, but queries interleave with other producers' bookings,
+// so their answers are left out of the checksum. The checksum includes the final statistics of every hotel,
+// which match across thread counts and modes
+void RunShardedWorkload(ostream& report, const char* scenario, const ServiceWorkload& workload,
+	unsigned threadCount, bool hotHotels)
+{
+	cerr << "sharded/" << scenario << ": threads=" << threadCount
+		 << " hotels=" << workload.hotelCount
+		 << " read_ratio=" << workload.readRatio
+		 << " hot_hotels=" << hotHotels << "\n";
+
+	const auto hotels = GenerateHotels(workload.hotelCount);
+	const auto operations = GenerateOperations(workload);
+	ShardedEngineOptions options;
+	options.shardCount = threadCount;
+	options.producerCount = threadCount;
+	options.pinShardThreads = true;
+	if (hotHotels)
+	{
+		options.hotHotels = hotels;
+	}
+	ShardedBookingEngine engine(BookingServiceOptions(), options);
+
+	vector<size_t> checksums(threadCount);
+	vector<thread> producers;
+	const auto beginTime = steady_clock::now();
+	for (unsigned producerIndex = 0; producerIndex < threadCount; ++producerIndex)
+	{
+		producers.emplace_back([&, producerIndex] {
+			// Shards take the first cores
+			PinCurrentThread(threadCount + producerIndex);
+			auto& producer = engine.GetProducer(producerIndex);
+			size_t checksum = 0;
+			for (size_t i = 0; i < operations.size(); ++i)
+			{
+				const auto& op = operations[i];
+				if ((hotHotels ? i : op.hotelIndex) % threadCount != producerIndex)
+				{
+					continue;
+				}
+				const auto& hotel = hotels[op.hotelIndex];
+				if (op.type == OperationType::Book)
+				{
+					producer.Book(op.time, hotel, op.clientId, op.roomCount);
+				}
+				else if (op.type == OperationType::Clients)
+				{
+					checksum += producer.GetDistinctClientCount(hotel);
+				}
+				else if (op.type == OperationType::Rooms)
+				{
+					checksum += producer.GetBookedRoomCount(hotel);
+				}
+			}
+			producer.Flush();
+			checksums[producerIndex] = hotHotels ? 0 : checksum;
+		});
+	}
+	for (auto& producer : producers)
+	{
+		producer.join();
+	}
+	const nanoseconds duration = steady_clock::now() - beginTime;
+
+	size_t checksum = 0;
+	for (auto producerChecksum : checksums)
+	{
+		checksum += producerChecksum;
+	}
+	auto& producer = engine.GetProducer(0);
+	for (auto& hotel : hotels)
+	{
+		checksum += producer.GetBookedRoomCount(hotel) + producer.GetDistinctClientCount(hotel);
+	}
+	ReportLine line;
+	line.Add("suite", "sharded")
+		.Add("scenario", scenario)
+		.Add("threads", threadCount)
+		.Add("hotels", workload.hotelCount)
+		.Add("clients", workload.clientCount)
+		.Add("read_ratio", workload.readRatio)
+		.Add("hot_hotels", hotHotels)
+		.Add("operation", "ALL")
+		.Add("count", operations.size())
+		.Add("ops_per_sec", GetOperationsPerSecond(operations.size(), duration))
+		.Add("checksum", checksum);
+	report << line.str() << "\n";
+}
+} // namespace
+
+void RunShardedBenchmarks(ostream& report, unsigned operationCount)
+{
+	for (double readRatio : { 0.0, 0.5 })
+	{
+		ServiceWorkload workload;
+		workload.operationCount = operationCount;
+		workload.readRatio = readRatio;
+		for (unsigned threadCount : { 1u, 2u, 4u, 8u })
+		{
+			RunShardedWorkload(report, "threads", workload, threadCount, false);
+		}
+	}
+
+	// A few hotels get all bookings. Sharding by hotel leaves the other threads idle,
+	// while partial windows of hot hotels spread their bookings over all producers
+	ServiceWorkload workload;
+	workload.operationCount = operationCount;
+	workload.hotelCount = 2;
+	workload.readRatio = 0;
+	for (bool hotHotels : { false, true })
+	{
+		for (unsigned threadCount : { 1u, 2u, 4u, 8u })
+		{
+			RunShardedWorkload(report, "hot_hotels", workload, threadCount, hotHotels);
+		}
+	}
+}
+
+void RunServiceBenchmarks(ostream& report, unsigned operationCount)
+{
+	ServiceWorkload baseline;
+	baseline.operationCount = operationCount;
+
+	RunWorkload(report, "baseline", baseline);
+
+	for (double readRatio : { 0.0, 0.9, 0.99 })
+	{
+		auto workload = baseline;
+		workload.readRatio = readRatio;
+		RunWorkload(report, "read_ratio", workload);
+	}
+
+	for (unsigned hotelCount : { 10u, 100'000u })
+	{
+		auto workload = baseline;
+		workload.hotelCount = hotelCount;
+		RunWorkload(report, "hotels", workload);
+	}
+
+	for (unsigned clientCount : { 100u, 1'000'000u })
+	{
+		auto workload = baseline;
+		workload.clientCount = clientCount;
+		RunWorkload(report, "clients", workload);
+	}
+
+	for (unsigned hotelCount : { 1'000u, 100'000u })
+	{
+		auto workload = baseline;
+		workload.hotelCount = hotelCount;
+		workload.rankHotels = true;
+		RunWorkload(report, "rank_hotels", workload);
+	}
+
+	for (unsigned clientCount : { 100u, 1'000'000u })
+	{
+		auto workload = baseline;
+		workload.clientCount = clientCount;
+		workload.indexClientHotels = true;
+		RunWorkload(report, "client_hotels", workload);
+	}
+
+	for (double cancelRatio : { 0.1, 0.5 })
+	{
+		auto workload = baseline;
+		workload.cancelRatio = cancelRatio;
+		RunWorkload(report, "cancel_ratio", workload);
+	}
+
+	// Bookings stay within a day-long time span longer with smaller deltas,
+	// so each booking has to evict fewer but the windows are deeper
+	for (Time maxTimeDelta : { 0, 10, 100'000 })
+	{
+		auto workload = baseline;
+		workload.maxTimeDelta = maxTimeDelta;
+		RunWorkload(report, "time_delta", workload);
+	}
+}
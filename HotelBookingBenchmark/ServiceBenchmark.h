@@ -0,0 +1,30 @@
+#pragma once
+#include "../HotelBooking/HotelBookings.h"
+#include <iosfwd>
+
+struct ServiceWorkload
+{
+	unsigned hotelCount = 1'000;
+	unsigned clientCount = 20'000;
+	// Time between consecutive bookings is uniformly distributed in [0, maxTimeDelta].
+	// Smaller deltas keep more bookings within the statistic time span.
+	Time maxTimeDelta = 1'000;
+	// Share of CLIENTS/ROOMS queries among all operations
+	double readRatio = 0.5;
+	// Maintain the hotel ranking on every booking
+	bool rankHotels = false;
+	// Maintain the client hotel index on every booking
+	bool indexClientHotels = false;
+	// Share of cancellations of recent bookings among writes. Cancellation is enabled if it is positive
+	double cancelRatio = 0;
+	unsigned operationCount = 500'000;
+};
+
+// Runs BookingService under a set of workloads, one parameter swept at a time,
+// and writes a report line per operation type of every workload
+void RunServiceBenchmarks(std::ostream& report, unsigned operationCount);
+
+// Runs ShardedBookingEngine with 1, 2, 4 and 8 shards, each fed by its own producer thread,
+// and writes a throughput report line per thread count. Checksums match across thread counts.
+// The hot_hotels scenario books two hotels with and without partial windows of hot hotels
+void RunShardedBenchmarks(std::ostream& report, unsigned operationCount);
@@ -0,0 +1,427 @@
+#include "UserInterfaceBenchmark.h"
+#include "../HotelBooking/BookingService.h"
+#include "../HotelBooking/FileReader.h"
+#include "../HotelBooking/LatencyHistogram.h"
+#include "../HotelBooking/ParallelQueryParser.h"
+#include "../HotelBooking/ParallelReplay.h"
+#include "../HotelBooking/UserInterface.h"
+#include "../HotelBookingTests/Generators.h"
+#include "BenchmarkReport.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+#ifdef __linux__
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+namespace
+{
+// Accepts and discards everything written to it
+class NullStreamBuf : public streambuf
+{
+protected:
+	int_type overflow(int_type ch) override { return traits_type::not_eof(ch); }
+	streamsize xsputn(const char* /*s*/, streamsize count) override { return count; }
+};
+
+void GenerateInput(ostream& input, unsigned lineCount, unsigned hotelCount, unsigned clientCount, double bookRatio)
+{
+	const auto hotels = GenerateHotels(hotelCount);
+	const auto clients = GenerateClientIds(clientCount);
+	mt19937 gen(4);
+	uniform_int_distribution<size_t> randHotel(0, hotels.size() - 1);
+	uniform_int_distribution<size_t> randClient(0, clients.size() - 1);
+	uniform_int_distribution<RoomCount> randRoomCount(1, 1000);
+	uniform_int_distribution<Time> randTimeDelta(0, 1000);
+	bernoulli_distribution randBook(bookRatio);
+	bernoulli_distribution randClientsQuery(0.5);
+
+	input << lineCount << "\n";
+	Time time = 0;
+	for (unsigned i = 0; i < lineCount; ++i)
+	{
+		const auto& hotel = hotels[randHotel(gen)];
+		if (randBook(gen))
+		{
+			time += randTimeDelta(gen);
+			input << "BOOK " << time << " " << hotel << " " << clients[randClient(gen)] << " " << randRoomCount(gen) << "\n";
+		}
+		else
+		{
+			input << (randClientsQuery(gen) ? "CLIENTS " : "ROOMS ") << hotel << "\n";
+		}
+	}
+}
+
+void RunInput(ostream& report, const char* scenario, unsigned lineCount, double bookRatio)
+{
+	const unsigned hotelCount = 1'000;
+	const unsigned clientCount = 20'000;
+	cerr << "ui/" << scenario << ": lines=" << lineCount << " book_ratio=" << bookRatio << "\n";
+
+	ostringstream generatedInput;
+	GenerateInput(generatedInput, lineCount, hotelCount, clientCount, bookRatio);
+	istringstream input(generatedInput.str());
+	const auto inputSize = input.str().size();
+	NullStreamBuf nullBuffer;
+	ostream output(&nullBuffer);
+
+	BookingService service;
+	UserInterface ui(input, output, service);
+	const auto beginTime = steady_clock::now();
+	ui.Run();
+	const nanoseconds duration = steady_clock::now() - beginTime;
+
+	ReportLine line;
+	line.Add("suite", "ui")
+		.Add("scenario", scenario)
+		.Add("lines", lineCount)
+		.Add("bytes", inputSize)
+		.Add("book_ratio", bookRatio)
+		.Add("hotels", hotelCount)
+		.Add("clients", clientCount)
+		.Add("duration_ms", duration_cast<milliseconds>(duration).count())
+		.Add("lines_per_sec", GetOperationsPerSecond(lineCount, duration))
+		.Add("mb_per_sec", GetOperationsPerSecond(inputSize, duration) / (1024 * 1024));
+	report << line.str() << "\n";
+}
+
+// Streams the input without the count line into the null device, so that every flush is a write system call
+void RunStream(ostream& report, const char* scenario, unsigned lineCount, const StreamOptions& options)
+{
+	const unsigned hotelCount = 1'000;
+	const unsigned clientCount = 20'000;
+	cerr << "ui/" << scenario << ": lines=" << lineCount << "\n";
+
+	ostringstream generatedInput;
+	GenerateInput(generatedInput, lineCount, hotelCount, clientCount, 0.5);
+	const auto inputText = generatedInput.str();
+	istringstream input(inputText.substr(inputText.find('\n') + 1));
+	const auto inputSize = input.str().size();
+#ifdef _WIN32
+	ofstream output("NUL", ios::binary);
+#else
+	ofstream output("/dev/null", ios::binary);
+#endif
+
+	BookingService service;
+	UserInterface ui(input, output, service);
+	const auto beginTime = steady_clock::now();
+	ui.RunStream(options);
+	const nanoseconds duration = steady_clock::now() - beginTime;
+
+	ReportLine line;
+	line.Add("suite", "ui")
+		.Add("scenario", scenario)
+		.Add("lines", lineCount)
+		.Add("bytes", inputSize)
+		.Add("book_ratio", 0.5)
+		.Add("hotels", hotelCount)
+		.Add("clients", clientCount)
+		.Add("duration_ms", duration_cast<milliseconds>(duration).count())
+		.Add("lines_per_sec", GetOperationsPerSecond(lineCount, duration))
+		.Add("mb_per_sec", GetOperationsPerSecond(inputSize, duration) / (1024 * 1024));
+	report << line.str() << "\n";
+}
+
+void ReplayFile(ostream& report, const string& path, const char* reader)
+{
+	cerr << "replay/" << reader << ": " << path << "\n";
+	NullStreamBuf nullBuffer;
+	ostream output(&nullBuffer);
+	BookingService service;
+
+	const auto beginTime = steady_clock::now();
+	if (reader == "iostream"sv)
+	{
+		ifstream input(path, ios::binary);
+		if (!input)
+		{
+			throw runtime_error("Can't open " + path);
+		}
+		UserInterface ui(input, output, service);
+		ui.Run();
+	}
+	else
+	{
+		istringstream unusedInput;
+		FileReader input(path, reader == "io_uring"sv ? FileReader::Backend::IoUring : FileReader::Backend::Read);
+		if (reader == "io_uring"sv && input.GetBackend() != FileReader::Backend::IoUring)
+		{
+			cerr << "io_uring is not available\n";
+			return;
+		}
+		UserInterface ui(unusedInput, output, service);
+		ui.Run(input);
+	}
+	const nanoseconds duration = steady_clock::now() - beginTime;
+
+	const auto inputSize = filesystem::file_size(path);
+	ReportLine line;
+	line.Add("suite", "replay")
+		.Add("mode", "sequential")
+		.Add("reader", reader)
+		.Add("threads", 0)
+		.Add("bytes", inputSize)
+		.Add("duration_ms", duration_cast<milliseconds>(duration).count())
+		.Add("mb_per_sec", GetOperationsPerSecond(inputSize, duration) / (1024 * 1024));
+	report << line.str() << "\n";
+}
+void ReplayFileInParallel(ostream& report, const string& path, unsigned threadCount)
+{
+	cerr << "replay/parallel: " << path << " threads=" << threadCount << "\n";
+	NullStreamBuf nullBuffer;
+	ostream output(&nullBuffer);
+	ParallelReplay replay(BookingServiceOptions{}, threadCount);
+
+	const auto beginTime = steady_clock::now();
+	FileReader input(path);
+	replay.Run(input, output);
+	const nanoseconds duration = steady_clock::now() - beginTime;
+
+	const auto inputSize = filesystem::file_size(path);
+	ReportLine line;
+	line.Add("suite", "replay")
+		.Add("mode", "partitioned")
+		.Add("reader", input.GetBackend() == FileReader::Backend::IoUring ? "io_uring" : "read")
+		.Add("threads", threadCount)
+		.Add("bytes", inputSize)
+		.Add("duration_ms", duration_cast<milliseconds>(duration).count())
+		.Add("mb_per_sec", GetOperationsPerSecond(inputSize, duration) / (1024 * 1024));
+	report << line.str() << "\n";
+}
+void ReplayFileParsingInParallel(ostream& report, const string& path, unsigned threadCount)
+{
+	cerr << "replay/parallel_parsing: " << path << " threads=" << threadCount << "\n";
+	NullStreamBuf nullBuffer;
+	ostream output(&nullBuffer);
+	BookingService service;
+	ParallelQueryParser parser(service, threadCount);
+
+	const auto beginTime = steady_clock::now();
+	parser.Run(path, output);
+	const nanoseconds duration = steady_clock::now() - beginTime;
+
+	const auto inputSize = filesystem::file_size(path);
+	ReportLine line;
+	line.Add("suite", "replay")
+		.Add("mode", "parallel_parsing")
+		.Add("reader", "mmap")
+		.Add("threads", threadCount)
+		.Add("bytes", inputSize)
+		.Add("duration_ms", duration_cast<milliseconds>(duration).count())
+		.Add("mb_per_sec", GetOperationsPerSecond(inputSize, duration) / (1024 * 1024));
+	report << line.str() << "\n";
+}
+#ifdef __linux__
+// Reads and writes pipes as stdin and stdout of a process driven by a frontend do
+class PipeStreamBuf : public streambuf
+{
+public:
+	PipeStreamBuf(int inputFd, int outputFd)
+		: m_inputFd(inputFd)
+		, m_outputFd(outputFd)
+	{
+		setp(m_output, m_output + sizeof(m_output));
+	}
+
+protected:
+	// Returns what a single read gets, as a file stream buffer does
+	int_type underflow() override
+	{
+		ssize_t size;
+		while ((size = ::read(m_inputFd, m_input, sizeof(m_input))) < 0 && errno == EINTR)
+		{
+		}
+		if (size <= 0)
+		{
+			return traits_type::eof();
+		}
+		setg(m_input, m_input, m_input + size);
+		return traits_type::to_int_type(*gptr());
+	}
+
+	int_type overflow(int_type ch) override
+	{
+		if (sync() != 0)
+		{
+			return traits_type::eof();
+		}
+		if (!traits_type::eq_int_type(ch, traits_type::eof()))
+		{
+			*pptr() = traits_type::to_char_type(ch);
+			pbump(1);
+		}
+		return traits_type::not_eof(ch);
+	}
+
+	int sync() override
+	{
+		for (auto data = pbase(); data != pptr();)
+		{
+			const auto size = ::write(m_outputFd, data, pptr() - data);
+			if (size < 0 && errno != EINTR)
+			{
+				return -1;
+			}
+			data += size < 0 ? 0 : size;
+		}
+		setp(m_output, m_output + sizeof(m_output));
+		return 0;
+	}
+
+private:
+	int m_inputFd;
+	int m_outputFd;
+	char m_input[64 * 1024];
+	char m_output[64 * 1024];
+};
+
+void WriteAll(int fd, const string& text)
+{
+	for (size_t written = 0; written < text.size();)
+	{
+		const auto size = ::write(fd, text.data() + written, text.size() - written);
+		if (size < 0 && errno != EINTR)
+		{
+			throw runtime_error("Can't write the query pipe");
+		}
+		written += size < 0 ? 0 : static_cast<size_t>(size);
+	}
+}
+
+// Sends a query and waits for its answer over pipes, as a frontend does, and reports round-trip latencies
+void RunPingPong(ostream& report, const char* flush, unsigned roundTripCount, const StreamOptions& options)
+{
+	const unsigned hotelCount = 1'000;
+	cerr << "interactive/" << flush << ": round_trips=" << roundTripCount << "\n";
+	int queryPipe[2];
+	int answerPipe[2];
+	if (::pipe(queryPipe) != 0 || ::pipe(answerPipe) != 0)
+	{
+		throw runtime_error("Can't create pipes");
+	}
+
+	BookingService service;
+	PipeStreamBuf uiBuffer(queryPipe[0], answerPipe[1]);
+	istream uiInput(&uiBuffer);
+	ostream uiOutput(&uiBuffer);
+	UserInterface ui(uiInput, uiOutput, service);
+	thread uiThread([&] { ui.RunStream(options); });
+
+	LatencyHistogram latencies;
+	// Closing the query pipe ends the stream
+	const auto stopUi = [&] {
+		::close(queryPipe[1]);
+		uiThread.join();
+		::close(queryPipe[0]);
+		::close(answerPipe[0]);
+		::close(answerPipe[1]);
+	};
+	try
+	{
+		const auto hotels = GenerateHotels(hotelCount);
+		const auto clients = GenerateClientIds(20'000);
+		mt19937 gen(5);
+		string queries;
+		for (unsigned i = 0; i < hotelCount * 10; ++i)
+		{
+			queries += "BOOK " + to_string(i) + " " + hotels[i % hotelCount] + " " + to_string(clients[gen() % clients.size()]) + " 1\n";
+		}
+		WriteAll(queryPipe[1], queries);
+
+		char answer[64];
+		for (unsigned i = 0; i < roundTripCount; ++i)
+		{
+			const auto query = (i % 2 == 0 ? "ROOMS "s : "CLIENTS "s) + hotels[gen() % hotelCount] + "\n";
+			const auto beginTime = steady_clock::now();
+			WriteAll(queryPipe[1], query);
+			for (size_t size = 0; size == 0 || answer[size - 1] != '\n';)
+			{
+				const auto readSize = ::read(answerPipe[0], answer + size, sizeof(answer) - size);
+				if (readSize == 0 || (readSize < 0 && errno != EINTR))
+				{
+					throw runtime_error("Can't read the answer pipe");
+				}
+				size += readSize < 0 ? 0 : static_cast<size_t>(readSize);
+			}
+			latencies.Record(static_cast<uint64_t>(duration_cast<nanoseconds>(steady_clock::now() - beginTime).count()));
+		}
+	}
+	catch (...)
+	{
+		stopUi();
+		throw;
+	}
+	stopUi();
+
+	ReportLine line;
+	line.Add("suite", "interactive")
+		.Add("flush", flush)
+		.AddLatencies(latencies);
+	report << line.str() << "\n";
+}
+#endif
+} // namespace
+
+void RunUserInterfaceBenchmarks(ostream& report, unsigned lineCount)
+{
+	RunInput(report, "mixed", lineCount, 0.5);
+	RunInput(report, "book_only", lineCount, 1.0);
+	RunInput(report, "read_mostly", lineCount, 0.1);
+	StreamOptions options;
+	RunStream(report, "stream_batched", lineCount, options);
+	options.flushEveryAnswer = true;
+	RunStream(report, "stream_every_answer", lineCount, options);
+}
+
+void RunReplayBenchmarks(ostream& report, unsigned lineCount, const string& path)
+{
+	auto replayPath = path;
+	if (path.empty())
+	{
+		replayPath = (filesystem::temp_directory_path() / "HotelBookingBenchmark.replay").string();
+		cerr << "replay: generating " << lineCount << " lines\n";
+		ofstream file(replayPath, ios::binary);
+		GenerateInput(file, lineCount, 1'000, 20'000, 0.5);
+	}
+	// The file is likely cached after generation or the first pass. Drop the page cache between runs to measure the disk
+	for (auto reader : { "iostream", "read", "io_uring" })
+	{
+		ReplayFile(report, replayPath, reader);
+	}
+	for (unsigned threadCount : { 1, 2, 4, 8 })
+	{
+		ReplayFileInParallel(report, replayPath, threadCount);
+	}
+	for (unsigned threadCount : { 1, 2, 4, 8 })
+	{
+		ReplayFileParsingInParallel(report, replayPath, threadCount);
+	}
+	if (path.empty())
+	{
+		filesystem::remove(replayPath);
+	}
+}
+
+void RunInteractiveBenchmarks(ostream& report, unsigned roundTripCount)
+{
+#ifdef __linux__
+	StreamOptions options;
+	options.flushEveryAnswer = true;
+	RunPingPong(report, "every_answer", roundTripCount, options);
+	RunPingPong(report, "batched", roundTripCount, StreamOptions());
+#else
+	(void)report;
+	(void)roundTripCount;
+	cerr << "interactive: pipes are only supported on Linux\n";
+#endif
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <iosfwd>
+#include <string>
+
+// Feeds a generated BOOK/CLIENTS/ROOMS query stream through UserInterface::Run
+// into a discarding output stream and reports lines/sec and MB/s.
+// The stream_* scenarios feed it through UserInterface::RunStream flushing batches or every answer
+void RunUserInterfaceBenchmarks(std::ostream& report, unsigned lineCount);
+
+// Replays a query log file through UserInterface::Run reading it with an ifstream, plain reads and io_uring,
+// through ParallelReplay and through ParallelQueryParser on 1 to 8 threads ("threads" is 0 for UserInterface::Run).
+// A mixed N-line log is generated in the temporary directory if path is empty
+void RunReplayBenchmarks(std::ostream& report, unsigned lineCount, const std::string& path);
+
+// Drives UserInterface::RunStream over pipes sending a CLIENTS or ROOMS query and waiting for its answer N times,
+// flushing every answer and batching answers, and reports round-trip latency percentiles (Linux only)
+void RunInteractiveBenchmarks(std::ostream& report, unsigned roundTripCount);
@@ -0,0 +1,94 @@
+#include "ContentionBenchmark.h"
+#include "ServiceBenchmark.h"
+#include "UserInterfaceBenchmark.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+Usage: HotelBookingBenchmark [--operations N] [--lines N] [--file PATH] [suite...]
+Suites:
+	service - BookingService alone, N operations per workload (default)
+	sharded - ShardedBookingEngine with 1 to 8 shard and producer thread pairs, N operations each
+	contention - a single hotel booked by 1 to 8 threads under a mutex, through flat combining
+		and into partial windows, N bookings each
+	ui - UserInterface::Run and UserInterface::RunStream over a generated N-line input
+	interactive - N round trips of a query and its answer over pipes through UserInterface::RunStream (Linux only)
+	replay - UserInterface::Run over the query log at PATH (a generated N-line one by default)
+		read with an ifstream, plain reads and io_uring, and through ParallelReplay and ParallelQueryParser on 1 to 8 threads
+Progress is written to stderr, the report (one JSON object per line) to stdout.
+*/
+int main(int argc, char* argv[])
+{
+	using namespace std;
+
+	try
+	{
+		unsigned operationCount = 500'000;
+		unsigned lineCount = 2'000'000;
+		string replayPath;
+		vector<string> suites;
+		for (int i = 1; i < argc; ++i)
+		{
+			const string arg = argv[i];
+			if (arg == "--operations" && i + 1 < argc)
+			{
+				operationCount = stoul(argv[++i]);
+			}
+			else if (arg == "--lines" && i + 1 < argc)
+			{
+				lineCount = stoul(argv[++i]);
+			}
+			else if (arg == "--file" && i + 1 < argc)
+			{
+				replayPath = argv[++i];
+			}
+			else
+			{
+				suites.push_back(arg);
+			}
+		}
+		if (suites.empty())
+		{
+			suites = { "service" };
+		}
+
+		for (auto& suite : suites)
+		{
+			if (suite == "service")
+			{
+				RunServiceBenchmarks(cout, operationCount);
+			}
+			else if (suite == "sharded")
+			{
+				RunShardedBenchmarks(cout, operationCount);
+			}
+			else if (suite == "contention")
+			{
+				RunContentionBenchmarks(cout, operationCount);
+			}
+			else if (suite == "ui")
+			{
+				RunUserInterfaceBenchmarks(cout, lineCount);
+			}
+			else if (suite == "interactive")
+			{
+				RunInteractiveBenchmarks(cout, operationCount);
+			}
+			else if (suite == "replay")
+			{
+				RunReplayBenchmarks(cout, lineCount, replayPath);
+			}
+			else
+			{
+				throw invalid_argument("Unknown benchmark suite " + suite);
+			}
+		}
+		return EXIT_SUCCESS;
+	}
+	catch (const exception& e)
+	{
+		cerr << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+}
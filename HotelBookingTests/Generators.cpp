@@ -0,0 +1,38 @@
+#include "Generators.h"
+#include <random>
+
+using namespace std;
+
+vector<string> GenerateHotels(unsigned count)
+{
+	const auto alphabet = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ01234567890"s;
+	vector<string> hotels;
+	hotels.reserve(count);
+	uniform_int_distribution<size_t> dist(0, alphabet.size() - 1);
+	mt19937 gen(1);
+	const size_t hotelNameSize = 12;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		string name;
+		name.reserve(hotelNameSize);
+		for (unsigned j = 0; j < hotelNameSize; ++j)
+		{
+			name += alphabet[dist(gen)];
+		}
+		hotels.push_back(name);
+	}
+	return hotels;
+}
+
+vector<ClientId> GenerateClientIds(unsigned count)
+{
+	vector<ClientId> clients;
+	clients.reserve(count);
+	uniform_int_distribution<unsigned> dist(1, 999'999'999);
+	mt19937 gen(2);
+	for (unsigned i = 0; i < count; ++i)
+	{
+		clients.push_back(dist(gen));
+	}
+	return clients;
+}
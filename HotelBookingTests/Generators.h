@@ -0,0 +1,10 @@
+#pragma once
+#include "../HotelBooking/HotelBookings.h"
+#include <string>
+#include <vector>
+
+// Deterministic pseudo-random data shared by the tests and benchmarks
+
+std::vector<std::string> GenerateHotels(unsigned count);
+
+std::vector<ClientId> GenerateClientIds(unsigned count);
@@ -1,12 +1,31 @@
+#include "../HotelBooking/AsyncBookingService.h"
 #include "../HotelBooking/BookingService.h"
+#include "../HotelBooking/CombiningHotelBookings.h"
+#include "../HotelBooking/FileReader.h"
+#include "../HotelBooking/HotHotelBookings.h"
+#include "../HotelBooking/LatencyHistogram.h"
+#include "../HotelBooking/ParallelQueryParser.h"
+#include "../HotelBooking/ParallelReplay.h"
+#include "../HotelBooking/QueryServer.h"
+#include "../HotelBooking/ShardedBookingEngine.h"
 #include "../HotelBooking/UserInterface.h"
+#include "Generators.h"
 
 #include "catch2/catch.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#ifdef __cpp_impl_coroutine
+#include <latch>
+#endif
+#include <map>
 #include <random>
 #include <sstream>
+#include <thread>
 
 using namespace std;
 using namespace std::chrono;
@@ -53,6 +72,285 @@ SCENARIO("Hotel bookings")
 	CHECK(bookings.GetBookedRoomCount() == 3);
 }
 
+SCENARIO("Hotel bookings within time range")
+{
+	const Time timeSpan = 10;
+	HotelBookings bookings(timeSpan);
+	CHECK(bookings.GetBookedRoomCount(0, 100) == 0);
+
+	bookings.Book(1, 1, 10);
+	bookings.Book(3, 2, 20);
+	bookings.Book(3, 3, 30);
+	bookings.Book(7, 1, 40);
+	CHECK(bookings.GetBookedRoomCount(1, 7) == 100);
+	CHECK(bookings.GetBookedRoomCount(-100, 100) == 100);
+	CHECK(bookings.GetBookedRoomCount(3, 3) == 50);
+	CHECK(bookings.GetBookedRoomCount(2, 6) == 50);
+	CHECK(bookings.GetBookedRoomCount(4, 6) == 0);
+	CHECK(bookings.GetBookedRoomCount(7, 1) == 0);
+
+	// Bookings at 1 and 3 leave the time span
+	bookings.Book(13, 2, 5);
+	CHECK(bookings.GetBookedRoomCount() == 45);
+	CHECK(bookings.GetBookedRoomCount(0, 13) == 45);
+	CHECK(bookings.GetBookedRoomCount(0, 12) == 40);
+	CHECK(bookings.GetBookedRoomCount(8, 13) == 5);
+}
+
+SCENARIO("Hotel bookings within several time spans")
+{
+	HotelBookings bookings({ 10, 2, 5 });
+	bookings.Book(0, 1, 1);
+	bookings.Book(1, 2, 10);
+	bookings.Book(3, 1, 100);
+	CHECK(bookings.GetBookedRoomCount(0) == 111);
+	CHECK(bookings.GetBookedRoomCount(1) == 100);
+	CHECK(bookings.GetBookedRoomCount(2) == 111);
+	CHECK(bookings.GetDistinctClientCount(0) == 2);
+	CHECK(bookings.GetDistinctClientCount(1) == 1);
+	CHECK(bookings.GetDistinctClientCount(2) == 2);
+	CHECK(bookings.GetBookingCount() == 3);
+
+	bookings.Book(6, 3, 1000);
+	CHECK(bookings.GetBookedRoomCount(0) == 1111);
+	CHECK(bookings.GetBookedRoomCount(1) == 1000);
+	CHECK(bookings.GetBookedRoomCount(2) == 1100);
+	CHECK(bookings.GetDistinctClientCount(0) == 3);
+	CHECK(bookings.GetDistinctClientCount(1) == 1);
+	CHECK(bookings.GetDistinctClientCount(2) == 2);
+	// History is retained for the longest time span
+	CHECK(bookings.GetBookingCount() == 4);
+	CHECK(bookings.GetBookedRoomCount(0, 6) == 1111);
+
+	bookings.Book(12, 1, 10000);
+	CHECK(bookings.GetBookedRoomCount(0) == 11100);
+	CHECK(bookings.GetBookedRoomCount(1) == 10000);
+	CHECK(bookings.GetBookedRoomCount(2) == 10000);
+	CHECK(bookings.GetDistinctClientCount(0) == 2);
+	CHECK(bookings.GetBookingCount() == 3);
+}
+
+SCENARIO("Late hotel bookings")
+{
+	BookingHistoryOptions rejectingOptions;
+	rejectingOptions.maxLateness = 3;
+	rejectingOptions.rejectTooLate = true;
+	HotelBookings bookings({ 10, 2 }, nullptr, rejectingOptions);
+	bookings.Book(5, 1, 1);
+	bookings.Book(8, 2, 10);
+	bookings.Book(6, 3, 100);
+	CHECK(bookings.GetBookedRoomCount(0) == 111);
+	CHECK(bookings.GetBookedRoomCount(1) == 10);
+	CHECK(bookings.GetDistinctClientCount(0) == 3);
+	CHECK(bookings.GetDistinctClientCount(1) == 1);
+	CHECK(bookings.GetBookingCount(1) == 1);
+	CHECK(bookings.GetBookedRoomCount(6, 7) == 100);
+	CHECK(bookings.GetBookedRoomCount(0, 6) == 101);
+	CHECK_THROWS_AS(bookings.Book(4, 4, 1000), std::invalid_argument);
+	CHECK(bookings.GetBookedRoomCount(0) == 111);
+
+	// Eviction follows the time order of bookings rather than their arrival order
+	bookings.Book(16, 1, 1000);
+	CHECK(bookings.GetBookedRoomCount(0) == 1010);
+	CHECK(bookings.GetBookedRoomCount(1) == 1000);
+	CHECK(bookings.GetDistinctClientCount(0) == 2);
+
+	WHEN("a booking is later than the lateness bound")
+	{
+		// It is made at the time of the latest booking by default
+		HotelBookings tolerant({ 10 }, nullptr, { 3 });
+		tolerant.Book(5, 1, 1);
+		tolerant.Book(8, 2, 10);
+		tolerant.Book(1, 3, 100);
+		CHECK(tolerant.GetBookedRoomCount() == 111);
+		CHECK(tolerant.GetBookedRoomCount(8, 8) == 110);
+
+		// The latest booking time is kept after all bookings leave the history,
+		// while the bookings are counted in the windows advanced past it
+		tolerant.AdvanceTime(100);
+		REQUIRE(tolerant.GetBookingCount() == 0);
+		CHECK(tolerant.GetEvictedBookingCount() == 3);
+		tolerant.Book(2, 4, 1000);
+		CHECK(tolerant.GetEvictedBookingCount() == 4);
+		CHECK(tolerant.GetBookedRoomCount() == 0);
+		bookings.AdvanceTime(100);
+		REQUIRE(bookings.GetBookingCount() == 0);
+		CHECK_THROWS_AS(bookings.Book(12, 4, 1000), std::invalid_argument);
+		bookings.Book(14, 4, 1000);
+		CHECK(bookings.GetBookedRoomCount(0) == 0);
+		CHECK(bookings.GetDistinctClientCount(0) == 0);
+		CHECK(bookings.GetBookingCount() == 0);
+	}
+
+	WHEN("bookings arrive shuffled within the lateness bound")
+	{
+		const std::vector<Time> timeSpans = { 50, 7, 20 };
+		const Time maxLateness = 10;
+		HotelBookings inOrder(timeSpans);
+		HotelBookings outOfOrder(timeSpans, nullptr, { maxLateness });
+
+		struct Event
+		{
+			Time arrival;
+			Time time;
+			ClientId clientId;
+			RoomCount roomCount;
+		};
+		mt19937 gen(5);
+		uniform_int_distribution<Time> randDelay(0, maxLateness);
+		uniform_int_distribution<ClientId> randClient(1, 20);
+		uniform_int_distribution<RoomCount> randRoomCount(1, 100);
+		vector<Event> events;
+		for (Time time = 0; time < 1000; time += 3)
+		{
+			// An event arriving after another one is at most maxLateness earlier than it
+			events.push_back({ time + randDelay(gen), time, randClient(gen), randRoomCount(gen) });
+		}
+		for (auto& event : events)
+		{
+			inOrder.Book(event.time, event.clientId, event.roomCount);
+		}
+		stable_sort(events.begin(), events.end(), [](const Event& lhs, const Event& rhs) { return lhs.arrival < rhs.arrival; });
+		for (auto& event : events)
+		{
+			outOfOrder.Book(event.time, event.clientId, event.roomCount);
+		}
+
+		for (size_t spanIndex = 0; spanIndex < timeSpans.size(); ++spanIndex)
+		{
+			CHECK(outOfOrder.GetBookedRoomCount(spanIndex) == inOrder.GetBookedRoomCount(spanIndex));
+			CHECK(outOfOrder.GetDistinctClientCount(spanIndex) == inOrder.GetDistinctClientCount(spanIndex));
+			CHECK(outOfOrder.GetBookingCount(spanIndex) == inOrder.GetBookingCount(spanIndex));
+		}
+		for (Time from = 940; from < 1000; from += 7)
+		{
+			CHECK(outOfOrder.GetBookedRoomCount(from, from + 11) == inOrder.GetBookedRoomCount(from, from + 11));
+		}
+	}
+}
+
+SCENARIO("Point-in-time hotel statistics")
+{
+	const std::vector<Time> timeSpans = { 10, 3 };
+	const Time retentionHorizon = 100;
+	HotelBookings bookings(timeSpans, nullptr, { 0, retentionHorizon });
+	CHECK(bookings.GetBookedRoomCountAt(5) == 0);
+	CHECK_THROWS_AS(HotelBookings(timeSpans).GetBookedRoomCountAt(5), std::logic_error);
+
+	// Statistics reported after the latest booking made at every time
+	struct Statistics
+	{
+		RoomCount rooms[2];
+		size_t clients[2];
+	};
+	std::map<Time, Statistics> reported;
+	mt19937 gen(7);
+	uniform_int_distribution<Time> randTimeDelta(0, 3);
+	uniform_int_distribution<ClientId> randClient(1, 5);
+	uniform_int_distribution<RoomCount> randRoomCount(1, 100);
+	Time time = 0;
+	for (int i = 0; i < 300; ++i)
+	{
+		time += randTimeDelta(gen);
+		bookings.Book(time, randClient(gen), randRoomCount(gen));
+		reported[time] = { { bookings.GetBookedRoomCount(0), bookings.GetBookedRoomCount(1) },
+			{ bookings.GetDistinctClientCount(0), bookings.GetDistinctClientCount(1) } };
+	}
+
+	// Bookings within the longest time span before the retention horizon are retained
+	for (Time asOf = time - retentionHorizon + timeSpans[0]; asOf <= time + 1; ++asOf)
+	{
+		auto it = std::prev(reported.upper_bound(asOf));
+		for (size_t spanIndex = 0; spanIndex < timeSpans.size(); ++spanIndex)
+		{
+			CHECK(bookings.GetBookedRoomCountAt(asOf, spanIndex) == it->second.rooms[spanIndex]);
+			CHECK(bookings.GetDistinctClientCountAt(asOf, spanIndex) == it->second.clients[spanIndex]);
+		}
+	}
+	CHECK_THROWS_AS(bookings.GetBookedRoomCountAt(time - retentionHorizon), std::out_of_range);
+	CHECK_THROWS_AS(bookings.GetDistinctClientCountAt(0), std::out_of_range);
+}
+
+SCENARIO("Cancelled hotel bookings")
+{
+	BookingHistoryOptions options;
+	options.maxLateness = 5;
+	options.cancellable = true;
+	HotelBookings bookings({ 10, 3 }, nullptr, options);
+	const auto first = bookings.Book(0, 1, 1, nullptr, 1);
+	const auto second = bookings.Book(2, 2, 10, nullptr, 2);
+	bookings.Book(4, 1, 100, nullptr, 3);
+	REQUIRE(first);
+	REQUIRE(second);
+	bookings.Cancel(*second);
+	CHECK(bookings.GetBookedRoomCount(0) == 101);
+	CHECK(bookings.GetBookedRoomCount(1) == 100);
+	CHECK(bookings.GetDistinctClientCount(0) == 1);
+	CHECK(bookings.GetBookingCount() == 2);
+	CHECK(bookings.GetBookingCount(0) == 2);
+	CHECK(bookings.GetBookingCount(1) == 1);
+	CHECK(bookings.GetBookedRoomCount(1, 4) == 100);
+
+	// A late booking is inserted before the tombstone
+	bookings.Book(1, 3, 1000, nullptr, 4);
+	CHECK(bookings.GetBookedRoomCount(0, 2) == 1001);
+	bookings.Cancel(*first);
+	CHECK(bookings.GetBookedRoomCount(0) == 1100);
+	CHECK(bookings.GetBookedRoomCount(0, 4) == 1100);
+
+	// Tombstones are evicted without touching statistics
+	bookings.Book(12, 4, 10000, nullptr, 5);
+	CHECK(bookings.GetBookedRoomCount(0) == 10100);
+	CHECK(bookings.GetDistinctClientCount(0) == 2);
+	CHECK(bookings.GetBookingCount() == 2);
+	CHECK(bookings.GetBookingCount(1) == 1);
+
+	WHEN("cancelled bookings are compared to bookings never made")
+	{
+		const std::vector<Time> timeSpans = { 50, 7, 20 };
+		HotelBookings cancelled(timeSpans, nullptr, options);
+		HotelBookings skipped(timeSpans);
+		mt19937 gen(11);
+		uniform_int_distribution<ClientId> randClient(1, 20);
+		uniform_int_distribution<RoomCount> randRoomCount(1, 100);
+		bernoulli_distribution randCancel(0.3);
+		bool cancelsPrevious = false;
+		std::uint64_t previousSequence = 0;
+		BookingId id = 0;
+		for (Time time = 0; time < 1000; time += 3)
+		{
+			const auto clientId = randClient(gen);
+			const auto roomCount = randRoomCount(gen);
+			const auto sequence = cancelled.Book(time, clientId, roomCount, nullptr, ++id);
+			if (cancelsPrevious)
+			{
+				// The previous booking is still within the longest time span
+				cancelled.Cancel(previousSequence);
+			}
+			REQUIRE(sequence);
+			previousSequence = *sequence;
+			cancelsPrevious = randCancel(gen) && time + 3 < 1000;
+			if (!cancelsPrevious)
+			{
+				skipped.Book(time, clientId, roomCount);
+			}
+			// Ranges skip the booking which may be cancelled next
+			CHECK(cancelled.GetBookedRoomCount(time - 30, time - 1) == skipped.GetBookedRoomCount(time - 30, time - 1));
+		}
+
+		for (size_t spanIndex = 0; spanIndex < timeSpans.size(); ++spanIndex)
+		{
+			CHECK(cancelled.GetBookedRoomCount(spanIndex) == skipped.GetBookedRoomCount(spanIndex));
+			CHECK(cancelled.GetDistinctClientCount(spanIndex) == skipped.GetDistinctClientCount(spanIndex));
+			CHECK(cancelled.GetBookingCount(spanIndex) == skipped.GetBookingCount(spanIndex));
+		}
+		for (Time from = 940; from < 1000; from += 7)
+		{
+			CHECK(cancelled.GetBookedRoomCount(from, from + 11) == skipped.GetBookedRoomCount(from, from + 11));
+		}
+	}
+}
+
 SCENARIO("Booking Service tests")
 {
 	const Time timeSpan = 5;
@@ -76,6 +374,480 @@ SCENARIO("Booking Service tests")
 	CHECK(service.GetDistinctClientCount(hotel1) == 1);
 	CHECK(service.GetBookedRoomCount(hotel2) == 0);
 	CHECK(service.GetDistinctClientCount(hotel2) == 0);
+
+	service.Book(2, hotel1, client1, 4);
+	CHECK(service.GetBookedRoomCount(hotel1, 1, 2) == 4);
+	CHECK(service.GetBookedRoomCount(hotel1, 0, 2) == 7);
+	CHECK(service.GetBookedRoomCount(hotel2, 0, 2) == 0);
+	CHECK(service.GetBookedRoomCount(hotel1, size_t(0)) == 7);
+	CHECK_THROWS_AS(service.GetBookedRoomCount(hotel1, size_t(1)), std::out_of_range);
+	CHECK_THROWS_AS(BookingService(vector<Time>{}), std::invalid_argument);
+
+	WHEN("there are several time spans")
+	{
+		BookingService multiSpanService({ 60 * 60, 24 * 60 * 60 });
+		multiSpanService.Book(0, hotel1, client1, 1);
+		multiSpanService.Book(2 * 60 * 60, hotel1, client2, 2);
+		CHECK(multiSpanService.GetBookedRoomCount(hotel1) == 2);
+		CHECK(multiSpanService.GetBookedRoomCount(hotel1, 0) == 2);
+		CHECK(multiSpanService.GetBookedRoomCount(hotel1, 1) == 3);
+		CHECK(multiSpanService.GetDistinctClientCount(hotel1, 0) == 1);
+		CHECK(multiSpanService.GetDistinctClientCount(hotel1, 1) == 2);
+		CHECK(multiSpanService.GetDistinctClientCount(hotel3, 1) == 0);
+		CHECK_THROWS_AS(multiSpanService.GetDistinctClientCount(hotel1, 2), std::out_of_range);
+	}
+
+	WHEN("bookings arrive late")
+	{
+		BookingServiceOptions options;
+		options.statisticTimeSpans = { 10 };
+		options.maxLateness = 5;
+		options.rejectTooLate = true;
+		options.indexClientHotels = true;
+		BookingService lateService(options);
+		lateService.Book(10, hotel1, client1, 1);
+		lateService.Book(20, hotel1, client2, 2);
+		CHECK(lateService.GetClientHotelCount(client1) == 0);
+		lateService.Book(15, hotel1, client1, 4);
+		CHECK(lateService.GetBookedRoomCount(hotel1) == 6);
+		CHECK(lateService.GetTotalBookedRoomCount() == 6);
+		CHECK(lateService.GetTotalBookingCount() == 2);
+		CHECK(lateService.GetClientHotelCount(client1) == 1);
+		CHECK_THROWS_AS(lateService.Book(14, hotel1, client3, 8), std::invalid_argument);
+		CHECK(lateService.GetTotalBookedRoomCount() == 6);
+		// The lateness is measured against the latest booking of the same hotel
+		lateService.Book(0, hotel2, client3, 8);
+		CHECK(lateService.GetTotalBookedRoomCount() == 14);
+	}
+
+	WHEN("totals over all hotels are queried")
+	{
+		BookingService totalService({ 10, 100 });
+		CHECK(totalService.GetTotalBookedRoomCount() == 0);
+		CHECK(totalService.GetTotalBookingCount() == 0);
+		totalService.Book(0, hotel1, client1, 1);
+		totalService.Book(5, hotel2, client2, 2);
+		totalService.Book(12, hotel1, client3, 4);
+		CHECK(totalService.GetTotalBookedRoomCount() == 6);
+		CHECK(totalService.GetTotalBookingCount() == 2);
+		CHECK(totalService.GetTotalBookedRoomCount(1) == 7);
+		CHECK(totalService.GetTotalBookingCount(1) == 3);
+		totalService.Book(200, hotel2, client4, 8);
+		CHECK(totalService.GetTotalBookedRoomCount() == 12);
+		CHECK(totalService.GetTotalBookingCount() == 2);
+		CHECK(totalService.GetTotalBookedRoomCount(1) == 13);
+		CHECK(totalService.GetTotalBookingCount(1) == 3);
+		CHECK_THROWS_AS(totalService.GetTotalBookingCount(2), std::out_of_range);
+	}
+
+	WHEN("bookings are cancelled")
+	{
+		BookingServiceOptions options;
+		options.statisticTimeSpans = { timeSpan, 100 };
+		options.maxLateness = 5;
+		options.indexClientHotels = true;
+		options.cancellable = true;
+		BookingService cancellableService(options);
+		CHECK_THROWS_AS(service.Cancel(1), std::logic_error);
+
+		const auto id1 = cancellableService.Book(0, hotel1, client1, 1);
+		const auto id2 = cancellableService.Book(2, hotel1, client2, 2);
+		const auto id3 = cancellableService.Book(3, hotel2, client1, 4);
+		CHECK(id1 == 1);
+		CHECK(id3 == 3);
+		CHECK(cancellableService.Cancel(id2));
+		CHECK_FALSE(cancellableService.Cancel(id2));
+		CHECK_FALSE(cancellableService.Cancel(100));
+		CHECK(cancellableService.GetBookedRoomCount(hotel1) == 1);
+		CHECK(cancellableService.GetDistinctClientCount(hotel1) == 1);
+		CHECK(cancellableService.GetBookedRoomCount(hotel1, 0, 10) == 1);
+		CHECK(cancellableService.GetTotalBookedRoomCount() == 5);
+		CHECK(cancellableService.GetTotalBookingCount(1) == 2);
+		CHECK(cancellableService.GetClientHotelCount(client2) == 0);
+
+		// A late booking moves the bookings made after it
+		cancellableService.Book(1, hotel2, client3, 8);
+		cancellableService.Book(0, hotel2, client4, 16);
+		CHECK(cancellableService.Cancel(id3));
+		CHECK(cancellableService.GetBookedRoomCount(hotel2) == 24);
+		CHECK(cancellableService.GetClientHotelCount(client1) == 1);
+
+		// Bookings can't be cancelled once they leave the booking history
+		cancellableService.Book(200, hotel1, client1, 32);
+		CHECK_FALSE(cancellableService.Cancel(id1));
+		CHECK(cancellableService.GetBookedRoomCount(hotel1) == 32);
+		// The bookings of the other hotel stay until it gets a later booking
+		CHECK(cancellableService.GetTotalBookedRoomCount(1) == 56);
+	}
+}
+
+SCENARIO("Top hotels by booked rooms")
+{
+	const Time timeSpan = 5;
+	const auto hotel1 = "Hilton"s;
+	const auto hotel2 = "Radisoon"s;
+	const auto hotel3 = "HolidayInn"s;
+
+	CHECK_THROWS_AS(BookingService(timeSpan).GetTopHotels(1), std::logic_error);
+
+	BookingServiceOptions options;
+	options.statisticTimeSpans = { timeSpan };
+	options.rankHotels = true;
+	BookingService service(options);
+	CHECK(service.GetTopHotels(10).empty());
+
+	auto topHotelNames = [&service](size_t count) {
+		vector<string> names;
+		for (auto& hotel : service.GetTopHotels(count))
+		{
+			CHECK(hotel.roomCount == service.GetBookedRoomCount(hotel.hotelName));
+			names.push_back(hotel.hotelName);
+		}
+		return names;
+	};
+
+	service.Book(0, hotel1, 1, 10);
+	service.Book(1, hotel2, 1, 20);
+	service.Book(2, hotel3, 1, 5);
+	CHECK(topHotelNames(10) == vector{ hotel2, hotel1, hotel3 });
+	CHECK(topHotelNames(2) == vector{ hotel2, hotel1 });
+	CHECK(topHotelNames(0).empty());
+
+	service.Book(3, hotel3, 2, 10);
+	CHECK(topHotelNames(10) == vector{ hotel2, hotel3, hotel1 });
+
+	// Hotels with equal room counts are ordered by name
+	service.Book(4, hotel1, 2, 5);
+	CHECK(topHotelNames(10) == vector{ hotel2, hotel1, hotel3 });
+
+	// Bookings at 0 and 1 leave the time spans of Hilton and Radisoon
+	service.Book(6, hotel1, 3, 1);
+	service.Book(7, hotel2, 3, 1);
+	CHECK(topHotelNames(10) == vector{ hotel3, hotel1, hotel2 });
+	CHECK(service.GetMemoryUsage().hotelRanking.blocks == 3);
+}
+
+SCENARIO("Hotels booked by a client")
+{
+	const Time timeSpan = 5;
+	const auto hotel1 = "Hilton"s;
+	const auto hotel2 = "Radisoon"s;
+	const auto hotel3 = "HolidayInn"s;
+	const ClientId client1 = 34;
+	const ClientId client2 = 443;
+
+	CHECK_THROWS_AS(BookingService(timeSpan).GetClientHotelCount(client1), std::logic_error);
+
+	BookingServiceOptions options;
+	options.statisticTimeSpans = { timeSpan, 100 };
+	options.indexClientHotels = true;
+	BookingService service(options);
+	CHECK(service.GetClientHotelCount(client1) == 0);
+	CHECK(service.GetClientHotels(client1).empty());
+
+	auto sortedClientHotels = [&service](ClientId clientId) {
+		auto hotels = service.GetClientHotels(clientId);
+		sort(hotels.begin(), hotels.end());
+		return hotels;
+	};
+
+	service.Book(0, hotel1, client1, 1);
+	service.Book(1, hotel2, client1, 1);
+	service.Book(2, hotel1, client1, 1);
+	service.Book(2, hotel3, client2, 1);
+	CHECK(service.GetClientHotelCount(client1) == 2);
+	CHECK(sortedClientHotels(client1) == vector{ hotel1, hotel2 });
+	CHECK(sortedClientHotels(client2) == vector{ hotel3 });
+	CHECK(service.GetMemoryUsage().clientHotelIndex.blocks > 0);
+
+	// The booking at 0 leaves the time span of Hilton, but the client still has the booking at 2 there
+	service.Book(5, hotel1, client2, 1);
+	CHECK(sortedClientHotels(client1) == vector{ hotel1, hotel2 });
+	CHECK(sortedClientHotels(client2) == vector{ hotel1, hotel3 });
+
+	// Only the first time span is indexed
+	service.Book(7, hotel1, client2, 1);
+	service.Book(8, hotel2, client2, 1);
+	CHECK(service.GetClientHotelCount(client1) == 0);
+	CHECK(service.GetDistinctClientCount(hotel1, 1) == 2);
+	CHECK(sortedClientHotels(client2) == vector{ hotel1, hotel3, hotel2 });
+}
+
+SCENARIO("Hotels without bookings are compacted")
+{
+	const auto hotel1 = "Hilton"s;
+	const auto hotel2 = "Radisoon"s;
+	const auto hotel3 = "HolidayInn"s;
+
+	// Bookings leave an empty time span as soon as they are made
+	BookingServiceOptions options;
+	options.statisticTimeSpans = { 0 };
+	options.rankHotels = true;
+	options.compactHotels = false;
+	BookingService service(options);
+	service.Book(0, hotel1, 1, 1);
+	service.Book(0, hotel2, 1, 1);
+	CHECK(service.GetMemoryUsage().hotelCount == 2);
+	CHECK(service.CompactHotels() == 2);
+	CHECK(service.GetMemoryUsage().hotelCount == 0);
+	CHECK(service.GetBookedRoomCount(hotel1) == 0);
+	CHECK(service.GetTopHotels(10).empty());
+
+	WHEN("hotels are compacted while booking")
+	{
+		options.compactHotels = true;
+		BookingService compactedService(options);
+		for (auto& hotel : { hotel1, hotel2, hotel3 })
+		{
+			compactedService.Book(0, hotel, 1, 1);
+			CHECK(compactedService.GetMemoryUsage().hotelCount == 0);
+		}
+		CHECK(compactedService.GetTopHotels(10).empty());
+#ifdef COLLECT_SERVICE_METRICS
+		CHECK(compactedService.GetMetrics().droppedHotelCount == 3);
+#endif
+	}
+
+	WHEN("hotels have bookings")
+	{
+		BookingService activeService(BookingServiceOptions{ { 10 } });
+		activeService.Book(0, hotel1, 1, 1);
+		activeService.Book(20, hotel1, 1, 1);
+		CHECK(activeService.CompactHotels() == 0);
+		CHECK(activeService.GetBookedRoomCount(hotel1) == 1);
+	}
+
+	WHEN("the only booking of a hotel is cancelled")
+	{
+		BookingServiceOptions cancellableOptions;
+		cancellableOptions.statisticTimeSpans = { 100 };
+		cancellableOptions.cancellable = true;
+		for (bool rejectTooLate : { false, true })
+		{
+			cancellableOptions.rejectTooLate = rejectTooLate;
+			cancellableOptions.compactHotels = false;
+			BookingService keepingService(cancellableOptions);
+			cancellableOptions.compactHotels = true;
+			BookingService compactedService(cancellableOptions);
+			for (auto service : { &keepingService, &compactedService })
+			{
+				REQUIRE(service->Cancel(service->Book(1000, hotel1, 1, 1)));
+			}
+			// The hotel keeps its latest booking time to check lateness of the bookings that follow
+			CHECK(compactedService.CompactHotels() == 0);
+			CHECK(compactedService.GetHotelCount() == 1);
+			if (rejectTooLate)
+			{
+				CHECK_THROWS_AS(keepingService.Book(10, hotel1, 2, 1), std::invalid_argument);
+				CHECK_THROWS_AS(compactedService.Book(10, hotel1, 2, 1), std::invalid_argument);
+				continue;
+			}
+			for (auto service : { &keepingService, &compactedService })
+			{
+				// Both bookings are made at the time of the cancelled one
+				service->Book(10, hotel1, 2, 1);
+				service->Book(150, hotel1, 3, 3);
+			}
+			CHECK(keepingService.GetBookedRoomCount(hotel1) == 4);
+			CHECK(keepingService.GetDistinctClientCount(hotel1) == 2);
+			CHECK(compactedService.GetBookedRoomCount(hotel1) == 4);
+			CHECK(compactedService.GetDistinctClientCount(hotel1) == 2);
+		}
+	}
+
+	WHEN("hotels are booked once and time moves on")
+	{
+		BookingServiceOptions expiringOptions;
+		expiringOptions.statisticTimeSpans = { 10 };
+		expiringOptions.rankHotels = true;
+		expiringOptions.indexClientHotels = true;
+		expiringOptions.cancellable = true;
+		BookingService keepingService(expiringOptions);
+		expiringOptions.expireIdleHotels = true;
+		BookingService expiringService(expiringOptions);
+		const int hotelCount = 100;
+		for (int i = 0; i < hotelCount; ++i)
+		{
+			keepingService.Book(i / 10, "hotel" + to_string(i), i, 1);
+			expiringService.Book(i / 10, "hotel" + to_string(i), i, 1);
+		}
+		CHECK(expiringService.GetHotelCount() == hotelCount);
+		keepingService.Book(100, hotel1, hotelCount, 1);
+		expiringService.Book(100, hotel1, hotelCount, 1);
+		CHECK(expiringService.GetHotelCount() == 1);
+
+		for (int i = 1; i <= hotelCount; ++i)
+		{
+			keepingService.Book(100 + i, hotel1, hotelCount, 1);
+			expiringService.Book(100 + i, hotel1, hotelCount, 1);
+		}
+		CHECK(keepingService.GetHotelCount() == hotelCount + 1);
+		CHECK(keepingService.GetBookedRoomCount("hotel5") == 1);
+		CHECK(expiringService.GetHotelCount() == 1);
+		CHECK(expiringService.GetBookedRoomCount("hotel5") == 0);
+		CHECK(expiringService.GetTotalBookedRoomCount() == 10);
+		CHECK(expiringService.GetClientHotelCount(5) == 0);
+		CHECK(expiringService.GetTopHotels(10).size() == 1);
+		CHECK_FALSE(expiringService.Cancel(6));
+	}
+
+	WHEN("hotels expire between queries")
+	{
+		BookingServiceOptions expiringOptions;
+		expiringOptions.statisticTimeSpans = { 10 };
+		expiringOptions.expireIdleHotels = true;
+		BookingService expiringService(expiringOptions);
+		expiringService.Book(0, hotel1, 1, 5);
+		expiringService.Book(9, hotel2, 1, 1);
+		CHECK(expiringService.GetBookedRoomCount(hotel1) == 5);
+		CHECK(expiringService.GetTotalBookedRoomCount() == 6);
+		// The hotel expires once the latest booking of the service is a time span later than its own
+		expiringService.Book(10, hotel2, 1, 1);
+		CHECK(expiringService.GetBookedRoomCount(hotel1) == 0);
+		CHECK(expiringService.GetTotalBookedRoomCount() == 2);
+		for (Time time = 11; time < 20; ++time)
+		{
+			expiringService.Book(time, hotel2, 1, 1);
+			CHECK(expiringService.GetBookedRoomCount(hotel1) == 0);
+			CHECK(expiringService.GetHotelCount() == 1);
+		}
+
+		// A hotel booked again after queuing is queued by its latest booking
+		expiringService.Book(15, hotel3, 2, 1);
+		expiringService.Book(25, hotel3, 2, 1);
+		expiringService.Book(34, hotel2, 1, 1);
+		CHECK(expiringService.GetBookedRoomCount(hotel3) == 1);
+		CHECK(expiringService.GetHotelCount() == 2);
+		expiringService.Book(35, hotel2, 1, 1);
+		CHECK(expiringService.GetBookedRoomCount(hotel3) == 0);
+		CHECK(expiringService.GetHotelCount() == 1);
+
+		// An expired hotel accepts a booking made at any time
+		expiringService.Book(5, hotel1, 3, 7);
+		CHECK(expiringService.GetHotelCount() == 1);
+		expiringService.Book(30, hotel1, 3, 7);
+		CHECK(expiringService.GetBookedRoomCount(hotel1) == 7);
+	}
+}
+
+#ifdef COLLECT_SERVICE_METRICS
+SCENARIO("Booking Service metrics")
+{
+	const Time timeSpan = 5;
+	const auto hotel1 = "Hilton"s;
+	const auto hotel2 = "Radisoon"s;
+
+	BookingService service(timeSpan);
+	service.Book(0, hotel1, 1, 3);
+	service.Book(1, hotel1, 2, 3);
+	service.Book(2, hotel1, 1, 3);
+	service.Book(1, hotel2, 1, 3);
+	service.Book(20, hotel1, 3, 3);
+	service.GetDistinctClientCount(hotel1);
+	service.GetBookedRoomCount(hotel1);
+	service.GetBookedRoomCount(hotel2);
+
+	auto metrics = service.GetMetrics();
+	CHECK(metrics.bookCount == 5);
+	CHECK(metrics.clientsQueryCount == 1);
+	CHECK(metrics.roomsQueryCount == 2);
+	CHECK(metrics.evictedBookingCount == 3);
+	CHECK(metrics.maxEvictedPerBook == 3);
+	CHECK(metrics.evictedPerBook[0] == 4);
+	CHECK(metrics.evictedPerBook[2] == 1); // 2-3 evicted bookings
+	CHECK(metrics.maxWindowSize == 3);
+	CHECK(metrics.hotelCount == 2);
+#ifdef USE_UNORDERED_MAP_FOR_STORING_HOTELS
+	CHECK(metrics.hotelMapLoadFactor > 0);
+#endif
+	CHECK(metrics.clientMapEntryCount == 2);
+	CHECK(metrics.clientMapLoadFactor > 0);
+
+	ostringstream output;
+	output << metrics;
+	CHECK(output.str().find("evicted bookings: 3\n") != string::npos);
+
+	WHEN("bookings are retained and cancelled")
+	{
+		// Only bookings leaving the longest time span are evicted, and cancelled ones are not counted
+		BookingServiceOptions options;
+		options.statisticTimeSpans = { 10, 5 };
+		options.retentionHorizon = 100;
+		options.cancellable = true;
+		BookingService retainingService(options);
+		retainingService.Book(0, hotel1, 1, 1);
+		const auto cancelledId = retainingService.Book(1, hotel1, 2, 1);
+		retainingService.Book(2, hotel1, 3, 1);
+		retainingService.Cancel(cancelledId);
+		retainingService.Book(20, hotel1, 1, 1);
+		const auto retainingMetrics = retainingService.GetMetrics();
+		CHECK(retainingMetrics.evictedBookingCount == 2);
+		CHECK(retainingMetrics.maxEvictedPerBook == 2);
+		CHECK(retainingMetrics.maxWindowSize == 3);
+	}
+}
+#endif
+
+SCENARIO("Booking Service memory usage")
+{
+	const Time timeSpan = 5;
+	const auto hotel1 = "Hilton"s;
+	const auto hotel2 = "Radisson Blu Hotel & Conference Center"s; // doesn't fit into small string buffer
+
+	BookingService service(timeSpan);
+	auto usage = service.GetMemoryUsage();
+	CHECK(usage.hotelCount == 0);
+	CHECK(usage.bookings.bytes == 0);
+
+	service.Book(0, hotel1, 1, 3);
+	service.Book(1, hotel1, 2, 3);
+	service.Book(1, hotel2, 1, 3);
+	usage = service.GetMemoryUsage();
+	CHECK(usage.hotelCount == 2);
+	CHECK(usage.bookingCount == 3);
+	CHECK(usage.hotelMap.blocks >= 2);
+	CHECK(usage.hotelNames.blocks == 1);
+	CHECK(usage.hotelNames.bytes > hotel2.size());
+	CHECK(usage.bookings.bytes >= 3 * (sizeof(Time) + sizeof(ClientId) + sizeof(RoomCount)));
+	CHECK(usage.clientMaps.blocks >= 3);
+	CHECK(usage.GetTotal().GetTotalBytes() > usage.GetTotal().bytes);
+
+	// Evicted bookings release client map nodes
+	const auto clientMapBlocks = usage.clientMaps.blocks;
+	service.Book(100, hotel1, 3, 3);
+	CHECK(service.GetMemoryUsage().clientMaps.blocks == clientMapBlocks - 1);
+	CHECK(service.GetMemoryUsage().bookingCount == 2);
+}
+
+SCENARIO("Booking Service shrinks containers after a burst")
+{
+	const auto hotel = "Hilton"s;
+	BookingService service(10);
+	for (ClientId clientId = 0; clientId < 1000; ++clientId)
+	{
+		service.Book(0, hotel, clientId, 1);
+	}
+	const auto burstUsage = service.GetMemoryUsage();
+	const auto burstBucketCount = service.GetMetrics().clientMapBucketCount;
+
+	// The burst leaves the time span, but the containers keep their capacity for a while
+	for (unsigned i = 1; i < HotelBookings::ShrinkDelay; ++i)
+	{
+		service.Book(100, hotel, 1, 1);
+	}
+	CHECK(service.GetMetrics().shrinkCount == 0);
+	CHECK(service.GetMetrics().clientMapBucketCount == burstBucketCount);
+
+	service.Book(100, hotel, 1, 1);
+	const auto metrics = service.GetMetrics();
+	CHECK(metrics.shrinkCount == 1);
+	CHECK(metrics.reclaimedBytes > 0);
+	CHECK(metrics.clientMapBucketCount < burstBucketCount);
+	const auto usage = service.GetMemoryUsage();
+	CHECK(usage.clientMaps.bytes < burstUsage.clientMaps.bytes);
+	CHECK(burstUsage.GetTotal().GetTotalBytes() - usage.GetTotal().GetTotalBytes() >= metrics.reclaimedBytes);
+	CHECK(service.GetBookedRoomCount(hotel) == HotelBookings::ShrinkDelay);
+	CHECK(service.GetDistinctClientCount(hotel) == 1);
 }
 
 SCENARIO("User Interface")
@@ -97,40 +869,1062 @@ ROOMS hilton
 	UserInterface ui(input, output, service);
 	ui.Run();
 	CHECK(output.str() == "1\n8\n2\n9\n2\n4\n"s);
+
+	WHEN("rooms are queried within time range")
+	{
+		istringstream rangeInput(R"(3
+BOOK 3 hilton 5 6
+ROOMS_RANGE hilton 0 2
+ROOMS_RANGE radisson 0 2
+)");
+		ostringstream rangeOutput;
+		UserInterface rangeUi(rangeInput, rangeOutput, service);
+		rangeUi.Run();
+		CHECK(rangeOutput.str() == "4\n0\n"s);
+	}
+
+	WHEN("time span index is given")
+	{
+		BookingService multiSpanService({ 1, 100 });
+		istringstream spanInput(R"(5
+BOOK 0 hilton 1 1
+BOOK 10 hilton 2 2
+ROOMS hilton
+ROOMS hilton 1
+CLIENTS hilton 1
+)");
+		ostringstream spanOutput;
+		UserInterface spanUi(spanInput, spanOutput, multiSpanService);
+		spanUi.Run();
+		CHECK(spanOutput.str() == "2\n3\n2\n"s);
+	}
+
+	WHEN("totals are queried")
+	{
+		istringstream totalInput(R"(3
+BOOK 4 radisson 7 2
+TOTAL
+TOTAL 0
+)");
+		ostringstream totalOutput;
+		UserInterface totalUi(totalInput, totalOutput, service);
+		totalUi.Run();
+		CHECK(totalOutput.str() == "6 3\n6 3\n"s);
+	}
+
+	WHEN("statistics are queried as of a point in time")
+	{
+		BookingServiceOptions options;
+		options.statisticTimeSpans = { 5 };
+		options.retentionHorizon = 100;
+		BookingService retainingService(options);
+		istringstream asOfInput(R"(7
+BOOK 0 hilton 1 1
+BOOK 3 hilton 2 2
+BOOK 10 hilton 1 4
+ROOMS hilton
+ROOMS_AT hilton 4
+CLIENTS_AT hilton 4
+ROOMS_AT radisson 4
+)");
+		ostringstream asOfOutput;
+		UserInterface asOfUi(asOfInput, asOfOutput, retainingService);
+		asOfUi.Run();
+		CHECK(asOfOutput.str() == "4\n3\n2\n0\n"s);
+	}
+
+	WHEN("hotels of a client are queried")
+	{
+		BookingServiceOptions options;
+		options.indexClientHotels = true;
+		BookingService indexedService(options);
+		istringstream hotelsInput(R"(4
+BOOK 0 hilton 7 1
+BOOK 1 radisson 7 2
+HOTELS 7
+HOTELS 8
+)");
+		ostringstream hotelsOutput;
+		UserInterface hotelsUi(hotelsInput, hotelsOutput, indexedService);
+		hotelsUi.Run();
+		CHECK(hotelsOutput.str() == "2\n0\n"s);
+	}
+
+	WHEN("bookings are cancelled")
+	{
+		BookingServiceOptions options;
+		options.cancellable = true;
+		BookingService cancellableService(options);
+		istringstream cancelInput(R"(6
+BOOK 0 hilton 7 1
+BOOK 1 hilton 8 2
+CANCEL 1
+CANCEL 5
+ROOMS hilton
+CLIENTS hilton
+)");
+		ostringstream cancelOutput;
+		UserInterface cancelUi(cancelInput, cancelOutput, cancellableService);
+		cancelUi.Run();
+		CHECK(cancelOutput.str() == "2\n1\n"s);
+	}
+
+	WHEN("query syntax is wrong")
+	{
+		for (auto line : { "ROOMS_RANGE hilton 0"s, "ROOMS hilton first"s, "TOTAL all"s, "HOTELS"s, "CANCEL"s })
+		{
+			istringstream badInput("1\n" + line + "\n");
+			ostringstream badOutput;
+			UserInterface badUi(badInput, badOutput, service);
+			CHECK_THROWS_AS(badUi.Run(), std::runtime_error);
+		}
+	}
+}
+
+SCENARIO("User Interface streaming")
+{
+	// Records the text written before every flush
+	class FlushRecordingBuffer : public stringbuf
+	{
+	public:
+		vector<string> flushes;
+
+	protected:
+		int sync() override
+		{
+			flushes.push_back(str());
+			str("");
+			return 0;
+		}
+	};
+
+	const auto runStream = [](const string& inputText, const StreamOptions& options) {
+		BookingService service(5);
+		istringstream input(inputText);
+		FlushRecordingBuffer outputBuffer;
+		ostream output(&outputBuffer);
+		UserInterface ui(input, output, service);
+		ui.RunStream(options);
+		return outputBuffer.flushes;
+	};
+
+	// No count line, and errors don't stop the stream
+	const auto input = "BOOK 0 hilton 1 8\nROOMS hilton\nROOMS hilton 7\nBOOKED\nBOOK 1 hilton 2 1\nCLIENTS hilton\n"s;
+	const vector<string> answers = { "8\n", "ERROR Statistic time span index is out of range\n", "ERROR Unknown query BOOKED\n", "2\n" };
+	StreamOptions options;
+	options.maxFlushDelay = hours(1);
+	// The answers are batched until the input is exhausted
+	CHECK(runStream(input, options) == vector<string>{ answers[0] + answers[1] + answers[2] + answers[3] });
+
+	WHEN("every answer is flushed")
+	{
+		options.flushEveryAnswer = true;
+		CHECK(runStream(input, options) == answers);
+	}
+
+	WHEN("batches are limited by size")
+	{
+		options.maxBufferedBytes = 40;
+		CHECK(runStream(input, options) == vector<string>{ answers[0] + answers[1], answers[2] + answers[3] });
+	}
+
+	WHEN("batches are limited by time")
+	{
+		options.maxFlushDelay = milliseconds(0);
+		CHECK(runStream(input, options) == answers);
+	}
+
+	WHEN("lines have unusual syntax")
+	{
+		// ParseQuery parses the lines the record parser doesn't accept
+		QueryRecord record;
+		string_view hotelName;
+		CHECK(ParseQueryRecord("ROOMS\thilton 1\r", record, hotelName));
+		CHECK((record.type == QueryType::Rooms && hotelName == "hilton" && record.number == 1));
+		// Fields of other query types are neither set nor read
+		QueryRecord dirtyRecord;
+		memset(&dirtyRecord, 0xff, sizeof(dirtyRecord));
+		REQUIRE(ParseQueryRecord("ROOMS hilton", dirtyRecord, hotelName));
+		Query query;
+		query.time = 42;
+		RecordToQuery(dirtyRecord, hotelName, query);
+		CHECK((query.type == QueryType::Rooms && query.hotelName == "hilton" && query.spanIndex == 0 && query.time == 42));
+		CHECK_FALSE(ParseQueryRecord("BOOK +1 hilton 1 2", record, hotelName));
+		CHECK_FALSE(ParseQueryRecord("ROOMS hilton 1st", record, hotelName));
+		// Nothing may follow the optional time span index, whichever parser reads the line
+		CHECK_FALSE(ParseQueryRecord("ROOMS hilton 0 extra", record, hotelName));
+		CHECK_FALSE(ParseQueryRecord("CLIENTS hilton extra", record, hotelName));
+		CHECK(runStream("BOOK +1 hilton 1 2\nROOMS\thilton 0\r\nROOMS hilton 0th\nCLIENTS hilton extra\nTOTAL +0 extra\n", options)
+			== vector<string>{ "2\nERROR ROOMS query syntax error\nERROR CLIENTS query syntax error\nERROR TOTAL query syntax error\n" });
+	}
+
+	WHEN("the last line lacks the line end")
+	{
+		CHECK(runStream("BOOK 0 hilton 1 8\nROOMS hilton", options) == vector<string>{ "8\n" });
+		CHECK(runStream("", options).empty());
+	}
+}
+
+SCENARIO("User Interface tracing")
+{
+	BookingService service(5);
+	istringstream input(R"(3
+BOOK 0 hilton 1 8
+BOOK 1 hilton 2 3
+ROOMS hilton
+)");
+	ostringstream output;
+	ostringstream summary;
+
+	UserInterface ui(input, output, service);
+	ui.EnableTracing(summary);
+	ui.Run();
+	CHECK(output.str() == "11\n"s);
+	CHECK(summary.str().find("BOOK        parse            2") != string::npos);
+	CHECK(summary.str().find("ROOMS       output           1") != string::npos);
+	CHECK(summary.str().find("CLIENTS") == string::npos);
+}
+
+SCENARIO("File reader")
+{
+	const auto path = (filesystem::temp_directory_path() / "HotelBookingTests.txt").string();
+	vector<string> lines = { "3", "BOOK 0 hilton 1 8", "", "a line longer than a buffer " + string(40, 'x'), "BOOK 1 hilton 2 3", "ROOMS hilton" };
+	{
+		ofstream file(path, ios::binary);
+		for (auto& line : lines)
+		{
+			file << line << "\n";
+		}
+		// The last line lacks the line end
+		file << "CLIENTS hilton";
+	}
+	lines.push_back("CLIENTS hilton");
+
+	for (auto backend : { FileReader::Backend::IoUring, FileReader::Backend::Read })
+	{
+		for (size_t bufferSize : { 1, 7, 4096 })
+		{
+			FileReader reader(path, backend, bufferSize, 3);
+			vector<string> readLines;
+			string_view line;
+			while (reader.ReadLine(line))
+			{
+				readLines.emplace_back(line);
+			}
+			CHECK(readLines == lines);
+			CHECK_FALSE(reader.ReadLine(line));
+		}
+	}
+	CHECK(FileReader(path, FileReader::Backend::Read).GetBackend() == FileReader::Backend::Read);
+	CHECK_THROWS_AS(FileReader(path + ".missing"), std::runtime_error);
+
+	WHEN("queries are read from a file")
+	{
+		{
+			ofstream file(path, ios::binary);
+			file << "4\nBOOK 0 hilton 1 8\nBOOK 1 hilton 2 3\nROOMS hilton\nCLIENTS hilton\n";
+		}
+		BookingService service(5);
+		istringstream unusedInput;
+		ostringstream output;
+		UserInterface ui(unusedInput, output, service);
+		FileReader reader(path, FileReader::Backend::IoUring, 8);
+		ui.Run(reader);
+		CHECK(output.str() == "11\n2\n"s);
+	}
+	filesystem::remove(path);
+}
+
+SCENARIO("Parallel replay")
+{
+	BookingServiceOptions options;
+	options.statisticTimeSpans = { 50, 1000 };
+	options.maxLateness = 20;
+	options.retentionHorizon = 100;
+	options.cancellable = true;
+	options.indexClientHotels = true;
+
+	// Spans several chunks, so that chunks are reused
+	const auto hotels = GenerateHotels(30);
+	mt19937 random(7);
+	vector<string> lines;
+	vector<Time> hotelTimes(hotels.size());
+	size_t bookingCount = 0;
+	while (lines.size() < ParallelReplay::ChunkLineCount * (ParallelReplay::ChunkCount + 2))
+	{
+		const auto hotelIndex = random() % hotels.size();
+		const auto& hotel = hotels[hotelIndex];
+		switch (random() % 10)
+		{
+		case 0:
+			lines.push_back("CLIENTS " + hotel + " " + to_string(random() % 2));
+			break;
+		case 1:
+			lines.push_back("ROOMS " + hotel);
+			break;
+		case 2:
+			lines.push_back("TOTAL " + to_string(random() % 2));
+			break;
+		case 3:
+			lines.push_back("HOTELS " + to_string(random() % 20));
+			break;
+		case 4:
+			lines.push_back("CANCEL " + to_string(bookingCount == 0 ? 1 : random() % bookingCount + 1));
+			break;
+		case 5:
+			lines.push_back("ROOMS_AT " + hotel + " " + to_string(hotelTimes[hotelIndex] - 30) + " 0");
+			break;
+		default:
+			hotelTimes[hotelIndex] += static_cast<Time>(random() % 10);
+			lines.push_back("BOOK " + to_string(hotelTimes[hotelIndex] - static_cast<Time>(random() % 10)) + " " + hotel + " "
+				+ to_string(random() % 20) + " " + to_string(random() % 5 + 1));
+			++bookingCount;
+		}
+	}
+	const auto makeInput = [&lines](size_t lineCount) {
+		string input = to_string(lineCount) + "\n";
+		for (size_t i = 0; i < lineCount && i < lines.size(); ++i)
+		{
+			input += lines[i] + "\n";
+		}
+		return input;
+	};
+	const auto runSequentially = [&options](const string& inputText) {
+		BookingService service(options);
+		istringstream input(inputText);
+		ostringstream output;
+		UserInterface ui(input, output, service);
+		ui.Run();
+		return output.str();
+	};
+
+	const auto inputText = makeInput(lines.size());
+	const auto expectedOutput = runSequentially(inputText);
+	for (unsigned partitionCount : { 1, 3, 8 })
+	{
+		ParallelReplay replay(options, partitionCount);
+		CHECK(replay.GetPartitionCount() == partitionCount);
+		istringstream input(inputText);
+		ostringstream output;
+		replay.Run(input, output);
+		CHECK(output.str() == expectedOutput);
+	}
+
+	WHEN("queries are read from a file")
+	{
+		const auto path = (filesystem::temp_directory_path() / "HotelBookingReplay.txt").string();
+		{
+			ofstream file(path, ios::binary);
+			file << inputText;
+		}
+		ParallelReplay replay(options, 4);
+		FileReader reader(path, FileReader::Backend::Read, 4096);
+		ostringstream output;
+		replay.Run(reader, output);
+		CHECK(output.str() == expectedOutput);
+		filesystem::remove(path);
+	}
+
+	WHEN("the count exceeds the number of lines")
+	{
+		// The last line lacks the line end, and it is read again as UserInterface::Run does
+		auto shortInput = makeInput(100);
+		shortInput.replace(0, 3, "103");
+		shortInput += lines[100];
+		ParallelReplay replay(options, 3);
+		istringstream input(shortInput);
+		ostringstream output;
+		replay.Run(input, output);
+		CHECK(output.str() == runSequentially(shortInput));
+	}
+
+	WHEN("a query fails")
+	{
+		// The answers to the preceding queries are written before the error
+		lines[ParallelReplay::ChunkLineCount * 2 + 10] = "ROOMS " + hotels[0] + " 5";
+		const auto failingInput = makeInput(lines.size());
+		string expectedPartialOutput;
+		{
+			BookingService service(options);
+			istringstream input(failingInput);
+			ostringstream output;
+			UserInterface ui(input, output, service);
+			CHECK_THROWS_AS(ui.Run(), std::out_of_range);
+			expectedPartialOutput = output.str();
+		}
+		ParallelReplay replay(options, 3);
+		istringstream input(failingInput);
+		ostringstream output;
+		CHECK_THROWS_AS(replay.Run(input, output), std::out_of_range);
+		CHECK(output.str() == expectedPartialOutput);
+	}
+
+	CHECK_THROWS_AS(ParallelReplay(options, 0), std::invalid_argument);
+	CHECK_THROWS_AS(ParallelReplay(options, ParallelReplay::MaxPartitionCount + 1), std::invalid_argument);
+
+	WHEN("idle hotels expire")
+	{
+		// Partitions would expire hotels against their own latest bookings rather than the latest booking of all hotels
+		auto expiringOptions = options;
+		expiringOptions.expireIdleHotels = true;
+		CHECK_THROWS_AS(ParallelReplay(expiringOptions, 4), std::invalid_argument);
+		CHECK_NOTHROW(BookingService(expiringOptions));
+	}
+}
+
+SCENARIO("Parallel query parsing")
+{
+	BookingServiceOptions options;
+	options.statisticTimeSpans = { 50, 1000 };
+	options.maxLateness = 20;
+	options.retentionHorizon = 100;
+	options.cancellable = true;
+	options.indexClientHotels = true;
+
+	// Spans several chunks. Unusual lines are left to ParseQuery
+	const auto hotels = GenerateHotels(30);
+	const vector<string> unusualLines = { "BOOK +5 hotel 1 1", "CLIENTS\thotel 1\r", "ROOMS hotel +0", "HOTELS -1",
+		"TOTAL +1 ", "BOOK 6 hotel 7 1 ignored" };
+	mt19937 random(11);
+	string lines;
+	unsigned lineCount = 0;
+	Time time = 0;
+	unsigned bookingCount = 0;
+	while (lines.size() < ParallelQueryParser::ChunkSize * 3)
+	{
+		const auto& hotel = hotels[random() % hotels.size()];
+		switch (random() % 12)
+		{
+		case 0:
+			lines += "CLIENTS " + hotel + " " + to_string(random() % 2) + "\n";
+			break;
+		case 1:
+			lines += "ROOMS " + hotel + "\n";
+			break;
+		case 2:
+			lines += "ROOMS_RANGE " + hotel + " " + to_string(time - 100) + " " + to_string(time) + "\n";
+			break;
+		case 3:
+			lines += "TOTAL\n";
+			break;
+		case 4:
+			lines += "HOTELS " + to_string(random() % 20) + "\n";
+			break;
+		case 5:
+			lines += "CLIENTS_AT " + hotel + " " + to_string(time - 30) + " 1\n";
+			break;
+		case 6:
+			lines += "CANCEL " + to_string(random() % (bookingCount + 1) + 1) + "\n";
+			break;
+		case 7:
+			lines += unusualLines[random() % unusualLines.size()] + "\n";
+			break;
+		default:
+			time += static_cast<Time>(random() % 10);
+			lines += "BOOK " + to_string(time) + " " + hotel + " " + to_string(random() % 20) + " " + to_string(random() % 5 + 1) + "\n";
+			++bookingCount;
+		}
+		++lineCount;
+	}
+	const auto runSequentially = [&options](const string& inputText) {
+		BookingService service(options);
+		istringstream input(inputText);
+		ostringstream output;
+		UserInterface ui(input, output, service);
+		ui.Run();
+		return output.str();
+	};
+	const auto runInParallel = [&options](const string& inputText, unsigned threadCount) {
+		BookingService service(options);
+		ParallelQueryParser parser(service, threadCount);
+		istringstream input(inputText);
+		ostringstream output;
+		parser.Run(input, output);
+		return output.str();
+	};
+
+	const auto inputText = to_string(lineCount) + "\n" + lines;
+	const auto expectedOutput = runSequentially(inputText);
+	for (unsigned threadCount : { 1, 2, 5 })
+	{
+		CHECK(runInParallel(inputText, threadCount) == expectedOutput);
+	}
+
+	WHEN("queries are read from a file")
+	{
+		const auto path = (filesystem::temp_directory_path() / "HotelBookingParsing.txt").string();
+		{
+			ofstream file(path, ios::binary);
+			file << inputText;
+		}
+		BookingService service(options);
+		ParallelQueryParser parser(service, 3);
+		ostringstream output;
+		parser.Run(path, output);
+		CHECK(output.str() == expectedOutput);
+		filesystem::remove(path);
+		CHECK_THROWS_AS(parser.Run(path, output), std::runtime_error);
+	}
+
+	WHEN("the count differs from the number of lines")
+	{
+		// Lines after the count are not executed
+		const auto shortInput = "1000" + inputText.substr(inputText.find('\n'));
+		CHECK(runInParallel(shortInput, 2) == runSequentially(shortInput));
+		// The last line lacks the line end, and it is read again as UserInterface::Run does
+		const auto longInput = "3\nBOOK 1 hilton 1 2\nROOMS hilton";
+		CHECK(runInParallel(longInput, 2) == "2\n2\n"s);
+		CHECK(runSequentially(longInput) == "2\n2\n"s);
+	}
+
+	WHEN("a query fails")
+	{
+		// The answers to the preceding queries are written before the error
+		auto failingInput = inputText;
+		failingInput.insert(failingInput.find('\n', ParallelQueryParser::ChunkSize + 100) + 1, "ROOMS hotel 5\n");
+		string expectedPartialOutput;
+		{
+			BookingService service(options);
+			istringstream input(failingInput);
+			ostringstream output;
+			UserInterface ui(input, output, service);
+			CHECK_THROWS_AS(ui.Run(), std::out_of_range);
+			expectedPartialOutput = output.str();
+		}
+		BookingService service(options);
+		ParallelQueryParser parser(service, 3);
+		istringstream input(failingInput);
+		ostringstream output;
+		CHECK_THROWS_AS(parser.Run(input, output), std::out_of_range);
+		CHECK(output.str() == expectedPartialOutput);
+	}
+
+	BookingService service;
+	CHECK(ParallelQueryParser(service, 4).GetThreadCount() == 4);
+	CHECK_THROWS_AS(ParallelQueryParser(service, 0), std::invalid_argument);
+}
+
+#ifdef __linux__
+SCENARIO("Query server")
+{
+	BookingService service(5);
+	QueryServer server(service);
+	const auto tcpAddress = ParseSocketAddress("tcp:" + to_string(server.Listen(ParseSocketAddress("tcp:0"))));
+	const auto unixAddress = ParseSocketAddress("unix:" + (filesystem::temp_directory_path() / "HotelBookingTests.sock").string());
+	server.Listen(unixAddress);
+	thread serverThread([&server] { server.Run(); });
+
+	const auto request = R"(6
+BOOK 0 hilton 1 8
+BOOK 1 hilton 2 3
+ROOMS hilton
+CLIENTS hilton
+BOOK 9 radisson 1 1
+TOTAL
+)"s;
+	istringstream input(request);
+	ostringstream output;
+	RunQueryClient(unixAddress, input, output);
+	CHECK(output.str() == "11\n2\n12 3\n"s);
+
+	WHEN("many clients pipeline queries concurrently")
+	{
+		// Every client books its own hotel, so the answers don't depend on the interleaving
+		const int clientCount = 8;
+		// Every request takes more reads than the server does per readiness event
+		const int bookingCount = 10000;
+		vector<string> outputs(clientCount);
+		vector<thread> clients;
+		for (int clientIndex = 0; clientIndex < clientCount; ++clientIndex)
+		{
+			clients.emplace_back([&, clientIndex] {
+				ostringstream clientRequest;
+				clientRequest << bookingCount * 2 << "\n";
+				for (int i = 0; i < bookingCount; ++i)
+				{
+					clientRequest << "BOOK " << i << " hotel" << clientIndex << " " << i << " 1\n"
+								  << "ROOMS hotel" << clientIndex << "\n";
+				}
+				istringstream clientInput(clientRequest.str());
+				ostringstream clientOutput;
+				RunQueryClient(clientIndex % 2 ? tcpAddress : unixAddress, clientInput, clientOutput);
+				outputs[clientIndex] = clientOutput.str();
+			});
+		}
+		for (auto& client : clients)
+		{
+			client.join();
+		}
+		ostringstream expected;
+		for (int i = 0; i < bookingCount; ++i)
+		{
+			expected << min(i + 1, 5) << "\n";
+		}
+		for (auto& clientOutput : outputs)
+		{
+			CHECK(clientOutput == expected.str());
+		}
+	}
+
+	WHEN("a query is wrong")
+	{
+		istringstream badInput("3\nROOMS\nCANCEL 1\nROOMS hilton\n");
+		ostringstream badOutput;
+		RunQueryClient(tcpAddress, badInput, badOutput);
+		CHECK(badOutput.str() == "ERROR ROOMS query syntax error\nERROR Booking cancellation is not enabled\n11\n"s);
+	}
+
+	server.Stop();
+	serverThread.join();
+	CHECK_THROWS_AS(ParseSocketAddress("tcp:http"), std::invalid_argument);
+	CHECK_THROWS_AS(ParseSocketAddress("localhost:80"), std::invalid_argument);
+}
+#endif
+
+#ifdef __cpp_impl_coroutine
+// Coroutine running until completion on its own
+struct DetachedTask
+{
+	struct promise_type
+	{
+		DetachedTask get_return_object() noexcept { return {}; }
+		suspend_never initial_suspend() noexcept { return {}; }
+		suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { terminate(); }
+	};
+};
+
+// Books the hotel and records its booked rooms after every booking
+DetachedTask BookHotelAsync(AsyncBookingService& service, string hotel, int bookingCount, vector<RoomCount>& rooms, latch& done)
+{
+	for (int i = 0; i < bookingCount; ++i)
+	{
+		co_await service.BookAsync(i, hotel, i % 3, i % 4 + 1);
+		rooms.push_back(co_await service.GetBookedRoomCountAsync(hotel));
+	}
+	done.count_down();
 }
 
-vector<string> GenerateHotels(unsigned count)
+DetachedTask GetRoomsAsync(AsyncBookingService& service, string hotel, size_t spanIndex, string& error, latch& done)
 {
-	const auto alphabet = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ01234567890"s;
-	vector<string> hotels;
-	hotels.reserve(count);
-	uniform_int_distribution<size_t> dist(0, alphabet.size() - 1);
-	mt19937 gen(1);
-	const size_t hotelNameSize = 12;
-	for (unsigned i = 0; i < count; ++i)
+	try
+	{
+		co_await service.GetBookedRoomCountAsync(hotel, spanIndex);
+	}
+	catch (const std::out_of_range& e)
 	{
-		string name;
-		name.reserve(hotelNameSize);
-		for (unsigned j = 0; j < hotelNameSize; ++j)
+		error = e.what();
+	}
+	done.count_down();
+}
+
+SCENARIO("Async Booking Service")
+{
+	const int hotelCount = 20;
+	const int bookingCount = 300;
+	BookingServiceOptions options;
+	options.statisticTimeSpans = { 10 };
+	BookingService expectedService(options);
+	vector<vector<RoomCount>> expectedRooms(hotelCount);
+	for (int i = 0; i < bookingCount; ++i)
+	{
+		for (int hotelIndex = 0; hotelIndex < hotelCount; ++hotelIndex)
 		{
-			name += alphabet[dist(gen)];
+			const auto hotel = "hotel" + to_string(hotelIndex);
+			expectedService.Book(i, hotel, i % 3, i % 4 + 1);
+			expectedRooms[hotelIndex].push_back(expectedService.GetBookedRoomCount(hotel));
 		}
-		hotels.push_back(name);
 	}
-	return hotels;
+
+	AsyncBookingService service(options, 3);
+	CHECK(service.GetShardCount() == 3);
+	vector<vector<RoomCount>> rooms(hotelCount);
+	{
+		latch done(hotelCount);
+		for (int hotelIndex = 0; hotelIndex < hotelCount; ++hotelIndex)
+		{
+			BookHotelAsync(service, "hotel" + to_string(hotelIndex), bookingCount, rooms[hotelIndex], done);
+		}
+		done.wait();
+	}
+	CHECK(rooms == expectedRooms);
+	const auto statistics = service.GetStatistics();
+	CHECK(statistics.operationCount == hotelCount * bookingCount * 2);
+	CHECK(statistics.batchCount > 0);
+	CHECK(statistics.batchCount <= statistics.operationCount);
+
+	WHEN("an operation throws")
+	{
+		string error;
+		latch done(1);
+		GetRoomsAsync(service, "hotel0", 1, error, done);
+		done.wait();
+		CHECK(!error.empty());
+	}
+
+	CHECK_THROWS_AS(AsyncBookingService(options, 0), std::invalid_argument);
+	auto expiringOptions = options;
+	expiringOptions.expireIdleHotels = true;
+	CHECK_THROWS_AS(AsyncBookingService(expiringOptions, 2), std::invalid_argument);
 }
+#endif
 
-vector<ClientId> GenerateClientIds(unsigned count)
+SCENARIO("Sharded booking engine")
 {
-	vector<ClientId> clients;
-	clients.reserve(count);
-	uniform_int_distribution<unsigned> dist(1, 999'999'999);
-	mt19937 gen(2);
-	for (unsigned i = 0; i < count; ++i)
+	const int hotelCount = 20;
+	const int bookingCount = 300;
+	BookingServiceOptions serviceOptions;
+	serviceOptions.statisticTimeSpans = { 10, 100 };
+	// Makes late bookings fail on the shards
+	serviceOptions.rejectTooLate = true;
+	BookingService expectedService(serviceOptions);
+	vector<vector<pair<RoomCount, size_t>>> expectedAnswers(hotelCount);
+	for (int i = 0; i < bookingCount; ++i)
+	{
+		for (int hotelIndex = 0; hotelIndex < hotelCount; ++hotelIndex)
+		{
+			const auto hotel = "hotel" + to_string(hotelIndex);
+			expectedService.Book(i, hotel, i % 7, i % 4 + 1);
+			expectedAnswers[hotelIndex].emplace_back(expectedService.GetBookedRoomCount(hotel),
+				expectedService.GetDistinctClientCount(hotel, 1));
+		}
+	}
+
+	ShardedEngineOptions options;
+	options.shardCount = 3;
+	options.producerCount = 2;
+	// A small queue makes the producers wait for the shards
+	options.queueCapacity = 8;
+	ShardedBookingEngine engine(serviceOptions, options);
+	CHECK(engine.GetShardCount() == 3);
+
+	// Every hotel is booked by a single producer
+	vector<vector<pair<RoomCount, size_t>>> answers(hotelCount);
+	vector<thread> producers;
+	for (unsigned producerIndex = 0; producerIndex < options.producerCount; ++producerIndex)
+	{
+		producers.emplace_back([&, producerIndex] {
+			auto& producer = engine.GetProducer(producerIndex);
+			for (int i = 0; i < bookingCount; ++i)
+			{
+				for (int hotelIndex = producerIndex; hotelIndex < hotelCount; hotelIndex += options.producerCount)
+				{
+					const auto hotel = "hotel" + to_string(hotelIndex);
+					producer.Book(i, hotel, i % 7, i % 4 + 1);
+					answers[hotelIndex].emplace_back(producer.GetBookedRoomCount(hotel),
+						producer.GetDistinctClientCount(hotel, 1));
+				}
+			}
+			producer.Flush();
+		});
+	}
+	for (auto& producer : producers)
 	{
-		clients.push_back(dist(gen));
+		producer.join();
 	}
-	return clients;
+	CHECK(answers == expectedAnswers);
+
+	WHEN("a request fails")
+	{
+		auto& producer = engine.GetProducer(0);
+		CHECK_THROWS_AS(producer.GetBookedRoomCount("hotel0", 2), std::out_of_range);
+		// A late booking fails on the shard, and the next query to the shard reports it
+		producer.Book(0, "hotel0", 1, 1);
+		CHECK_THROWS_AS(producer.GetBookedRoomCount("hotel0"), std::invalid_argument);
+		CHECK(producer.GetBookedRoomCount("hotel0") == expectedAnswers[0].back().first);
+		producer.Book(0, "hotel0", 1, 1);
+		CHECK_THROWS_AS(producer.Flush(), std::invalid_argument);
+		CHECK_NOTHROW(producer.Flush());
+	}
+
+	CHECK_THROWS_AS(engine.GetProducer(2), std::out_of_range);
+	options.shardCount = 0;
+	CHECK_THROWS_AS(ShardedBookingEngine(serviceOptions, options), std::invalid_argument);
+	options.shardCount = 2;
+	serviceOptions.expireIdleHotels = true;
+	CHECK_THROWS_AS(ShardedBookingEngine(serviceOptions, options), std::invalid_argument);
+}
+
+SCENARIO("Hot hotel bookings")
+{
+	const vector<Time> timeSpans = { 10, 100 };
+	const int bookingCount = 1000;
+	HotelBookings expected(timeSpans);
+	BookingHistoryOptions historyOptions;
+	historyOptions.rejectTooLate = true;
+	HotHotelBookings hotel(timeSpans, 4, historyOptions);
+	CHECK(hotel.GetPartitionCount() == 4);
+	CHECK(hotel.GetBookedRoomCount(1) == 0);
+	CHECK(hotel.GetDistinctClientCount() == 0);
+
+	WHEN("partitions are booked in turn")
+	{
+		// Partitions see every fourth booking, so their own windows keep bookings the hotel has already evicted
+		for (int i = 0; i < bookingCount; ++i)
+		{
+			expected.Book(i, i % 13, i % 5 + 1);
+			hotel.Book(i % 4, i, i % 13, i % 5 + 1);
+			CHECK(hotel.GetBookedRoomCount() == expected.GetBookedRoomCount());
+			CHECK(hotel.GetBookedRoomCount(1) == expected.GetBookedRoomCount(1));
+			CHECK(hotel.GetDistinctClientCount() == expected.GetDistinctClientCount());
+			CHECK(hotel.GetDistinctClientCount(1) == expected.GetDistinctClientCount(1));
+		}
+	}
+
+	WHEN("partitions are booked concurrently")
+	{
+		vector<thread> threads;
+		for (unsigned partitionIndex = 0; partitionIndex < 4; ++partitionIndex)
+		{
+			threads.emplace_back([&hotel, partitionIndex] {
+				for (int i = partitionIndex; i < bookingCount; i += 4)
+				{
+					hotel.Book(partitionIndex, i, i % 13, i % 5 + 1);
+					// Reads lock all partitions while other threads book theirs
+					hotel.GetDistinctClientCount();
+				}
+			});
+		}
+		for (auto& bookingThread : threads)
+		{
+			bookingThread.join();
+		}
+		for (int i = 0; i < bookingCount; ++i)
+		{
+			expected.Book(i, i % 13, i % 5 + 1);
+		}
+		CHECK(hotel.GetBookedRoomCount() == expected.GetBookedRoomCount());
+		CHECK(hotel.GetBookedRoomCount(1) == expected.GetBookedRoomCount(1));
+		CHECK(hotel.GetDistinctClientCount() == expected.GetDistinctClientCount());
+		CHECK(hotel.GetDistinctClientCount(1) == expected.GetDistinctClientCount(1));
+	}
+
+	WHEN("a partition lags behind")
+	{
+		hotel.Book(0, 100, 1, 5);
+		hotel.Book(1, 50, 2, 7);
+		// The booking at 50 is out of the shorter time span of the booking at 100
+		CHECK(hotel.GetBookedRoomCount() == 5);
+		CHECK(hotel.GetDistinctClientCount() == 1);
+		CHECK(hotel.GetBookedRoomCount(1) == 12);
+		CHECK(hotel.GetDistinctClientCount(1) == 2);
+		hotel.Book(1, 95, 1, 1);
+		CHECK(hotel.GetBookedRoomCount() == 6);
+		CHECK(hotel.GetDistinctClientCount() == 1);
+		CHECK_THROWS_AS(hotel.Book(1, 90, 3, 1), std::invalid_argument);
+	}
+
+	WHEN("a lagging partition gets late bookings")
+	{
+		const vector<Time> lateTimeSpans = { 10, 1000 };
+		BookingHistoryOptions lateOptions;
+		lateOptions.maxLateness = 100;
+		HotelBookings expectedHotel(lateTimeSpans, nullptr, lateOptions);
+		HotHotelBookings lateHotel(lateTimeSpans, 2, lateOptions);
+		const auto book = [&](unsigned partitionIndex, Time time, ClientId clientId, RoomCount roomCount) {
+			expectedHotel.Book(time, clientId, roomCount);
+			lateHotel.Book(partitionIndex, time, clientId, roomCount);
+			for (size_t spanIndex = 0; spanIndex < lateTimeSpans.size(); ++spanIndex)
+			{
+				CHECK(lateHotel.GetBookedRoomCount(spanIndex) == expectedHotel.GetBookedRoomCount(spanIndex));
+				CHECK(lateHotel.GetDistinctClientCount(spanIndex) == expectedHotel.GetDistinctClientCount(spanIndex));
+			}
+		};
+		book(0, 0, 1, 2);
+		book(0, 5, 2, 4);
+		// Reads advance the windows of the first partition past its latest booking
+		book(1, 100, 3, 6);
+		// The booking is late for the partition, but out of the shorter time span of the hotel
+		book(0, 3, 1, 8);
+		book(1, 200, 4, 16);
+		CHECK(lateHotel.GetBookedRoomCount() == 16);
+		CHECK(lateHotel.GetDistinctClientCount() == 1);
+
+		// Bookings arrive up to 20 late, and the partitions take turns
+		for (int i = 0; i < bookingCount; ++i)
+		{
+			book(i % 2, 300 + i - (i * 7) % 21, i % 13, i % 5 + 1);
+		}
+	}
+
+	CHECK_THROWS_AS(hotel.GetBookedRoomCount(2), std::out_of_range);
+	CHECK_THROWS_AS(HotHotelBookings(timeSpans, 0), std::invalid_argument);
+
+	WHEN("a sharded engine has a hot hotel")
+	{
+		BookingServiceOptions serviceOptions;
+		serviceOptions.statisticTimeSpans = timeSpans;
+		// Bookings of the producers reach a combined hotel out of order
+		serviceOptions.maxLateness = bookingCount;
+		serviceOptions.rejectTooLate = true;
+		BookingService expectedService(serviceOptions);
+		for (int i = 0; i < bookingCount; ++i)
+		{
+			expectedService.Book(i, "flagship", i % 13, i % 5 + 1);
+			expectedService.Book(i, "hotel" + to_string(i % 2), i % 13, 1);
+		}
+		for (bool combineHotHotels : { false, true })
+		{
+			ShardedEngineOptions options;
+			options.shardCount = 2;
+			options.producerCount = 2;
+			options.hotHotels = { "flagship" };
+			options.combineHotHotels = combineHotHotels;
+			ShardedBookingEngine engine(serviceOptions, options);
+			vector<thread> producers;
+			for (unsigned producerIndex = 0; producerIndex < 2; ++producerIndex)
+			{
+				producers.emplace_back([&engine, producerIndex] {
+					auto& producer = engine.GetProducer(producerIndex);
+					for (int i = producerIndex; i < bookingCount; i += 2)
+					{
+						producer.Book(i, "flagship", i % 13, i % 5 + 1);
+						producer.Book(i, "hotel" + to_string(producerIndex), i % 13, 1);
+					}
+					producer.Flush();
+				});
+			}
+			for (auto& producer : producers)
+			{
+				producer.join();
+			}
+			auto& producer = engine.GetProducer(0);
+			for (const auto hotelName : { "flagship", "hotel0", "hotel1" })
+			{
+				CHECK(producer.GetBookedRoomCount(hotelName) == expectedService.GetBookedRoomCount(hotelName));
+				CHECK(producer.GetDistinctClientCount(hotelName, 1) == expectedService.GetDistinctClientCount(hotelName, 1));
+			}
+			CHECK_THROWS_AS(producer.Book(-bookingCount, "flagship", 1, 1), std::invalid_argument);
+		}
+	}
+}
+
+SCENARIO("Flat combining hotel bookings")
+{
+	const vector<Time> timeSpans = { 10, 100 };
+	const int bookingCount = 1000;
+	BookingHistoryOptions historyOptions;
+	historyOptions.maxLateness = 5;
+	historyOptions.rejectTooLate = true;
+	HotelBookings expected(timeSpans, nullptr, historyOptions);
+
+	WHEN("bookings are made in batches")
+	{
+		// Late bookings within a batch make the deferred removals happen before them
+		HotelBookings batched(timeSpans, nullptr, historyOptions);
+		const vector<BookingRequest> batch = { { 1, 1, 1 }, { 5, 2, 2 }, { 20, 3, 3 }, { 17, 4, 4 }, { 30, 5, 5 }, { 2, 6, 6 }, { 40, 1, 7 } };
+		vector<exception_ptr> errors;
+		batched.BookBatch(batch, errors);
+		REQUIRE(errors.size() == batch.size());
+		for (size_t i = 0; i < batch.size(); ++i)
+		{
+			bool failed = false;
+			try
+			{
+				expected.Book(batch[i].time, batch[i].clientId, batch[i].roomCount);
+			}
+			catch (const std::invalid_argument&)
+			{
+				failed = true;
+			}
+			CHECK(static_cast<bool>(errors[i]) == failed);
+		}
+		CHECK(errors[5]);
+		for (size_t spanIndex = 0; spanIndex < timeSpans.size(); ++spanIndex)
+		{
+			CHECK(batched.GetBookedRoomCount(spanIndex) == expected.GetBookedRoomCount(spanIndex));
+			CHECK(batched.GetDistinctClientCount(spanIndex) == expected.GetDistinctClientCount(spanIndex));
+			CHECK(batched.GetBookingCount(spanIndex) == expected.GetBookingCount(spanIndex));
+		}
+	}
+
+	WHEN("a single thread books")
+	{
+		CombiningHotelBookings hotel(timeSpans, 1, historyOptions);
+		for (int i = 0; i < bookingCount; ++i)
+		{
+			expected.Book(i, i % 13, i % 5 + 1);
+			hotel.Book(0, i, i % 13, i % 5 + 1);
+			CHECK(hotel.GetBookedRoomCount(1) == expected.GetBookedRoomCount(1));
+			CHECK(hotel.GetDistinctClientCount() == expected.GetDistinctClientCount());
+		}
+		CHECK_THROWS_AS(hotel.Book(0, 0, 1, 1), std::invalid_argument);
+		CHECK(hotel.GetStatistics().bookingCount == bookingCount + 1);
+		CHECK(hotel.GetStatistics().batchCount == bookingCount + 1);
+	}
+
+	WHEN("threads book concurrently")
+	{
+		// Every booking is accepted however late it arrives, so the result doesn't depend on the order
+		historyOptions.maxLateness = bookingCount;
+		CombiningHotelBookings hotel(timeSpans, 4, historyOptions);
+		vector<thread> threads;
+		for (unsigned threadIndex = 0; threadIndex < 4; ++threadIndex)
+		{
+			threads.emplace_back([&hotel, threadIndex] {
+				for (int i = threadIndex; i < bookingCount; i += 4)
+				{
+					hotel.Book(threadIndex, i, i % 13, i % 5 + 1);
+				}
+			});
+		}
+		for (auto& bookingThread : threads)
+		{
+			bookingThread.join();
+		}
+		for (int i = 0; i < bookingCount; ++i)
+		{
+			expected.Book(i, i % 13, i % 5 + 1);
+		}
+		for (size_t spanIndex = 0; spanIndex < timeSpans.size(); ++spanIndex)
+		{
+			CHECK(hotel.GetBookedRoomCount(spanIndex) == expected.GetBookedRoomCount(spanIndex));
+			CHECK(hotel.GetDistinctClientCount(spanIndex) == expected.GetDistinctClientCount(spanIndex));
+		}
+		const auto statistics = hotel.GetStatistics();
+		CHECK(statistics.bookingCount == bookingCount);
+		CHECK(statistics.batchCount <= statistics.bookingCount);
+		CHECK_THROWS_AS(hotel.GetBookedRoomCount(2), std::out_of_range);
+	}
+
+	historyOptions.cancellable = true;
+	CHECK_THROWS_AS(CombiningHotelBookings(timeSpans, 2, historyOptions), std::invalid_argument);
+	CHECK_THROWS_AS(CombiningHotelBookings(timeSpans, 0), std::invalid_argument);
+}
+
+SCENARIO("Latency histogram")
+{
+	LatencyHistogram histogram;
+	CHECK(histogram.GetPercentile(50) == 0);
+
+	for (std::uint64_t value = 1; value <= 1000; ++value)
+	{
+		histogram.Record(value);
+	}
+	CHECK(histogram.GetCount() == 1000);
+	CHECK(histogram.GetMax() == 1000);
+	CHECK(histogram.GetSum() == 500500);
+	CHECK(histogram.GetPercentile(100) == 1000);
+
+	// Reported percentiles are rounded up to the bucket bound with an error below 1/16
+	const auto p50 = histogram.GetPercentile(50);
+	CHECK(p50 >= 500);
+	CHECK(p50 <= 500 + 500 / 16);
+	const auto p99 = histogram.GetPercentile(99);
+	CHECK(p99 >= 990);
+	CHECK(p99 <= 1000);
+
+	// Small values are stored exactly
+	LatencyHistogram small;
+	small.Record(3);
+	small.Record(7);
+	CHECK(small.GetPercentile(50) == 3);
+
+	histogram.Merge(small);
+	CHECK(histogram.GetCount() == 1002);
+	histogram.Reset();
+	CHECK(histogram.GetCount() == 0);
 }
 
 SCENARIO("Benchmark")
@@ -161,4 +1955,55 @@ SCENARIO("Benchmark")
 	std::cout << queryCount << " queries have been executed in "
 			  << duration_cast<chrono::milliseconds>(duration).count()
 			  << " ms\n";
+
+	// The same bookings on the sharded engine, with as many shards as producer threads.
+	// Producer p books the hotels with indices p, p + threadCount, ..., so each hotel is booked in time order
+	struct Booking
+	{
+		size_t hotelIndex;
+		ClientId client;
+		RoomCount roomCount;
+		Time time;
+	};
+	vector<Booking> bookings;
+	bookings.reserve(queryCount);
+	time = 0;
+	for (unsigned i = 0; i < queryCount; ++i)
+	{
+		Booking booking{ randHotel(gen), clients[randClient(gen)], randRoomCount(gen), 0 };
+		time += randTimeDelta(gen);
+		booking.time = time;
+		bookings.push_back(booking);
+	}
+	for (unsigned threadCount = 1; threadCount <= max(4u, thread::hardware_concurrency() / 2); threadCount *= 2)
+	{
+		ShardedEngineOptions options;
+		options.shardCount = threadCount;
+		options.producerCount = threadCount;
+		ShardedBookingEngine engine(BookingServiceOptions(), options);
+		const auto beginShardedTime = steady_clock::now();
+		vector<thread> producers;
+		for (unsigned producerIndex = 0; producerIndex < threadCount; ++producerIndex)
+		{
+			producers.emplace_back([&, producerIndex] {
+				auto& producer = engine.GetProducer(producerIndex);
+				for (auto& booking : bookings)
+				{
+					if (booking.hotelIndex % threadCount == producerIndex)
+					{
+						producer.Book(booking.time, hotels[booking.hotelIndex], booking.client, booking.roomCount);
+					}
+				}
+				producer.Flush();
+			});
+		}
+		for (auto& producer : producers)
+		{
+			producer.join();
+		}
+		const auto shardedDuration = steady_clock::now() - beginShardedTime;
+		std::cout << queryCount << " queries have been executed in "
+				  << duration_cast<chrono::milliseconds>(shardedDuration).count()
+				  << " ms by " << threadCount << " shards and " << threadCount << " producers\n";
+	}
 }